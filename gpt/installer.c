@@ -13,6 +13,7 @@
 
 #include "fat.h"
 #include "gpt.h"
+#include "../tlibc/blkcopy.h"
 
 #include <fcntl.h>
 #include <stdio.h>
@@ -169,12 +170,53 @@ static void copyin(void *fat, const char *src, const char *name) {
   fflush(stdin);
 }
 
+static void show_progress(const struct blkcopy_stats *st, void *ctx) {
+  uint64_t ms = st->elapsed_ns / 1000000;
+  fprintf(stderr, "\r%lu MiB written, %lu MB/s", (unsigned long)(st->bytes >> 20),
+          ms > 0 ? (unsigned long)(st->bytes / 1000 / ms) : 0ul);
+}
+
+// write a prebuilt disk image (such as gpt's a.img) to the destination.
+static int write_image(const char *image, const char *dst) {
+  int in = open(image, O_RDONLY);
+  if (in < 0) {
+    die("open image");
+  }
+  int out = open(dst, O_WRONLY);
+  if (out < 0) {
+    die("open dest");
+  }
+
+  struct blkcopy bc = {
+    .in = in,
+    .out = out,
+    .bs = 1 << 20,
+    .count = BLKCOPY_ALL,
+    .nbuf = 0,
+    .sparse = false,
+    .direct = true,
+    .progress = show_progress,
+    .ctx = NULL,
+  };
+  struct blkcopy_stats st;
+  int ret = blkcopy(&bc, &st);
+  if (ret == 0 && fsync(out) != 0) {
+    ret = -1;
+  }
+  fprintf(stderr, "\n%s: %lu bytes written\n", ret == 0 ? image : "failed",
+          (unsigned long)st.bytes);
+  close(in);
+  close(out);
+  return ret != 0;
+}
+
 static void usage(FILE *stream) {
   static const char *usage_string = "Usage:\n"
     "\t-k path to linux bzImage\n"
     "\t-d destination (a image file or a block device)\n"
     "\t-s size of first partition in MiB (Default 64)\n"
-    "\t-busybox path to static-linked busybox executable\n";
+    "\t-busybox path to static-linked busybox executable\n"
+    "\t-i write this disk image to the destination instead\n";
 
   fputs(usage_string, stream);
 }
@@ -182,6 +224,7 @@ static void usage(FILE *stream) {
 int main(int argc, char **argv) {
   const char *path_bzimage = NULL;
   const char *path_busybox = NULL;
+  const char *path_image = NULL;
   const char *dst = NULL;
   size_t boot_size = 64;
   bool print_help = false;;
@@ -205,6 +248,9 @@ int main(int argc, char **argv) {
     } else if (strcmp(cur, "-busybox") == 0) {
        path_busybox = argv[i + 1];
        i += 2;
+    } else if (strcmp(cur, "-i") == 0) {
+       path_image = argv[i + 1];
+       i += 2;
     }
   }
   //// handle incorrect usage
@@ -212,6 +258,9 @@ int main(int argc, char **argv) {
     usage(stdout);
     return 0;
   }
+  if (path_image != NULL && dst != NULL) {
+    return write_image(path_image, dst);
+  }
   if (path_bzimage == NULL) {
     fprintf(stderr, "Error: no bzimage provided.\n");
     usage(stderr);
@@ -0,0 +1,36 @@
+#include "std.h"
+#include "arena.h"
+
+bool arena_init(struct arena *a, size_t reserve) {
+    a->used = 0;
+    a->cap = reserve;
+    a->base = sys_mmap(NULL, reserve, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if ((long)a->base < 0) {
+        a->base = NULL;
+        a->cap = 0;
+        return false;
+    }
+    return true;
+}
+
+void *arena_alloc(struct arena *a, size_t size) {
+    size = (size + 7) & ~(size_t)7;
+    size_t off = __atomic_fetch_add(&a->used, size, __ATOMIC_RELAXED);
+    if (off + size > a->cap) {
+        return NULL;
+    }
+    return a->base + off;
+}
+
+void arena_reset(struct arena *a) {
+    a->used = 0;
+}
+
+void arena_destroy(struct arena *a) {
+    if (a->base != NULL) {
+        sys_munmap(a->base, a->cap);
+    }
+    a->base = NULL;
+    a->used = a->cap = 0;
+}
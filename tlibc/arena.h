@@ -0,0 +1,25 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+/** A bump allocator over one large anonymous mapping. Pages are only
+ * backed by memory once touched, so reserve generously. Allocation is
+ * a single atomic add and may be shared between threads. There is no
+ * free: release everything at once with arena_destroy. */
+
+#include <stddef.h>
+#include <stdbool.h>
+
+struct arena {
+    char *base;
+    size_t used;
+    size_t cap;
+};
+
+extern bool arena_init(struct arena *a, size_t reserve);
+/** Returns 8-byte aligned memory, or NULL if the reservation is exhausted. */
+extern void *arena_alloc(struct arena *a, size_t size);
+/** Forget all allocations, keeping the mapping. */
+extern void arena_reset(struct arena *a);
+extern void arena_destroy(struct arena *a);
+
+#endif // _ARENA_H_
@@ -0,0 +1,370 @@
+#if __STDC_HOSTED__
+#define _GNU_SOURCE     // O_DIRECT, before any libc header
+#endif
+#include "blkcopy.h"
+
+#define PAGE 4096ul
+#define PROGRESS_NS 1000000000ull
+
+#if __STDC_HOSTED__
+// hosted build (gpt/installer): the same primitives on top of libc.
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static long io_read(int fd, void *p, size_t n) {
+    long r = read(fd, p, n);
+    return r < 0 ? -errno : r;
+}
+
+static long io_write(int fd, const void *p, size_t n) {
+    long r = write(fd, p, n);
+    return r < 0 ? -errno : r;
+}
+
+static long io_skip(int fd, size_t n) {
+    long r = lseek(fd, n, SEEK_CUR);
+    return r < 0 ? -errno : r;
+}
+
+static int io_truncate(int fd, long len) {
+    return ftruncate(fd, len) < 0 ? -errno : 0;
+}
+
+static int get_flags(int fd) {
+    return fcntl(fd, F_GETFL);
+}
+
+static int set_flags(int fd, int flags) {
+    return fcntl(fd, F_SETFL, flags) < 0 ? -errno : 0;
+}
+
+static void *map_anon(size_t size) {
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+static void unmap(void *p, size_t size) {
+    munmap(p, size);
+}
+
+static void futex_wait(int *addr, int val) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void futex_wake(int *addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+typedef pthread_t reader_t;
+
+static int reader_main(void *arg);
+
+static void *reader_start(void *arg) {
+    reader_main(arg);
+    return NULL;
+}
+
+static int reader_spawn(reader_t *t, void *arg) {
+    return -pthread_create(t, NULL, reader_start, arg);
+}
+
+static void reader_join(reader_t *t) {
+    pthread_join(*t, NULL);
+}
+#else
+#include "std.h"
+#include "thread.h"
+
+static long io_read(int fd, void *p, size_t n) {
+    return sys_read(fd, p, n);
+}
+
+static long io_write(int fd, const void *p, size_t n) {
+    return sys_write(fd, p, n);
+}
+
+static long io_skip(int fd, size_t n) {
+    return sys_lseek(fd, n, SEEK_CUR);
+}
+
+static int io_truncate(int fd, long len) {
+    return sys_ftruncate(fd, len);
+}
+
+static int get_flags(int fd) {
+    return sys_fcntl(fd, F_GETFL, 0);
+}
+
+static int set_flags(int fd, int flags) {
+    return sys_fcntl(fd, F_SETFL, flags);
+}
+
+static void *map_anon(size_t size) {
+    void *p = sys_mmap(NULL, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (long)p < 0 ? NULL : p;
+}
+
+static void unmap(void *p, size_t size) {
+    sys_munmap(p, size);
+}
+
+static void futex_wait(int *addr, int val) {
+    sys_futex(addr, FUTEX_WAIT | FUTEX_PRIVATE_FLAG, val, NULL, NULL, 0);
+}
+
+static void futex_wake(int *addr) {
+    sys_futex(addr, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, 1, NULL, NULL, 0);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    sys_clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+typedef struct thread reader_t;
+
+static int reader_main(void *arg);
+
+static int reader_spawn(reader_t *t, void *arg) {
+    return thread_create(t, reader_main, arg);
+}
+
+static void reader_join(reader_t *t) {
+    thread_join(t);
+}
+#endif
+
+/** The ring shared by the reader thread and the writer. Block k goes
+ * to buffer k % nbuf; each side waits on the other's sequence word. */
+struct ring {
+    const struct blkcopy *bc;
+    char *mem;
+    size_t nbuf;
+    size_t bufsz;           // bs rounded up to pages
+    long *len;              // bytes in each buffer
+
+    uint64_t filled;        // blocks read, written by the reader
+    uint64_t drained;       // blocks written, written by the writer
+    int fseq;               // bumped with filled, and when the reader ends
+    int dseq;               // bumped with drained, and on stop
+    bool eof;               // the reader is done after filled blocks
+    bool stop;              // the writer gave up
+    int err;                // read error
+};
+
+/** Drop O_DIRECT from fd, when the kernel refused an unaligned transfer. */
+static bool undirect(int fd) {
+    int flags = get_flags(fd);
+    if (flags < 0 || !(flags & O_DIRECT)) {
+        return false;
+    }
+    return set_flags(fd, flags & ~O_DIRECT) == 0;
+}
+
+static int reader_main(void *arg) {
+    struct ring *r = arg;
+    const struct blkcopy *bc = r->bc;
+
+    for (uint64_t k = 0; k < bc->count; k++) {
+        // wait for a free buffer.
+        for (;;) {
+            int seq = __atomic_load_n(&r->dseq, __ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE)) {
+                goto out;
+            }
+            if (k - __atomic_load_n(&r->drained, __ATOMIC_ACQUIRE) < r->nbuf) {
+                break;
+            }
+            futex_wait(&r->dseq, seq);
+        }
+
+        char *buf = r->mem + (k % r->nbuf) * r->bufsz;
+        long n = io_read(bc->in, buf, bc->bs);
+        if (n == -EINVAL && undirect(bc->in)) {
+            n = io_read(bc->in, buf, bc->bs);
+        }
+        if (n <= 0) {
+            r->err = n;
+            break;
+        }
+        r->len[k % r->nbuf] = n;
+        __atomic_store_n(&r->filled, k + 1, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&r->fseq, 1, __ATOMIC_RELEASE);
+        futex_wake(&r->fseq);
+    }
+
+out:
+    __atomic_store_n(&r->eof, true, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&r->fseq, 1, __ATOMIC_RELEASE);
+    futex_wake(&r->fseq);
+    return 0;
+}
+
+static bool all_zero(const char *p, size_t len) {
+    const uint64_t *w = (const uint64_t *)p;  // buffers are page aligned
+    size_t i = 0;
+    for (; i < len / 8; i++) {
+        if (w[i] != 0) {
+            return false;
+        }
+    }
+    for (i *= 8; i < len; i++) {
+        if (p[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static long write_block(int fd, const char *p, size_t len) {
+    for (size_t done = 0; done < len; ) {
+        long w = io_write(fd, p + done, len - done);
+        if (w == -EINVAL && undirect(fd)) {
+            continue;
+        }
+        if (w <= 0) {
+            return w < 0 ? w : -EIO;
+        }
+        done += w;
+    }
+    return len;
+}
+
+int blkcopy(const struct blkcopy *bc, struct blkcopy_stats *st) {
+    static const struct blkcopy_stats zero;
+    *st = zero;
+    uint64_t start = now_ns();
+    if (bc->bs == 0 || bc->count == 0) {
+        return 0;
+    }
+
+    struct ring r = {
+        .bc = bc,
+        .nbuf = bc->nbuf > 0 ? bc->nbuf : BLKCOPY_NBUF,
+    };
+    // every buffer starts on a page, as O_DIRECT wants.
+    size_t bufsz = (bc->bs + PAGE - 1) & ~(PAGE - 1);
+    r.bufsz = bufsz;
+    // the lengths follow the buffers.
+    size_t memsz = r.nbuf * bufsz + r.nbuf * sizeof(long);
+    r.mem = map_anon(memsz);
+    if (r.mem == NULL) {
+        return -ENOMEM;
+    }
+    r.len = (long *)(r.mem + r.nbuf * bufsz);
+
+    // the flags belong to the open file, which others may share: they
+    // get them back as they were.
+    int in_flags = get_flags(bc->in);
+    int out_flags = get_flags(bc->out);
+    bool direct = bc->direct && bc->bs % PAGE == 0 && in_flags >= 0 && out_flags >= 0;
+    if (direct) {
+        // refused on some filesystems, which is fine.
+        set_flags(bc->in, in_flags | O_DIRECT);
+        set_flags(bc->out, out_flags | O_DIRECT);
+    }
+
+    reader_t reader;
+    int ret = reader_spawn(&reader, &r);
+    if (ret < 0) {
+        if (direct) {
+            set_flags(bc->in, in_flags);
+            set_flags(bc->out, out_flags);
+        }
+        unmap(r.mem, memsz);
+        return ret;
+    }
+
+    bool hole = false;      // the output ends in a skipped block
+    uint64_t reported = start;
+    for (uint64_t k = 0; ; k++) {
+        // wait for block k, or the end.
+        bool end = false;
+        for (;;) {
+            int seq = __atomic_load_n(&r.fseq, __ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&r.filled, __ATOMIC_ACQUIRE) > k) {
+                break;
+            }
+            if (__atomic_load_n(&r.eof, __ATOMIC_ACQUIRE)) {
+                end = __atomic_load_n(&r.filled, __ATOMIC_ACQUIRE) <= k;
+                if (end) {
+                    break;
+                }
+                continue;
+            }
+            futex_wait(&r.fseq, seq);
+        }
+        if (end) {
+            break;
+        }
+
+        const char *buf = r.mem + (k % r.nbuf) * bufsz;
+        long n = r.len[k % r.nbuf];
+        if (bc->sparse && all_zero(buf, n)) {
+            long off = io_skip(bc->out, n);
+            ret = off < 0 ? off : 0;
+            hole = true;
+        } else {
+            long w = write_block(bc->out, buf, n);
+            ret = w < 0 ? w : 0;
+            hole = false;
+        }
+        if (ret < 0) {
+            break;
+        }
+
+        bool full = (size_t)n == bc->bs;
+        st->full_in += full;
+        st->part_in += !full;
+        st->full_out += full;
+        st->part_out += !full;
+        st->bytes += n;
+
+        __atomic_store_n(&r.drained, k + 1, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&r.dseq, 1, __ATOMIC_RELEASE);
+        futex_wake(&r.dseq);
+
+        uint64_t t = now_ns();
+        if (bc->progress != NULL && t - reported >= PROGRESS_NS) {
+            st->elapsed_ns = t - start;
+            bc->progress(st, bc->ctx);
+            reported = t;
+        }
+    }
+
+    // stop the reader if the writer failed, then wait for it.
+    __atomic_store_n(&r.stop, true, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&r.dseq, 1, __ATOMIC_RELEASE);
+    futex_wake(&r.dseq);
+    reader_join(&reader);
+    if (direct) {
+        set_flags(bc->in, in_flags);
+        set_flags(bc->out, out_flags);
+    }
+
+    if (ret == 0 && r.err < 0) {
+        ret = r.err;
+    }
+    if (ret == 0 && hole) {
+        // a trailing hole only exists once the size covers it.
+        long end = io_skip(bc->out, 0);
+        ret = end < 0 ? end : io_truncate(bc->out, end);
+    }
+    unmap(r.mem, memsz);
+    st->elapsed_ns = now_ns() - start;
+    return ret;
+}
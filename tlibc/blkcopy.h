@@ -0,0 +1,46 @@
+#ifndef _BLKCOPY_H_
+#define _BLKCOPY_H_
+
+/** Block copier behind dd, also built into hosted programs (the gpt
+ * installer).
+ *
+ * A reader thread fills a ring of page aligned buffers while the
+ * calling thread writes them out, so reading and writing overlap.
+ * With direct set, O_DIRECT is tried on both fds and dropped again
+ * where the kernel refuses it (tmpfs, a short final block); either
+ * way both have their file status flags back on return. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BLKCOPY_ALL UINT64_MAX
+#define BLKCOPY_NBUF 4
+
+struct blkcopy_stats {
+    uint64_t full_in;       // records read completely
+    uint64_t part_in;       // short reads
+    uint64_t full_out;
+    uint64_t part_out;
+    uint64_t bytes;         // bytes written, holes included
+    uint64_t elapsed_ns;
+};
+
+struct blkcopy {
+    int in;
+    int out;
+    size_t bs;              // a multiple of 4096 for O_DIRECT
+    uint64_t count;         // blocks to copy, or BLKCOPY_ALL
+    int nbuf;               // buffers in the ring, 0 for BLKCOPY_NBUF
+    bool sparse;            // seek over all-zero blocks instead of writing them
+    bool direct;            // try O_DIRECT
+    /** Called from the copying thread about once a second. May be NULL. */
+    void (*progress)(const struct blkcopy_stats *st, void *ctx);
+    void *ctx;
+};
+
+/** Copy from the current offset of in to the current offset of out.
+ * Returns 0 or a negative errno; st is filled in either way. */
+extern int blkcopy(const struct blkcopy *bc, struct blkcopy_stats *st);
+
+#endif // _BLKCOPY_H_
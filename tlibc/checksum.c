@@ -0,0 +1,409 @@
+#include <stdbool.h>
+#include "checksum.h"
+
+// tlibc passes -D__X86_64__, hosted compilers define __x86_64__.
+#if defined(__X86_64__) || defined(__x86_64__)
+#define CHECKSUM_X86
+#endif
+
+#define CRC32_POLY  0xedb88320u   // reflected 0x04c11db7
+#define CRC32C_POLY 0x82f63b78u   // reflected 0x1edc6f41
+#define CKSUM_POLY  0x04c11db7u
+
+/** Slice-by-8 tables: [0] is the classic byte table, [k] advances a byte
+ * through k more zero bytes, so 8 lookups consume 8 bytes. */
+static uint32_t crc32_tab[8][256];
+static uint32_t crc32c_tab[8][256];
+static uint32_t cksum_tab[8][256];
+
+static uint32_t crc32_table(uint32_t crc, const uint8_t *p, size_t len);
+static uint32_t crc32c_table(uint32_t crc, const uint8_t *p, size_t len);
+static void sha256_blocks_c(uint32_t h[8], const uint8_t *p, size_t n);
+
+/** The implementations picked for this CPU. */
+static uint32_t (*crc32_impl)(uint32_t, const uint8_t *, size_t) = crc32_table;
+static uint32_t (*crc32c_impl)(uint32_t, const uint8_t *, size_t) = crc32c_table;
+static void (*sha256_blocks)(uint32_t h[8], const uint8_t *, size_t) = sha256_blocks_c;
+static int ready;
+
+static inline uint32_t load_le32(const uint8_t *p) {
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint32_t load_be32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void reflected_tables(uint32_t tab[8][256], uint32_t poly) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int j = 0; j < 8; j++) {
+            c = c & 1 ? (c >> 1) ^ poly : c >> 1;
+        }
+        tab[0][i] = c;
+    }
+    for (int k = 1; k < 8; k++) {
+        for (int i = 0; i < 256; i++) {
+            uint32_t c = tab[k - 1][i];
+            tab[k][i] = (c >> 8) ^ tab[0][c & 0xff];
+        }
+    }
+}
+
+static void cksum_tables(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i << 24;
+        for (int j = 0; j < 8; j++) {
+            c = c & 0x80000000u ? (c << 1) ^ CKSUM_POLY : c << 1;
+        }
+        cksum_tab[0][i] = c;
+    }
+    for (int k = 1; k < 8; k++) {
+        for (int i = 0; i < 256; i++) {
+            uint32_t c = cksum_tab[k - 1][i];
+            cksum_tab[k][i] = (c << 8) ^ cksum_tab[0][c >> 24];
+        }
+    }
+}
+
+/** -- portable -- */
+
+/** crc is the register value, not complemented. */
+static uint32_t slice8(uint32_t tab[8][256], uint32_t crc, const uint8_t *p, size_t len) {
+    for (; len >= 8; p += 8, len -= 8) {
+        uint32_t lo = crc ^ load_le32(p);
+        uint32_t hi = load_le32(p + 4);
+        crc = tab[7][lo & 0xff] ^ tab[6][(lo >> 8) & 0xff] ^
+              tab[5][(lo >> 16) & 0xff] ^ tab[4][lo >> 24] ^
+              tab[3][hi & 0xff] ^ tab[2][(hi >> 8) & 0xff] ^
+              tab[1][(hi >> 16) & 0xff] ^ tab[0][hi >> 24];
+    }
+    for (; len > 0; p++, len--) {
+        crc = (crc >> 8) ^ tab[0][(crc ^ *p) & 0xff];
+    }
+    return crc;
+}
+
+static uint32_t crc32_table(uint32_t crc, const uint8_t *p, size_t len) {
+    return slice8(crc32_tab, crc, p, len);
+}
+
+static uint32_t crc32c_table(uint32_t crc, const uint8_t *p, size_t len) {
+    return slice8(crc32c_tab, crc, p, len);
+}
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t ror(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static void sha256_blocks_c(uint32_t h[8], const uint8_t *p, size_t n) {
+    for (; n > 0; n--, p += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = load_be32(p + 4 * i);
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+        uint32_t e = h[4], f = h[5], g = h[6], k = h[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = k + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) +
+                          ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+            uint32_t t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) +
+                          ((a & b) ^ (a & c) ^ (b & c));
+            k = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+        h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+    }
+}
+
+/** -- x86 -- */
+
+#ifdef CHECKSUM_X86
+typedef long long v2di __attribute__((vector_size(16)));
+typedef long long v2diu __attribute__((vector_size(16), aligned(1)));
+typedef int v4si __attribute__((vector_size(16)));
+typedef int v4siu __attribute__((vector_size(16), aligned(1)));
+typedef short v8hi __attribute__((vector_size(16)));
+typedef char v16qi __attribute__((vector_size(16)));
+typedef char v16qiu __attribute__((vector_size(16), aligned(1)));
+typedef uint64_t u64u __attribute__((aligned(1)));
+
+#define CLMUL(a, b, imm) __builtin_ia32_pclmulqdq128((a), (b), (imm))
+
+/** Fold 64 bytes at a time into four 128-bit lanes with carry-less
+ * multiplies, then fold the lanes together and finish with a Barrett
+ * reduction. The constants are x^n mod P (bit reflected) for the fold
+ * distances, as in Intel's "Fast CRC Computation Using PCLMULQDQ".
+ * len must be at least 64 and a multiple of 16. */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul(uint32_t crc, const uint8_t *p, size_t len) {
+    const v2di k1k2 = {0x154442bd4, 0x1c6e41596};  // x^(4*128+32), x^(4*128-32)
+    const v2di k3k4 = {0x1751997d0, 0x0ccaa009e};  // x^(128+32), x^(128-32)
+    const v2di k5 = {0x163cd6124, 0};              // x^64
+    const v2di poly = {0x1db710641, 0x1f7011641};  // P and floor(x^64 / P)
+    const v2di mask32 = {0xffffffff, 0};
+
+    v2di x0 = *(const v2diu *)p ^ (v2di){crc, 0};
+    v2di x1 = *(const v2diu *)(p + 16);
+    v2di x2 = *(const v2diu *)(p + 32);
+    v2di x3 = *(const v2diu *)(p + 48);
+    for (p += 64, len -= 64; len >= 64; p += 64, len -= 64) {
+        x0 = CLMUL(x0, k1k2, 0x00) ^ CLMUL(x0, k1k2, 0x11) ^ *(const v2diu *)p;
+        x1 = CLMUL(x1, k1k2, 0x00) ^ CLMUL(x1, k1k2, 0x11) ^ *(const v2diu *)(p + 16);
+        x2 = CLMUL(x2, k1k2, 0x00) ^ CLMUL(x2, k1k2, 0x11) ^ *(const v2diu *)(p + 32);
+        x3 = CLMUL(x3, k1k2, 0x00) ^ CLMUL(x3, k1k2, 0x11) ^ *(const v2diu *)(p + 48);
+    }
+
+    x0 = CLMUL(x0, k3k4, 0x00) ^ CLMUL(x0, k3k4, 0x11) ^ x1;
+    x0 = CLMUL(x0, k3k4, 0x00) ^ CLMUL(x0, k3k4, 0x11) ^ x2;
+    x0 = CLMUL(x0, k3k4, 0x00) ^ CLMUL(x0, k3k4, 0x11) ^ x3;
+    for (; len >= 16; p += 16, len -= 16) {
+        x0 = CLMUL(x0, k3k4, 0x00) ^ CLMUL(x0, k3k4, 0x11) ^ *(const v2diu *)p;
+    }
+
+    // 128 to 64 bits, then 64 to 32.
+    x0 = CLMUL(x0, k3k4, 0x10) ^ (v2di){x0[1], 0};
+    v4si s = (v4si)x0;
+    x0 = (v2di)(v4si){s[1], s[2], s[3], 0} ^ CLMUL(x0 & mask32, k5, 0x00);
+
+    // Barrett reduction
+    v2di t = CLMUL(x0 & mask32, poly, 0x10);
+    t = CLMUL(t & mask32, poly, 0x00);
+    return ((v4si)(x0 ^ t))[1];
+}
+
+static uint32_t crc32_x86(uint32_t crc, const uint8_t *p, size_t len) {
+    if (len >= 64) {
+        size_t n = len & ~(size_t)15;
+        crc = crc32_pclmul(crc, p, n);
+        p += n;
+        len -= n;
+    }
+    return crc32_table(crc, p, len);
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *p, size_t len) {
+    uint64_t c = crc;
+    for (; len >= 8; p += 8, len -= 8) {
+        c = __builtin_ia32_crc32di(c, *(const u64u *)p);
+    }
+    for (; len > 0; p++, len--) {
+        c = __builtin_ia32_crc32qi(c, *p);
+    }
+    return c;
+}
+
+/** Two rounds per sha256rnds2 on the state split into ABEF and CDGH,
+ * the schedule computed 4 words at a time with sha256msg1/msg2. */
+__attribute__((target("sha,ssse3,sse4.1")))
+static void sha256_blocks_ni(uint32_t h[8], const uint8_t *p, size_t n) {
+    const v16qi bswap = {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12};
+
+    v4si t = __builtin_ia32_pshufd(*(const v4siu *)&h[0], 0xb1);        // CDAB
+    v4si s1 = __builtin_ia32_pshufd(*(const v4siu *)&h[4], 0x1b);       // EFGH
+    v4si s0 = (v4si)__builtin_ia32_palignr128((v2di)t, (v2di)s1, 64);   // ABEF
+    s1 = (v4si)__builtin_ia32_pblendw128((v8hi)s1, (v8hi)t, 0xf0);      // CDGH
+
+    for (; n > 0; n--, p += 64) {
+        v4si abef = s0;
+        v4si cdgh = s1;
+        v4si w[4];
+
+        for (int g = 0; g < 16; g++) {
+            if (g < 4) {
+                w[g] = (v4si)__builtin_ia32_pshufb128(*(const v16qiu *)(p + 16 * g), bswap);
+            }
+            v4si m = w[g % 4] + *(const v4siu *)&sha256_k[4 * g];
+            s1 = __builtin_ia32_sha256rnds2(s1, s0, m);
+            if (g >= 3 && g < 15) {
+                // w[g + 1] += words 4g - 7 ...; finish with msg2.
+                v4si prev = (v4si)__builtin_ia32_palignr128((v2di)w[g % 4], (v2di)w[(g + 3) % 4], 32);
+                w[(g + 1) % 4] = __builtin_ia32_sha256msg2(w[(g + 1) % 4] + prev, w[g % 4]);
+            }
+            m = __builtin_ia32_pshufd(m, 0x0e);
+            s0 = __builtin_ia32_sha256rnds2(s0, s1, m);
+            if (g >= 1 && g < 13) {
+                w[(g + 3) % 4] = __builtin_ia32_sha256msg1(w[(g + 3) % 4], w[g % 4]);
+            }
+        }
+        s0 += abef;
+        s1 += cdgh;
+    }
+
+    t = __builtin_ia32_pshufd(s0, 0x1b);                                 // FEBA
+    s1 = __builtin_ia32_pshufd(s1, 0xb1);                                // DCHG
+    *(v4siu *)&h[0] = (v4si)__builtin_ia32_pblendw128((v8hi)t, (v8hi)s1, 0xf0);            // DCBA
+    *(v4siu *)&h[4] = (v4si)__builtin_ia32_palignr128((v2di)s1, (v2di)t, 64);              // HGFE
+}
+
+static void cpuid(uint32_t leaf, uint32_t r[4]) {
+    __asm__ volatile("cpuid"
+                     : "=a"(r[0]), "=b"(r[1]), "=c"(r[2]), "=d"(r[3])
+                     : "a"(leaf), "c"(0));
+}
+#endif
+
+static void setup(void) {
+    reflected_tables(crc32_tab, CRC32_POLY);
+    reflected_tables(crc32c_tab, CRC32C_POLY);
+    cksum_tables();
+
+#ifdef CHECKSUM_X86
+    uint32_t r[4];
+    cpuid(0, r);
+    uint32_t max = r[0];
+    cpuid(1, r);
+    bool pclmul = r[2] & (1u << 1);
+    bool ssse3 = r[2] & (1u << 9);
+    bool sse41 = r[2] & (1u << 19);
+    bool sse42 = r[2] & (1u << 20);
+    if (pclmul && sse41) {
+        crc32_impl = crc32_x86;
+    }
+    if (sse42) {
+        crc32c_impl = crc32c_sse42;
+    }
+    if (max >= 7 && ssse3 && sse41) {
+        cpuid(7, r);
+        if (r[1] & (1u << 29)) {
+            sha256_blocks = sha256_blocks_ni;
+        }
+    }
+#endif
+    __atomic_store_n(&ready, 1, __ATOMIC_RELEASE);
+}
+
+// racing first calls all compute the same tables, which is harmless.
+static inline void need_setup(void) {
+    if (!__atomic_load_n(&ready, __ATOMIC_ACQUIRE)) {
+        setup();
+    }
+}
+
+/** -- interface -- */
+
+uint32_t crc32_update(uint32_t crc, const void *buf, size_t len) {
+    need_setup();
+    return ~crc32_impl(~crc, buf, len);
+}
+
+uint32_t crc32c_update(uint32_t crc, const void *buf, size_t len) {
+    need_setup();
+    return ~crc32c_impl(~crc, buf, len);
+}
+
+uint32_t cksum_update(uint32_t crc, const void *buf, size_t len) {
+    need_setup();
+    const uint8_t *p = buf;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint32_t hi = crc ^ load_be32(p);
+        uint32_t lo = load_be32(p + 4);
+        crc = cksum_tab[7][hi >> 24] ^ cksum_tab[6][(hi >> 16) & 0xff] ^
+              cksum_tab[5][(hi >> 8) & 0xff] ^ cksum_tab[4][hi & 0xff] ^
+              cksum_tab[3][lo >> 24] ^ cksum_tab[2][(lo >> 16) & 0xff] ^
+              cksum_tab[1][(lo >> 8) & 0xff] ^ cksum_tab[0][lo & 0xff];
+    }
+    for (; len > 0; p++, len--) {
+        crc = (crc << 8) ^ cksum_tab[0][(crc >> 24) ^ *p];
+    }
+    return crc;
+}
+
+uint32_t cksum_final(uint32_t crc, uint64_t len) {
+    need_setup();
+    for (; len != 0; len >>= 8) {
+        crc = (crc << 8) ^ cksum_tab[0][(crc >> 24) ^ (len & 0xff)];
+    }
+    return ~crc;
+}
+
+void sha256_init(struct sha256 *ctx) {
+    static const uint32_t h0[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    need_setup();
+    for (int i = 0; i < 8; i++) {
+        ctx->h[i] = h0[i];
+    }
+    ctx->len = 0;
+}
+
+void sha256_update(struct sha256 *ctx, const void *buf, size_t len) {
+    const uint8_t *p = buf;
+    size_t fill = ctx->len % 64;
+    ctx->len += len;
+
+    if (fill > 0) {
+        size_t n = 64 - fill < len ? 64 - fill : len;
+        for (size_t i = 0; i < n; i++) {
+            ctx->buf[fill + i] = p[i];
+        }
+        p += n;
+        len -= n;
+        if (fill + n < 64) {
+            return;
+        }
+        sha256_blocks(ctx->h, ctx->buf, 1);
+    }
+
+    sha256_blocks(ctx->h, p, len / 64);
+    p += len & ~(size_t)63;
+    len %= 64;
+    for (size_t i = 0; i < len; i++) {
+        ctx->buf[i] = p[i];
+    }
+}
+
+void sha256_final(struct sha256 *ctx, uint8_t digest[SHA256_DIGEST]) {
+    size_t fill = ctx->len % 64;
+    uint64_t bits = ctx->len * 8;
+
+    ctx->buf[fill++] = 0x80;
+    if (fill > 56) {
+        for (; fill < 64; fill++) {
+            ctx->buf[fill] = 0;
+        }
+        sha256_blocks(ctx->h, ctx->buf, 1);
+        fill = 0;
+    }
+    for (; fill < 56; fill++) {
+        ctx->buf[fill] = 0;
+    }
+    for (int i = 0; i < 8; i++) {
+        ctx->buf[56 + i] = bits >> (56 - 8 * i);
+    }
+    sha256_blocks(ctx->h, ctx->buf, 1);
+
+    for (int i = 0; i < 8; i++) {
+        digest[4 * i] = ctx->h[i] >> 24;
+        digest[4 * i + 1] = ctx->h[i] >> 16;
+        digest[4 * i + 2] = ctx->h[i] >> 8;
+        digest[4 * i + 3] = ctx->h[i];
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef _CHECKSUM_H_
+#define _CHECKSUM_H_
+
+/** CRC32, CRC32C, POSIX cksum CRC and SHA-256.
+ *
+ * Only needs <stdint.h> and <stddef.h>, so it builds both inside tlibc
+ * and in hosted programs such as gpt. The fastest implementation the
+ * CPU supports is picked on first use: PCLMULQDQ folding for CRC32, the
+ * SSE4.2 crc32 instruction for CRC32C and the SHA extensions for
+ * SHA-256, with slice-by-8 tables and plain C everywhere else. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** CRC32 as in zlib, gzip and GPT; start with crc = 0. */
+extern uint32_t crc32_update(uint32_t crc, const void *buf, size_t len);
+
+/** CRC32C (Castagnoli) as in iSCSI and ext4; start with crc = 0. */
+extern uint32_t crc32c_update(uint32_t crc, const void *buf, size_t len);
+
+/** The CRC of POSIX cksum, without the length; start with crc = 0. */
+extern uint32_t cksum_update(uint32_t crc, const void *buf, size_t len);
+/** Append the total length and complement, giving what cksum prints. */
+extern uint32_t cksum_final(uint32_t crc, uint64_t len);
+
+struct sha256 {
+    uint32_t h[8];
+    uint64_t len;       // bytes hashed so far
+    uint8_t buf[64];    // partial block
+};
+
+#define SHA256_DIGEST 32
+
+extern void sha256_init(struct sha256 *ctx);
+extern void sha256_update(struct sha256 *ctx, const void *buf, size_t len);
+extern void sha256_final(struct sha256 *ctx, uint8_t digest[SHA256_DIGEST]);
+
+#endif // _CHECKSUM_H_
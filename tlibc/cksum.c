@@ -0,0 +1,51 @@
+#include "std.h"
+#include "checksum.h"
+
+#define BUFSZ (1 << 20)
+
+static char buf[BUFSZ];
+
+/** Print the POSIX CRC and the size, like cksum(1). */
+static int sum(const char *path) {
+    int fd = path == NULL ? 0 : sys_open(path, O_RDONLY);
+    if (fd < 0) {
+        return fd;
+    }
+
+    uint32_t crc = 0;
+    uint64_t len = 0;
+    long r;
+    while ((r = sys_read(fd, buf, sizeof(buf))) > 0) {
+        crc = cksum_update(crc, buf, r);
+        len += r;
+    }
+    if (fd != 0) {
+        sys_close(fd);
+    }
+    if (r < 0) {
+        return r;
+    }
+
+    if (path == NULL) {
+        Printf("%u %L\n", cksum_final(crc, len), len);
+    } else {
+        Printf("%u %L %s\n", cksum_final(crc, len), len, path);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int ret = 0;
+    if (argc == 1) {
+        ret |= sum(NULL) < 0;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (sum(Strcmp(argv[i], "-") == 0 ? NULL : argv[i]) < 0) {
+            sys_write(2, "cksum: cannot read ", 19);
+            sys_write(2, argv[i], Strlen(argv[i]));
+            sys_write(2, "\n", 1);
+            ret = 1;
+        }
+    }
+    return ret;
+}
@@ -11,6 +11,9 @@ LDFLAGS = "-nostdlib"
 # program prefix
 PREFIX = "_"
 
+# multi-call build: one binary, tlibc, holding every program
+MULTICALL = False
+
 def main() -> int:
     with open('dependencies.json', 'r') as fobj:
         depl: dict = json.load(fobj);
@@ -41,18 +44,45 @@ def main() -> int:
         fobj.write("\n")
 
         # target: uproc
-        for d in depl.keys():
-            pn = f"{PREFIX}{d}"
-            obj = ' '.join(depl[d])
-            fobj.write(f"{pn}: {obj} \n\t$(LD) {obj} -o {pn} \n")
+        if MULTICALL:
+            write_multicall(fobj, depl)
+        else:
+            for d in depl.keys():
+                pn = f"{PREFIX}{d}"
+                obj = ' '.join(depl[d])
+                fobj.write(f"{pn}: {obj} \n\t$(LD) {obj} -o {pn} \n")
         fobj.write("\n")
         
         # miscellaneous: clean, collect
-        fobj.write("\n.PHONY: clean collect\n")
+        fobj.write("\n.PHONY: clean collect multicall\n")
         fobj.write("clean:\n\t-rm -f *.o *.d _*\n")
         fobj.write(f"collect:\n\t@echo {' '.join(uproc)}\n")
+        fobj.write(f"multicall:\n\t@echo {'tlibc' if MULTICALL else ''}\n")
     return 0;
 
+def write_multicall(fobj, depl: dict):
+    """ Every program's main is renamed to <name>_main and linked into
+    one binary with multicall.o, which calls the one named by argv[0].
+    The programs are links to it. """
+    names = sorted(depl.keys())
+    with open('applets.h', 'w') as h:
+        h.write("// auto generated, do not modify.\n")
+        for d in names:
+            h.write(f"APPLET({d})\n")
+
+    libs: list = []
+    for d in names:
+        for o in depl[d]:
+            if o != f"{d}.o" and o not in libs:
+                libs.append(o)
+    obj = ' '.join(["multicall.o"] + [f"{d}.mc.o" for d in names] + libs)
+
+    fobj.write("%.mc.o: %.c\n\t$(CC) $(CFLAGS) -DMULTICALL -Dmain=$*_main -c $< -o $@\n")
+    fobj.write("multicall.o: applets.h\n\n")
+    fobj.write(f"{PREFIX}tlibc: {obj} \n\t$(LD) {obj} -o {PREFIX}tlibc \n")
+    for d in names:
+        fobj.write(f"{PREFIX}{d}: {PREFIX}tlibc \n\tln -sf {PREFIX}tlibc {PREFIX}{d} \n")
+
 if __name__ == "__main__":
     # architecture info
     ARCH = {
@@ -64,4 +94,8 @@ if __name__ == "__main__":
     CFLAGS += ARCH[a]
     t = input(f"CFLAGS = {CFLAGS}")
     CFLAGS += t
+    try:
+        MULTICALL = input("multi-call binary? (y/N)").strip().lower() == "y"
+    except EOFError:
+        MULTICALL = False
     exit(main())
@@ -0,0 +1,333 @@
+#include "std.h"
+#include "thread.h"
+#include "walk.h"
+
+#define PATH_MAX 4096
+#define COPY_CHUNK (1ul << 30)
+#define RW_BUFSZ 65536
+
+static struct {
+    bool recursive;     // -r
+    bool preserve;      // -p: setuid, setgid and sticky bits too
+} opt;
+
+/** Where the tree being copied goes. */
+static struct {
+    const char *src;
+    size_t srclen;
+    const char *dst;
+} root;
+
+static struct mutex errlock;
+static int failed;
+
+static void complain(const char *what, const char *path) {
+    mutex_lock(&errlock);
+    failed = 1;
+    sys_write(2, "cp: ", 4);
+    sys_write(2, what, Strlen(what));
+    sys_write(2, " ", 1);
+    sys_write(2, path, Strlen(path));
+    sys_write(2, "\n", 1);
+    mutex_unlock(&errlock);
+}
+
+/** The ways to move bytes, fastest first. Once one is refused for a
+ * file, the next is tried for the rest of that file. */
+enum method {
+    BY_COPY_FILE_RANGE = 0,
+    BY_SENDFILE,
+    BY_READ_WRITE,
+};
+
+static bool unsupported(long err) {
+    return err == -EXDEV || err == -ENOSYS || err == -EINVAL ||
+           err == -EOPNOTSUPP || err == -EBADF;
+}
+
+/** Copy [off, off + len) of in to the same offset of out. */
+static int copy_range(int in, int out, long off, long len, enum method *how) {
+    while (len > 0) {
+        size_t n = len < (long)COPY_CHUNK ? len : COPY_CHUNK;
+        long r;
+
+        switch (*how) {
+        case BY_COPY_FILE_RANGE: {
+            long off_in = off;
+            long off_out = off;
+            r = sys_copy_file_range(in, &off_in, out, &off_out, n, 0);
+            break;
+        }
+        case BY_SENDFILE: {
+            long off_in = off;
+            sys_lseek(out, off, SEEK_SET);
+            r = sys_sendfile(out, in, &off_in, n);
+            break;
+        }
+        default: {
+            char buf[RW_BUFSZ];
+            r = sys_pread(in, buf, n < sizeof(buf) ? n : sizeof(buf), off);
+            for (long done = 0; done < r; ) {
+                long w = sys_pwrite(out, buf + done, r - done, off + done);
+                if (w <= 0) {
+                    return w < 0 ? w : -EIO;
+                }
+                done += w;
+            }
+            break;
+        }
+        }
+
+        if (r < 0 && *how != BY_READ_WRITE && unsupported(r)) {
+            (*how)++;
+            continue;
+        }
+        if (r < 0) {
+            return r;
+        }
+        if (r == 0) {
+            // the source shrank under us.
+            return 0;
+        }
+        off += r;
+        len -= r;
+    }
+    return 0;
+}
+
+/** Copy the contents of in to the empty file out, keeping holes. */
+static int copy_fd(int in, int out, uint64_t size) {
+    // a reflink shares the extents and is done in no time.
+    if (sys_ioctl(out, FICLONE, in) == 0) {
+        return 0;
+    }
+
+    enum method how = BY_COPY_FILE_RANGE;
+    long off = 0;
+    while ((uint64_t)off < size) {
+        long data = sys_lseek(in, off, SEEK_DATA);
+        if (data == -ENXIO) {
+            // nothing but a hole up to EOF.
+            break;
+        }
+        if (data < 0) {
+            // no SEEK_DATA here: everything is data.
+            data = off;
+        }
+        long hole = sys_lseek(in, data, SEEK_HOLE);
+        if (hole < 0 || (uint64_t)hole > size) {
+            hole = size;
+        }
+
+        int r = copy_range(in, out, data, hole - data, &how);
+        if (r < 0) {
+            return r;
+        }
+        off = hole;
+    }
+
+    // set the size, so a trailing hole is kept too.
+    return sys_ftruncate(out, size);
+}
+
+/** The permissions a copy of st gets. */
+static int copy_mode(const struct stat *st) {
+    return st->st_mode & (opt.preserve ? 07777 : 0777);
+}
+
+/** Copy the file to dst; 1, and nothing done, if dst is that file. */
+static int copy_file(int dirfd, const char *name, const char *dst, const struct stat *st) {
+    int in = sys_openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        return in;
+    }
+    // private until it has its mode, which goes on the fd, not the path;
+    // and not truncated before we know it is not the source itself.
+    int out = sys_openat_mode(AT_FDCWD, dst, O_WRONLY | O_CREAT | O_CLOEXEC, 0600);
+    if (out < 0) {
+        sys_close(in);
+        return out;
+    }
+    struct stat ost;
+    int r = sys_fstat(out, &ost);
+    if (r == 0 && ost.st_dev == st->st_dev && ost.st_ino == st->st_ino) {
+        r = 1;
+    }
+    if (r != 0 || (r = sys_ftruncate(out, 0)) < 0) {
+        sys_close(in);
+        sys_close(out);
+        return r;
+    }
+    sys_fchmod(out, copy_mode(st));
+
+    r = copy_fd(in, out, st->st_size);
+    sys_close(in);
+    sys_close(out);
+    return r;
+}
+
+static int copy_link(int dirfd, const char *name, const char *dst) {
+    char target[PATH_MAX];
+    long n = sys_readlinkat(dirfd, name, target, sizeof(target) - 1);
+    if (n < 0) {
+        return n;
+    }
+    target[n] = 0;
+    return sys_symlinkat(target, AT_FDCWD, dst);
+}
+
+/** Destination of a path below the source root. */
+static bool dst_path(char *dst, const char *path) {
+    const char *rel = path + root.srclen;
+    size_t dlen = Strlen(root.dst);
+    size_t rlen = Strlen(rel);
+    if (dlen + rlen + 2 > PATH_MAX) {
+        return false;
+    }
+    Memcpy(dst, root.dst, dlen);
+    if (rlen > 0 && rel[0] != '/') {
+        dst[dlen++] = '/';
+    }
+    Memcpy(dst + dlen, rel, rlen + 1);
+    return true;
+}
+
+// runs on the walker's threads, so the files of a tree are copied in parallel.
+static int visit(struct walk_entry *e, void *ctx) {
+    char dst[PATH_MAX];
+    if (!dst_path(dst, e->path)) {
+        complain("path too long:", e->path);
+        return WALK_SKIP;
+    }
+
+    int r = 0;
+    switch (e->type) {
+    case DT_DIR: {
+        if (!opt.recursive) {
+            complain("omitting directory", e->path);
+            return WALK_SKIP;
+        }
+        // keep it writable until its contents are in place, see post().
+        r = sys_mkdir(dst, copy_mode(e->st) | 0700);
+        if (r == -EEXIST) {
+            r = 0;
+        }
+        break;
+    }
+    case DT_REG: {
+        r = copy_file(e->dirfd, e->name, dst, e->st);
+        if (r == 1) {
+            char msg[PATH_MAX + 32];
+            Sprintf(msg, "and %s are the same file", dst);
+            complain(e->path, msg);
+            return 0;
+        }
+        break;
+    }
+    case DT_LNK: {
+        r = copy_link(e->dirfd, e->name, dst);
+        break;
+    }
+    default: {
+        complain("skipping special file", e->path);
+        return 0;
+    }
+    }
+
+    if (r < 0) {
+        complain("cannot copy", e->path);
+        return WALK_SKIP;
+    }
+    return 0;
+}
+
+static void post(struct walk_entry *e, void *ctx) {
+    char dst[PATH_MAX];
+    struct stat st;
+    if (dst_path(dst, e->path) && sys_fstatat(AT_FDCWD, e->path, &st, 0) == 0) {
+        sys_fchmodat(AT_FDCWD, dst, copy_mode(&st));
+    }
+}
+
+static void error(const char *path, int err, void *ctx) {
+    complain("cannot access", path);
+}
+
+static const char *basename(const char *path) {
+    const char *b = path;
+    for (const char *p = path; *p; p++) {
+        if (*p == '/' && p[1] != 0 && p[1] != '/') {
+            b = p + 1;
+        }
+    }
+    return b;
+}
+
+static bool is_dir(const char *path) {
+    struct stat st;
+    return sys_fstatat(AT_FDCWD, path, &st, 0) == 0 && (st.st_mode & S_IFMT) == S_IFDIR;
+}
+
+static void cp(const char *src, const char *dst, bool into) {
+    static const struct walk_ops ops = {
+        .visit = visit,
+        .post = post,
+        .error = error,
+        .ctx = NULL,
+    };
+    static char target[PATH_MAX];
+
+    if (into) {
+        // copy to dst/basename(src)
+        const char *b = basename(src);
+        size_t dlen = Strlen(dst);
+        size_t blen = 0;
+        for (; b[blen] && b[blen] != '/'; blen++) {
+        }
+        if (dlen + blen + 2 > PATH_MAX) {
+            complain("path too long:", dst);
+            return;
+        }
+        Memcpy(target, dst, dlen);
+        target[dlen++] = '/';
+        Memcpy(target + dlen, b, blen);
+        target[dlen + blen] = 0;
+        dst = target;
+    }
+
+    root.src = src;
+    root.srclen = Strlen(src);
+    root.dst = dst;
+    walk(src, WALK_STAT, &ops);
+}
+
+int main(int argc, char **argv) {
+    int first = 1;
+    for (; first < argc && argv[first][0] == '-' && argv[first][1] != 0; first++) {
+        for (const char *f = argv[first] + 1; *f; f++) {
+            if (*f == 'p') {
+                opt.preserve = true;
+            } else if (*f == 'r' || *f == 'R') {
+                opt.recursive = true;
+            } else {
+                sys_write(2, "Usage: cp [-rp] <src>... <dst>\n", 31);
+                return 1;
+            }
+        }
+    }
+    if (argc - first < 2) {
+        sys_write(2, "Usage: cp [-rp] <src>... <dst>\n", 31);
+        return 1;
+    }
+
+    const char *dst = argv[argc - 1];
+    bool into = is_dir(dst);
+    if (argc - first > 2 && !into) {
+        complain("not a directory:", dst);
+        return 1;
+    }
+    for (int i = first; i < argc - 1; i++) {
+        cp(argv[i], dst, into);
+    }
+    return failed;
+}
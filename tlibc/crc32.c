@@ -0,0 +1,59 @@
+#include "std.h"
+#include "checksum.h"
+
+#define BUFSZ (1 << 20)
+
+static char buf[BUFSZ];
+static uint32_t (*update)(uint32_t crc, const void *buf, size_t len) = crc32_update;
+
+static int sum(const char *path) {
+    int fd = path == NULL ? 0 : sys_open(path, O_RDONLY);
+    if (fd < 0) {
+        return fd;
+    }
+
+    uint32_t crc = 0;
+    long r;
+    while ((r = sys_read(fd, buf, sizeof(buf))) > 0) {
+        crc = update(crc, buf, r);
+    }
+    if (fd != 0) {
+        sys_close(fd);
+    }
+    if (r < 0) {
+        return r;
+    }
+
+    // %x has no zero padding.
+    static const char hex[] = "0123456789abcdef";
+    char digits[9];
+    for (int i = 0; i < 8; i++) {
+        digits[i] = hex[(crc >> (28 - 4 * i)) & 0xf];
+    }
+    digits[8] = 0;
+    Printf("%s  %s\n", digits, path == NULL ? "-" : path);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int first = 1;
+    if (first < argc && Strcmp(argv[first], "-c") == 0) {
+        // CRC32C instead
+        update = crc32c_update;
+        first++;
+    }
+
+    int ret = 0;
+    if (first == argc) {
+        ret |= sum(NULL) < 0;
+    }
+    for (int i = first; i < argc; i++) {
+        if (sum(Strcmp(argv[i], "-") == 0 ? NULL : argv[i]) < 0) {
+            sys_write(2, "crc32: cannot read ", 19);
+            sys_write(2, argv[i], Strlen(argv[i]));
+            sys_write(2, "\n", 1);
+            ret = 1;
+        }
+    }
+    return ret;
+}
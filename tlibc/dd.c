@@ -0,0 +1,197 @@
+#include "std.h"
+#include "blkcopy.h"
+
+static struct {
+    const char *in;         // if=
+    const char *out;        // of=
+    uint64_t bs;            // bs=
+    uint64_t count;         // count=
+    uint64_t skip;          // skip=, in blocks
+    uint64_t seek;          // seek=, in blocks
+    bool sparse;            // conv=sparse
+    bool notrunc;           // conv=notrunc
+    bool fsync;             // conv=fsync
+    bool progress;          // status=progress
+    bool quiet;             // status=none
+} opt;
+
+static void die(const char *what, const char *arg) {
+    sys_write(2, "dd: ", 4);
+    sys_write(2, what, Strlen(what));
+    if (arg != NULL) {
+        sys_write(2, arg, Strlen(arg));
+    }
+    sys_write(2, "\n", 1);
+    sys_exit(1);
+}
+
+/** A number with an optional k/M/G (binary) suffix. */
+static uint64_t parse_num(const char *s) {
+    const char *p = s;
+    uint64_t v = 0;
+    for (; *p >= '0' && *p <= '9'; p++) {
+        v = v * 10 + (*p - '0');
+    }
+    switch (*p) {
+    case 'k': case 'K': v <<= 10; p++; break;
+    case 'M': v <<= 20; p++; break;
+    case 'G': v <<= 30; p++; break;
+    }
+    if (p == s || *p != 0) {
+        die("invalid number: ", s);
+    }
+    return v;
+}
+
+/** Print "bytes copied, seconds, rate" for the whole run or the progress line. */
+static void report(const struct blkcopy_stats *st, const char *end) {
+    static char line[256];
+    uint64_t ms = st->elapsed_ns / 1000000;
+    uint64_t rate = st->elapsed_ns > 0 ? st->bytes * 1000 / st->elapsed_ns : 0;  // MB/s
+    char frac[4] = {
+        '0' + ms % 1000 / 100, '0' + ms % 100 / 10, '0' + ms % 10, 0,
+    };
+    unsigned n = Sprintf(line, "%L bytes copied, %L.%s s, %L MB/s%s",
+                         st->bytes, ms / 1000, frac, rate, end);
+    sys_write(2, line, n);
+}
+
+static void progress(const struct blkcopy_stats *st, void *ctx) {
+    report(st, "\r");
+}
+
+static void set_conv(const char *v) {
+    while (*v) {
+        const char *e = v;
+        while (*e && *e != ',') {
+            e++;
+        }
+        size_t len = e - v;
+        if (len == 6 && Memcmp(v, "sparse", 6) == 0) {
+            opt.sparse = true;
+        } else if (len == 7 && Memcmp(v, "notrunc", 7) == 0) {
+            opt.notrunc = true;
+        } else if (len == 5 && Memcmp(v, "fsync", 5) == 0) {
+            opt.fsync = true;
+        } else {
+            die("unknown conv: ", v);
+        }
+        v = *e ? e + 1 : e;
+    }
+}
+
+/** Move fd forward n bytes; read them away if it cannot seek. */
+static void skip(int fd, uint64_t n, const char *what) {
+    if (n == 0 || sys_lseek(fd, n, SEEK_CUR) >= 0) {
+        return;
+    }
+    static char buf[65536];
+    while (n > 0) {
+        long r = sys_read(fd, buf, n < sizeof(buf) ? n : sizeof(buf));
+        if (r <= 0) {
+            die("cannot skip in ", what);
+        }
+        n -= r;
+    }
+}
+
+int main(int argc, char **argv) {
+    opt.bs = 512;
+    opt.count = BLKCOPY_ALL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = a;
+        while (*v && *v != '=') {
+            v++;
+        }
+        if (*v != '=') {
+            die("bad operand: ", a);
+        }
+        v++;
+        size_t klen = v - 1 - a;
+
+#define IS(key) (klen == sizeof(key) - 1 && Memcmp(a, key, klen) == 0)
+        if (IS("if")) {
+            opt.in = v;
+        } else if (IS("of")) {
+            opt.out = v;
+        } else if (IS("bs")) {
+            opt.bs = parse_num(v);
+        } else if (IS("count")) {
+            opt.count = parse_num(v);
+        } else if (IS("skip")) {
+            opt.skip = parse_num(v);
+        } else if (IS("seek")) {
+            opt.seek = parse_num(v);
+        } else if (IS("conv")) {
+            set_conv(v);
+        } else if (IS("status")) {
+            opt.progress = Strcmp(v, "progress") == 0;
+            opt.quiet = Strcmp(v, "none") == 0;
+        } else {
+            die("bad operand: ", a);
+        }
+#undef IS
+    }
+    if (opt.bs == 0) {
+        die("bs must not be 0", NULL);
+    }
+
+    int in = 0;
+    if (opt.in != NULL && (in = sys_open(opt.in, O_RDONLY)) < 0) {
+        die("cannot open ", opt.in);
+    }
+    int out = 1;
+    if (opt.out != NULL) {
+        out = sys_openat_mode(AT_FDCWD, opt.out, O_WRONLY | O_CREAT, 0666);
+        if (out < 0) {
+            die("cannot open ", opt.out);
+        }
+    }
+
+    skip(in, opt.skip * opt.bs, opt.in ? opt.in : "standard input");
+    if (opt.seek > 0 && sys_lseek(out, opt.seek * opt.bs, SEEK_CUR) < 0) {
+        die("cannot seek in ", opt.out ? opt.out : "standard output");
+    }
+    struct stat st;
+    if (opt.out != NULL && !opt.notrunc &&
+        sys_fstat(out, &st) == 0 && (st.st_mode & S_IFMT) == S_IFREG) {
+        sys_ftruncate(out, opt.seek * opt.bs);
+    }
+
+    struct blkcopy bc = {
+        .in = in,
+        .out = out,
+        .bs = opt.bs,
+        .count = opt.count,
+        .nbuf = 0,
+        .sparse = opt.sparse,
+        // bypass the page cache whenever the block size allows it, but
+        // only on files of our own: an inherited stdin or stdout is
+        // shared with whoever else holds it.
+        .direct = opt.in != NULL && opt.out != NULL,
+        .progress = opt.progress ? progress : NULL,
+        .ctx = NULL,
+    };
+    struct blkcopy_stats stats;
+    int r = blkcopy(&bc, &stats);
+    if (r == 0 && opt.fsync) {
+        r = sys_fsync(out);
+    }
+
+    if (!opt.quiet) {
+        char line[128];
+        unsigned n = Sprintf(line, "%L+%L records in\n%L+%L records out\n",
+                             stats.full_in, stats.part_in, stats.full_out, stats.part_out);
+        if (opt.progress) {
+            sys_write(2, "\n", 1);
+        }
+        sys_write(2, line, n);
+        report(&stats, "\n");
+    }
+    if (r < 0) {
+        die("copy failed", NULL);
+    }
+    return 0;
+}
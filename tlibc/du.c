@@ -0,0 +1,92 @@
+#include "std.h"
+#include "thread.h"
+#include "walk.h"
+
+static struct {
+    bool all;       // -a: also list files
+    bool summary;   // -s: only the arguments
+} opt;
+
+/** Callbacks run on several threads, the output is shared. */
+static struct mutex outlock;
+static char out[65536];
+static size_t outlen;
+
+static void flush(void) {
+    sys_write(1, out, outlen);
+    outlen = 0;
+}
+
+static void emit(uint64_t bytes, const char *path) {
+    mutex_lock(&outlock);
+    if (outlen + Strlen(path) + 32 > sizeof(out)) {
+        flush();
+    }
+    outlen += Sprintf(out + outlen, "%L\t%s\n", (bytes + 1023) / 1024, path);
+    mutex_unlock(&outlock);
+}
+
+static int visit(struct walk_entry *e, void *ctx) {
+    e->weight = e->st->st_blocks * 512;
+    if (e->type != DT_DIR && (e->depth == 0 || (opt.all && !opt.summary))) {
+        emit(e->weight, e->path);
+    }
+    return 0;
+}
+
+static void post(struct walk_entry *e, void *ctx) {
+    if (!opt.summary || e->depth == 0) {
+        emit(e->total, e->path);
+    }
+}
+
+static void error(const char *path, int err, void *ctx) {
+    mutex_lock(&outlock);
+    sys_write(2, "du: cannot access ", 18);
+    sys_write(2, path, Strlen(path));
+    sys_write(2, "\n", 1);
+    mutex_unlock(&outlock);
+}
+
+int main(int argc, char **argv) {
+    static const struct walk_ops ops = {
+        .visit = visit,
+        .post = post,
+        .error = error,
+        .ctx = NULL,
+    };
+    int npath = 0;
+    int ret = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] != 0) {
+            for (const char *f = argv[i] + 1; *f; f++) {
+                switch (*f) {
+                case 'a': opt.all = true; break;
+                case 's': opt.summary = true; break;
+                case 'k': break;
+                default: {
+                    sys_write(2, "Usage: du [-aks] [path...]\n", 27);
+                    return 1;
+                }
+                }
+            }
+            argv[i] = NULL;
+            continue;
+        }
+        npath++;
+    }
+
+    // sizes are in KiB, hard links are only counted once.
+    for (int i = 1; i < argc; i++) {
+        if (argv[i] != NULL && walk(argv[i], WALK_STAT | WALK_DEDUP, &ops) != 0) {
+            ret = 1;
+        }
+    }
+    if (npath == 0 && walk(".", WALK_STAT | WALK_DEDUP, &ops) != 0) {
+        ret = 1;
+    }
+
+    flush();
+    return ret;
+}
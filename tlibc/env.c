@@ -1,8 +1,8 @@
 #include "std.h"
 
-int main(int argc, char **argv, char **envp) {
-    for (int i = 0; envp[i]; i++) {
-        Printf("%s\n", envp[i]);
+int main(int argc, char **argv) {
+    for (int i = 0; environ[i]; i++) {
+        Printf("%s\n", environ[i]);
     }
 
     return 0;
@@ -0,0 +1,35 @@
+// Linux error numbers. Wrappers in sys.S return them negated.
+#ifndef __ERRNO_H_
+#define __ERRNO_H_
+
+#define EPERM    1   /* Operation not permitted */
+#define ENOENT   2   /* No such file or directory */
+#define ESRCH    3   /* No such process */
+#define EINTR    4   /* Interrupted system call */
+#define EIO      5   /* I/O error */
+#define ENXIO    6   /* No such device or address */
+#define E2BIG    7   /* Argument list too long */
+#define ENOEXEC  8   /* Exec format error */
+#define EBADF    9   /* Bad file number */
+#define ECHILD  10   /* No child processes */
+#define EAGAIN  11   /* Try again */
+#define ENOMEM  12   /* Out of memory */
+#define EACCES  13   /* Permission denied */
+#define EEXIST  17   /* File exists */
+#define EXDEV   18   /* Cross-device link */
+#define ENOTDIR 20   /* Not a directory */
+#define EISDIR  21   /* Is a directory */
+#define EINVAL  22   /* Invalid argument */
+#define EMFILE  24   /* Too many open files */
+#define ENOTTY  25   /* Not a typewriter */
+#define ETXTBSY 26   /* Text file busy */
+#define ENOSPC  28   /* No space left on device */
+#define ESPIPE  29   /* Illegal seek */
+#define EROFS   30   /* Read-only file system */
+#define EPIPE   32   /* Broken pipe */
+#define ENAMETOOLONG 36  /* File name too long */
+#define ENOSYS  38   /* Invalid system call number */
+#define ELOOP   40   /* Too many symbolic links encountered */
+#define EOPNOTSUPP 95    /* Operation not supported */
+
+#endif // __ERRNO_H_
@@ -1,148 +1,559 @@
 #include "std.h"
 
-static long eval(const char *expr);
-static bool contains(const char *fmt, char tar);
+/** Integer expressions: + - * / % with the usual precedence, unary
+ * minus and plus, parentheses, and $1, $2, ... for the columns of a
+ * row. An expression is parsed once into a tree, folded where it is
+ * constant, and compiled into register bytecode that a threaded loop
+ * runs. Arithmetic wraps around, as in two's complement.
+ *
+ * eval               one expression a line, until a line starting 'q'
+ * eval -b expr [file...]
+ *                    expr for each line of the files, or stdin: its
+ *                    blank-separated fields are the columns, a field
+ *                    the number it starts with, a missing one 0 */
 
-int main(int argc, char **argv) {
-    static struct buffered_reader br;
-    static char buf[2048];
-    br.start = br.end = 0;
+#define MAXNODE 4096
+#define MAXINSN (MAXNODE + 1)
+#define MAXDEPTH 256    // nesting of the parser's recursion
+#define MAXCOL 255
+#define NREG 256
+#define CHUNK (1ul << 20)
+#define OUTBUF 65536
 
-    sys_write(1, "(eval) ", 7);
-    while (fdgets(&br, buf, 0)) {
-        Printf("%l\n", eval(buf));
-        if (*(char *)buf == 'q') {
-            break;
+/** -- the tree -- */
+
+enum {
+    N_NUM,
+    N_COL,
+    N_NEG,
+    N_ADD,
+    N_SUB,
+    N_MUL,
+    N_DIV,
+    N_MOD,
+};
+
+struct node {
+    int kind;
+    int a, b;       // the operands: nodes
+    long val;       // N_NUM's value, N_COL's column
+};
+
+static struct node nodes[MAXNODE];
+static int nnode;
+
+/** What is being parsed, and what went wrong if something did. */
+static struct {
+    const char *src, *p, *end;
+    int depth;
+    const char *err;
+    const char *at;
+} ps;
+
+static bool fail(const char *err) {
+    if (ps.err == NULL) {
+        ps.err = err;
+        ps.at = ps.p;
+    }
+    return false;
+}
+
+static int node(int kind, int a, int b, long val) {
+    if (nnode == MAXNODE) {
+        fail("too long");
+        return -1;
+    }
+    nodes[nnode] = (struct node){kind, a, b, val};
+    return nnode++;
+}
+
+static long wrap_neg(long v) {
+    return -(unsigned long)v;
+}
+
+/** x op y on constants, as the bytecode does it; false for a division
+ * by zero. */
+static bool fold(int kind, long x, long y, long *res) {
+    switch (kind) {
+    case N_ADD: *res = (unsigned long)x + y; return true;
+    case N_SUB: *res = (unsigned long)x - y; return true;
+    case N_MUL: *res = (unsigned long)x * y; return true;
+    case N_DIV: *res = y == -1 ? wrap_neg(x) : y != 0 ? x / y : 0; return y != 0;
+    case N_MOD: *res = y == -1 ? 0 : y != 0 ? x % y : 0; return y != 0;
+    }
+    return false;
+}
+
+/** a op b, folded when both are constants. */
+static int binary(int kind, int a, int b) {
+    if (a < 0 || b < 0) {
+        return -1;
+    }
+    if (nodes[a].kind == N_NUM && nodes[b].kind == N_NUM) {
+        long v;
+        if (!fold(kind, nodes[a].val, nodes[b].val, &v)) {
+            fail("division by zero");
+            return -1;
         }
-        sys_write(1, "(eval) ", 7);
+        if (a == nnode - 2 && b == nnode - 1) {
+            nnode -= 2;
+        }
+        return node(N_NUM, 0, 0, v);
     }
-    return 0;
+    return node(kind, a, b, 0);
 }
 
-static bool contains(const char *fmt, char tar) {
-    if (tar == 0) {
-        return true;
+static void skip_blanks(void) {
+    while (ps.p < ps.end && (*ps.p == ' ' || *ps.p == '\t')) {
+        ps.p++;
+    }
+}
+
+/** The next character that is not blank, or 0 at the end. */
+static char peek(void) {
+    skip_blanks();
+    return ps.p < ps.end ? *ps.p : 0;
+}
+
+static int parse_sum(void);
+
+/** A number, a column, or ( sum ). */
+static int parse_primary(void) {
+    char c = peek();
+    if (c >= '0' && c <= '9') {
+        unsigned long v = 0;
+        for (; ps.p < ps.end && *ps.p >= '0' && *ps.p <= '9'; ps.p++) {
+            v = v * 10 + (*ps.p - '0');
+        }
+        return node(N_NUM, 0, 0, v);
+    }
+    if (c == '$') {
+        ps.p++;
+        long col = 0;
+        const char *digits = ps.p;
+        for (; ps.p < ps.end && *ps.p >= '0' && *ps.p <= '9' && col <= MAXCOL; ps.p++) {
+            col = col * 10 + (*ps.p - '0');
+        }
+        if (ps.p == digits || col == 0 || col > MAXCOL) {
+            fail("no such column");
+            return -1;
+        }
+        return node(N_COL, 0, 0, col);
+    }
+    if (c == '(') {
+        ps.p++;
+        int n = parse_sum();
+        if (n < 0) {
+            return -1;
+        }
+        if (peek() != ')') {
+            fail("')' expected");
+            return -1;
+        }
+        ps.p++;
+        return n;
     }
+    fail("operand expected");
+    return -1;
+}
 
-    for (; *fmt; fmt++) {
-        if (*fmt == tar) {
-            return true;
+/** - unary, + unary, or a primary. */
+static int parse_unary(void) {
+    if (++ps.depth > MAXDEPTH) {
+        fail("nested too deep");
+        return -1;
+    }
+    char c = peek();
+    int n;
+    if (c == '-' || c == '+') {
+        ps.p++;
+        n = parse_unary();
+        if (n >= 0 && c == '-' && nodes[n].kind == N_NUM) {
+            nodes[n].val = wrap_neg(nodes[n].val);
+        } else if (n >= 0 && c == '-') {
+            n = node(N_NEG, n, 0, 0);
         }
+    } else {
+        n = parse_primary();
     }
+    ps.depth--;
+    return n;
+}
 
-    return false;
+static int parse_product(void) {
+    int n = parse_unary();
+    for (char c; n >= 0 && ((c = peek()) == '*' || c == '/' || c == '%'); ) {
+        ps.p++;
+        n = binary(c == '*' ? N_MUL : c == '/' ? N_DIV : N_MOD, n, parse_unary());
+    }
+    return n;
+}
+
+static int parse_sum(void) {
+    int n = parse_product();
+    for (char c; n >= 0 && ((c = peek()) == '+' || c == '-'); ) {
+        ps.p++;
+        n = binary(c == '+' ? N_ADD : N_SUB, n, parse_product());
+    }
+    return n;
 }
 
-// operators
-enum oper {
-    OP_NULL = 0,
-    OP_PLUS,
-    OP_SUB,
-    OP_MULT,
-    OP_DIV
+/** -- the bytecode -- */
+
+enum {
+    I_CONST,    // dst = imm
+    I_COL,      // dst = the column a
+    I_NEG,      // dst = -a
+    I_ADD,      // dst = a op b
+    I_SUB,
+    I_MUL,
+    I_DIV,
+    I_MOD,
+    I_ADDI,     // dst = a op imm
+    I_MULI,
+    I_DIVI,     // imm is neither 0 nor -1
+    I_MODI,
+    I_RSUBI,    // dst = imm - a
+    I_RET,      // the result is a
 };
 
-static void eval_simple(long *left, long *right, enum oper op) {
-    switch (op) {
-    case (OP_NULL): {
-        *left = *right;
-        *right = 0;
-        break;
-    }
-    case (OP_PLUS): {
-        *left += *right;
-        *right = 0;
-        break;
-    }
-    case (OP_SUB): {
-        *left -= *right;
-        *right = 0;
-        break;
-    }
-    case (OP_MULT): {
-        *left *= *right;
-        *right = 0;
-        break;
-    }
-    case (OP_DIV): {
-        *left /= *right;
-        *right = 0;
-        break;
-    }
-    }
-}
-
-static const char *eval_recur(const char *expr, long *res) {
-    long ret = 0;
-    long cur = 0;
-    enum oper op = OP_NULL;
-
-    for (; *expr != 0; expr++) {
-        switch (*expr) {
-            case '0':
-            case '1':
-            case '2':
-            case '3':
-            case '4':
-            case '5':
-            case '6':
-            case '7':
-            case '8':
-            case '9': {
-                cur *= 10;
-                cur += (long) (*expr - '0');
-                break;
-            }
+struct insn {
+    uint8_t op;
+    uint8_t dst;
+    uint8_t a;
+    uint8_t b;
+    long imm;
+};
 
-            // brackets
-            case ')': {
-                eval_simple(&ret, &cur, op);
-                goto end;
-                break;
-            }
-            case '(': {
-                // set cur to the value in the bracket
-                expr = eval_recur(expr + 1, &cur);
-                eval_simple(&ret, &cur, op);
-                break;
-            }
+static struct insn prog[MAXINSN];
+static int ninsn;
+static int maxcol;      // the highest column the program reads
 
-            // operators
-            case '+': {
-                eval_simple(&ret, &cur, op);
-                op = OP_PLUS;
-                break;
-            }
-            case '-': {
-                eval_simple(&ret, &cur, op);
-                op = OP_SUB;
-                break;
-            }
-            case '*': {
-                eval_simple(&ret, &cur, op);
-                op = OP_MULT;
-                break;
+/** A tree of n nodes compiles to at most n instructions and a return:
+ * one a node, none for a constant that is an immediate. */
+static void emit_insn(int op, int dst, int a, int b, long imm) {
+    prog[ninsn++] = (struct insn){op, dst, a, b, imm};
+}
+
+/** Compile the tree n into code that leaves its value in register r,
+ * using the registers above r as it needs. */
+static bool gen(int n, int r) {
+    if (r >= NREG) {
+        return fail("too complex");
+    }
+    const struct node *x = &nodes[n];
+    switch (x->kind) {
+    case N_NUM:
+        emit_insn(I_CONST, r, 0, 0, x->val);
+        return true;
+    case N_COL:
+        emit_insn(I_COL, r, x->val, 0, 0);
+        maxcol = x->val > maxcol ? x->val : maxcol;
+        return true;
+    case N_NEG:
+        if (!gen(x->a, r)) {
+            return false;
+        }
+        emit_insn(I_NEG, r, r, 0, 0);
+        return true;
+    }
+
+    // an operand that is a constant becomes an immediate.
+    const struct node *a = &nodes[x->a], *b = &nodes[x->b];
+    bool commutes = x->kind == N_ADD || x->kind == N_MUL;
+    if (a->kind == N_NUM && (commutes || x->kind == N_SUB)) {
+        if (!gen(x->b, r)) {
+            return false;
+        }
+        emit_insn(x->kind == N_ADD ? I_ADDI : x->kind == N_MUL ? I_MULI : I_RSUBI, r, r, 0, a->val);
+        return true;
+    }
+    if (b->kind == N_NUM) {
+        if (!gen(x->a, r)) {
+            return false;
+        }
+        long v = b->val;
+        switch (x->kind) {
+        case N_ADD: emit_insn(I_ADDI, r, r, 0, v); break;
+        case N_SUB: emit_insn(I_ADDI, r, r, 0, wrap_neg(v)); break;
+        case N_MUL: emit_insn(I_MULI, r, r, 0, v); break;
+        case N_DIV:
+        case N_MOD:
+            if (v == 0) {
+                return fail("division by zero");
             }
-            case '/': {
-                eval_simple(&ret, &cur, op);
-                op = OP_DIV;
-                break;
+            if (v == -1) {
+                // what would trap for the lowest number: x / -1 is -x.
+                emit_insn(x->kind == N_DIV ? I_NEG : I_CONST, r, r, 0, 0);
+            } else {
+                emit_insn(x->kind == N_DIV ? I_DIVI : I_MODI, r, r, 0, v);
             }
+            break;
+        }
+        return true;
+    }
+    if (!gen(x->a, r) || !gen(x->b, r + 1)) {
+        return false;
+    }
+    static const uint8_t ops[] = {
+        [N_ADD] = I_ADD, [N_SUB] = I_SUB, [N_MUL] = I_MUL, [N_DIV] = I_DIV, [N_MOD] = I_MOD,
+    };
+    emit_insn(ops[x->kind], r, r, r + 1, 0);
+    return true;
+}
 
-            default: {
-                eval_simple(&ret, &cur, op);
-                break;
-            }
+/** Parse and compile [src, end) into prog. False, with ps.err set, if
+ * it is no expression. */
+static bool compile(const char *src, const char *end) {
+    ps.src = ps.p = src;
+    ps.end = end;
+    ps.depth = 0;
+    ps.err = NULL;
+    nnode = ninsn = maxcol = 0;
+    int n = parse_sum();
+    if (n >= 0 && peek() != 0) {
+        fail("operator expected");
+    }
+    if (ps.err != NULL || !gen(n, 0)) {
+        return false;
+    }
+    emit_insn(I_RET, 0, 0, 0, 0);
+    return true;
+}
+
+/** Run prog on the columns col[1..maxcol]. False for a division by zero. */
+static bool run(const long *col, long *res) {
+    static const void *const labels[] = {
+        [I_CONST] = &&op_const, [I_COL] = &&op_col, [I_NEG] = &&op_neg,
+        [I_ADD] = &&op_add, [I_SUB] = &&op_sub, [I_MUL] = &&op_mul,
+        [I_DIV] = &&op_div, [I_MOD] = &&op_mod, [I_ADDI] = &&op_addi,
+        [I_MULI] = &&op_muli, [I_DIVI] = &&op_divi, [I_MODI] = &&op_modi,
+        [I_RSUBI] = &&op_rsubi, [I_RET] = &&op_ret,
+    };
+    long r[NREG];
+    const struct insn *ip = prog;
+    // each instruction jumps to the next one's code itself.
+#define NEXT goto *labels[(++ip)->op]
+    goto *labels[ip->op];
+op_const:
+    r[ip->dst] = ip->imm;
+    NEXT;
+op_col:
+    r[ip->dst] = col[ip->a];
+    NEXT;
+op_neg:
+    r[ip->dst] = wrap_neg(r[ip->a]);
+    NEXT;
+op_add:
+    r[ip->dst] = (unsigned long)r[ip->a] + r[ip->b];
+    NEXT;
+op_sub:
+    r[ip->dst] = (unsigned long)r[ip->a] - r[ip->b];
+    NEXT;
+op_mul:
+    r[ip->dst] = (unsigned long)r[ip->a] * r[ip->b];
+    NEXT;
+op_div:
+    if (r[ip->b] == 0) {
+        return false;
+    }
+    r[ip->dst] = r[ip->b] == -1 ? wrap_neg(r[ip->a]) : r[ip->a] / r[ip->b];
+    NEXT;
+op_mod:
+    if (r[ip->b] == 0) {
+        return false;
+    }
+    r[ip->dst] = r[ip->b] == -1 ? 0 : r[ip->a] % r[ip->b];
+    NEXT;
+op_addi:
+    r[ip->dst] = (unsigned long)r[ip->a] + ip->imm;
+    NEXT;
+op_muli:
+    r[ip->dst] = (unsigned long)r[ip->a] * ip->imm;
+    NEXT;
+op_divi:
+    r[ip->dst] = r[ip->a] / ip->imm;
+    NEXT;
+op_modi:
+    r[ip->dst] = r[ip->a] % ip->imm;
+    NEXT;
+op_rsubi:
+    r[ip->dst] = (unsigned long)ip->imm - r[ip->a];
+    NEXT;
+op_ret:
+    *res = r[ip->a];
+    return true;
+#undef NEXT
+}
+
+/** -- output -- */
+
+static char out[OUTBUF];
+static size_t outlen;
+
+static void flush(void) {
+    for (size_t done = 0; done < outlen; ) {
+        long w = sys_write(1, out + done, outlen - done);
+        if (w <= 0) {
+            sys_exit(2);
         }
+        done += w;
     }
+    outlen = 0;
+}
 
-end:
-    *res = ret;
-    return *expr == 0 ? expr : (expr + 1);
+static void emit_long(long v) {
+    if (outlen + 24 > sizeof(out)) {
+        flush();
+    }
+    outlen += Sprintf(out + outlen, "%l\n", v);
 }
 
-static long eval(const char *expr) {
-    long ret;
-    eval_recur(expr, &ret);
-    return ret;
+/** Say what went wrong, and where: the column of expr, or the line of
+ * the input for n > 0. */
+static void error(const char *what, const char *where, long n) {
+    static char buf[256];
+    flush();
+    unsigned len = n > 0 ? Sprintf(buf, "eval: %s %s %l\n", what, where, n) :
+                           Sprintf(buf, "eval: %s\n", what);
+    sys_write(2, buf, len);
+}
+
+/** What compile did not like, and where. */
+static void bad_expr(void) {
+    error(ps.err, "at column", ps.at - ps.src + 1);
+}
+
+/** -- batch mode -- */
+
+/** Fill col[1..maxcol] from the blank-separated fields of [p, e). */
+static void fields(const char *p, const char *e, long *col) {
+    for (int i = 1; i <= maxcol; i++) {
+        while (p < e && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+        bool neg = p < e && *p == '-';
+        p += p < e && (*p == '-' || *p == '+');
+        unsigned long v = 0;
+        for (; p < e && *p >= '0' && *p <= '9'; p++) {
+            v = v * 10 + (*p - '0');
+        }
+        col[i] = neg ? wrap_neg(v) : (long)v;
+        while (p < e && *p != ' ' && *p != '\t') {
+            p++;
+        }
+    }
+}
+
+static long lineno;
+static bool failed;
+
+/** Evaluate prog on each whole line of [p, e); returns the rest. */
+static const char *rows(const char *p, const char *e, bool last) {
+    static long col[MAXCOL + 1];
+    while (p < e) {
+        const char *nl = Memchr(p, '\n', e - p);
+        if (nl == NULL && !last) {
+            break;
+        }
+        const char *le = nl != NULL ? nl : e;
+        lineno++;
+        fields(p, le, col);
+        long v;
+        if (run(col, &v)) {
+            emit_long(v);
+        } else {
+            error("division by zero", "on line", lineno);
+            failed = true;
+        }
+        p = le + (nl != NULL);
+    }
+    return p;
+}
+
+static int batch(int fd) {
+    static char buf[CHUNK];
+    size_t len = 0;
+    for (;;) {
+        long r = sys_read(fd, buf + len, sizeof(buf) - len);
+        if (r < 0) {
+            return r;
+        }
+        len += r;
+        const char *rest = rows(buf, buf + len, r == 0);
+        if (rest == buf && len == sizeof(buf)) {
+            // a line longer than the buffer is cut in two.
+            rest = rows(buf, buf + len, true);
+        }
+        len -= rest - buf;
+        Memmove(buf, rest, len);
+        if (r == 0) {
+            return 0;
+        }
+    }
+}
+
+static int usage(void) {
+    static const char msg[] = "usage: eval, or eval -b expr [file...]\n";
+    sys_write(2, msg, sizeof(msg) - 1);
+    return 2;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        if (argc < 3 || Strcmp(argv[1], "-b") != 0) {
+            return usage();
+        }
+        if (!compile(argv[2], argv[2] + Strlen(argv[2]))) {
+            bad_expr();
+            return 2;
+        }
+        int err = argc == 3 ? batch(0) : 0;
+        for (int i = 3; i < argc; i++) {
+            int fd = sys_open(argv[i], O_RDONLY);
+            if (fd < 0 || batch(fd) < 0) {
+                flush();
+                sys_write(2, "eval: ", 6);
+                sys_write(2, argv[i], Strlen(argv[i]));
+                sys_write(2, ": cannot read\n", 14);
+                err = -1;
+            }
+            if (fd >= 0) {
+                sys_close(fd);
+            }
+        }
+        flush();
+        return err < 0 ? 2 : failed;
+    }
+
+    static struct buffered_reader br;
+    static char buf[2048];
+    static const long none[MAXCOL + 1];
+    br.start = br.end = 0;
+
+    sys_write(1, "(eval) ", 7);
+    while (fdgets(&br, buf, 0)) {
+        if (buf[0] == 'q') {
+            break;
+        }
+        size_t n = Strlen(buf);
+        while (n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == '\r' ||
+                         buf[n - 1] == ' ' || buf[n - 1] == '\t')) {
+            n--;
+        }
+        long v;
+        if (n == 0) {
+            // nothing to say to an empty line
+        } else if (!compile(buf, buf + n)) {
+            bad_expr();
+        } else if (run(none, &v)) {
+            emit_long(v);
+        } else {
+            error("division by zero", NULL, 0);
+        }
+        flush();
+        sys_write(1, "(eval) ", 7);
+    }
+    flush();
+    return 0;
 }
@@ -0,0 +1,190 @@
+#include "std.h"
+#include "thread.h"
+#include "walk.h"
+
+/** A numeric test: +n (greater), -n (less) or n (exactly). */
+struct numtest {
+    bool on;
+    int cmp;        // 1, -1 or 0
+    int64_t val;
+};
+
+static struct {
+    const char *name;   // -name
+    int type;           // -type, as DT_*; -1 for any
+    struct numtest size;
+    int64_t size_unit;  // -size suffix, 512 byte blocks by default
+    struct numtest mtime;
+    int maxdepth;       // -maxdepth, -1 for unlimited
+    int64_t now;
+} opt;
+
+static struct mutex outlock;
+static char out[65536];
+static size_t outlen;
+
+static void flush(void) {
+    sys_write(1, out, outlen);
+    outlen = 0;
+}
+
+static bool numtest(const struct numtest *t, int64_t v) {
+    switch (t->cmp) {
+    case 1: return v > t->val;
+    case -1: return v < t->val;
+    }
+    return v == t->val;
+}
+
+static const char *basename(const char *path) {
+    const char *b = path;
+    for (const char *p = path; *p; p++) {
+        if (*p == '/' && p[1] != 0) {
+            b = p + 1;
+        }
+    }
+    return b;
+}
+
+static bool match(const struct walk_entry *e) {
+    if (opt.type >= 0 && e->type != opt.type) {
+        return false;
+    }
+    if (opt.name != NULL &&
+        !Fnmatch(opt.name, e->depth == 0 ? basename(e->path) : e->name)) {
+        return false;
+    }
+    if (opt.size.on) {
+        int64_t units = (e->st->st_size + opt.size_unit - 1) / opt.size_unit;
+        if (!numtest(&opt.size, units)) {
+            return false;
+        }
+    }
+    if (opt.mtime.on) {
+        int64_t age = (opt.now - e->st->st_mtim.tv_sec) / 86400;
+        if (!numtest(&opt.mtime, age)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int visit(struct walk_entry *e, void *ctx) {
+    if (match(e)) {
+        size_t len = Strlen(e->path);
+        mutex_lock(&outlock);
+        if (outlen + len + 1 > sizeof(out)) {
+            flush();
+        }
+        Memcpy(out + outlen, e->path, len);
+        outlen += len;
+        out[outlen++] = '\n';
+        mutex_unlock(&outlock);
+    }
+
+    if (opt.maxdepth >= 0 && e->depth >= opt.maxdepth) {
+        return WALK_SKIP;
+    }
+    return 0;
+}
+
+static void error(const char *path, int err, void *ctx) {
+    mutex_lock(&outlock);
+    sys_write(2, "find: cannot access ", 20);
+    sys_write(2, path, Strlen(path));
+    sys_write(2, "\n", 1);
+    mutex_unlock(&outlock);
+}
+
+/** Parse [+-]n, returns the rest of the string. */
+static const char *parse_num(struct numtest *t, const char *s) {
+    t->on = true;
+    t->cmp = *s == '+' ? 1 : (*s == '-' ? -1 : 0);
+    if (t->cmp != 0) {
+        s++;
+    }
+    t->val = 0;
+    for (; *s >= '0' && *s <= '9'; s++) {
+        t->val = t->val * 10 + (*s - '0');
+    }
+    return s;
+}
+
+static int usage(void) {
+    static const char msg[] =
+        "Usage: find [path...] [-name pattern] [-type bcdflps] [-size [+-]n[ckMG]]\n"
+        "            [-mtime [+-]n] [-maxdepth n]\n";
+    sys_write(2, msg, sizeof(msg) - 1);
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    static const struct walk_ops ops = {
+        .visit = visit,
+        .post = NULL,
+        .error = error,
+        .ctx = NULL,
+    };
+    static const int types[] = {
+        ['b'] DT_BLK, ['c'] DT_CHR, ['d'] DT_DIR, ['f'] DT_REG,
+        ['l'] DT_LNK, ['p'] DT_FIFO, ['s'] DT_SOCK,
+    };
+    opt.type = -1;
+    opt.maxdepth = -1;
+    opt.size_unit = 512;
+
+    // paths come first, then the tests.
+    int npath = 1;
+    while (npath < argc && argv[npath][0] != '-') {
+        npath++;
+    }
+
+    for (int i = npath; i < argc; i += 2) {
+        const char *arg = i + 1 < argc ? argv[i + 1] : NULL;
+        if (arg == NULL) {
+            return usage();
+        }
+        if (Strcmp(argv[i], "-name") == 0) {
+            opt.name = arg;
+        } else if (Strcmp(argv[i], "-type") == 0) {
+            unsigned char c = arg[0];
+            if (c >= sizeof(types) / sizeof(types[0]) || types[c] == 0) {
+                return usage();
+            }
+            opt.type = types[c];
+        } else if (Strcmp(argv[i], "-size") == 0) {
+            switch (*parse_num(&opt.size, arg)) {
+            case 'c': opt.size_unit = 1; break;
+            case 'k': opt.size_unit = 1024; break;
+            case 'M': opt.size_unit = 1024 * 1024; break;
+            case 'G': opt.size_unit = 1024 * 1024 * 1024; break;
+            }
+        } else if (Strcmp(argv[i], "-mtime") == 0) {
+            parse_num(&opt.mtime, arg);
+        } else if (Strcmp(argv[i], "-maxdepth") == 0) {
+            opt.maxdepth = atoi(arg);
+        } else {
+            return usage();
+        }
+    }
+
+    // only stat when a test needs more than d_type.
+    int flags = 0;
+    if (opt.size.on || opt.mtime.on) {
+        struct timespec ts;
+        sys_clock_gettime(CLOCK_REALTIME, &ts);
+        opt.now = ts.tv_sec;
+        flags |= WALK_STAT;
+    }
+
+    int ret = 0;
+    for (int i = 1; i < npath; i++) {
+        ret |= walk(argv[i], flags, &ops) != 0;
+    }
+    if (npath == 1) {
+        ret |= walk(".", flags, &ops) != 0;
+    }
+
+    flush();
+    return ret;
+}
@@ -0,0 +1,99 @@
+#include "std.h"
+
+/**
+ * Does the bracket expression starting at pat ('[') match ch? On return
+ * *end points past the closing ']'. Returns -1 if pat is not a valid
+ * bracket expression, in which case '[' is an ordinary character.
+ */
+static int match_class(const char *pat, char ch, const char **end) {
+    const char *p = pat + 1;
+    bool neg = false;
+    bool hit = false;
+
+    if (*p == '!' || *p == '^') {
+        neg = true;
+        p++;
+    }
+    // a leading ']' is a member, not the end.
+    for (bool first = true; *p && (first || *p != ']'); first = false) {
+        char lo = *p++;
+        char hi = lo;
+        if (*p == '-' && p[1] && p[1] != ']') {
+            hi = p[1];
+            p += 2;
+        }
+        if ((unsigned char)lo <= (unsigned char)ch &&
+            (unsigned char)ch <= (unsigned char)hi) {
+            hit = true;
+        }
+    }
+    if (*p != ']') {
+        return -1;
+    }
+    *end = p + 1;
+    return hit != neg;
+}
+
+/** Does the first element of pat match ch? Sets *next to the element after it. */
+static bool match_one(const char *pat, char ch, const char **next) {
+    switch (*pat) {
+    case 0: {
+        return false;
+    }
+    case '?': {
+        *next = pat + 1;
+        return true;
+    }
+    case '[': {
+        int r = match_class(pat, ch, next);
+        if (r >= 0) {
+            return r;
+        }
+        break;
+    }
+    case '\\': {
+        if (pat[1]) {
+            *next = pat + 2;
+            return pat[1] == ch;
+        }
+        break;
+    }
+    }
+    *next = pat + 1;
+    return *pat == ch;
+}
+
+/**
+ * Shell-style pattern match of the whole string: '*', '?', '[...]'
+ * (with ranges and '!'/'^' negation) and '\' escapes. Only the last
+ * '*' is ever backtracked to, so this runs in O(len(pat) * len(s)).
+ */
+bool Fnmatch(const char *pat, const char *s) {
+    const char *star = NULL;   // pattern right after the last '*'
+    const char *retry = NULL;  // where that '*' should resume in s
+
+    while (*s) {
+        const char *next;
+        if (*pat == '*') {
+            star = ++pat;
+            retry = s;
+            continue;
+        }
+        if (match_one(pat, *s, &next)) {
+            pat = next;
+            s++;
+            continue;
+        }
+        if (star == NULL) {
+            return false;
+        }
+        // let the last '*' swallow one more character.
+        pat = star;
+        s = ++retry;
+    }
+
+    while (*pat == '*') {
+        pat++;
+    }
+    return *pat == 0;
+}
@@ -0,0 +1,445 @@
+#include "std.h"
+#include "arena.h"
+#include "sorting.h"
+#include "glob.h"
+
+#define GLOB_ARENA (256ul << 20)
+#define DENTS_BUF (1 << 20)     // most directories in one getdents64
+#define BUCKETS 64              // a power of 2
+#define PATH_MAX 4096
+
+/** What one component of a pattern compiles to, an op per character. */
+enum {
+    OP_CHAR,
+    OP_ANY,         // ?
+    OP_STAR,        // *, never twice in a row
+    OP_SET,         // [...]
+};
+
+struct op {
+    uint8_t kind;
+    uint8_t ch;         // OP_CHAR
+    uint8_t set[32];    // OP_SET: a bit per byte
+};
+
+/** A compiled component. Most names are turned down by their length,
+ * or by the plain characters before the first op that is not one and
+ * after the last '*', before any op has to run. */
+struct matcher {
+    struct op *ops;
+    int nops;
+    int min;            // length of a name at least; exactly without a '*'
+    bool star;
+    int prefix;         // plain ops at the start
+    int suffix;         // plain ops after the last '*'
+    bool dot;           // starts with a '.': may match hidden names
+};
+
+struct dent {
+    const char *name;
+    uint32_t len;
+    uint8_t type;       // DT_*
+};
+
+/** A directory as read, under the path it was read by. */
+struct listing {
+    struct listing *next;
+    const char *dir;
+    uint32_t hash;
+    struct dent *ents;
+    size_t n;
+};
+
+/** Listings, compiled patterns and the matches' keys; reset by glob_forget. */
+static struct arena ga;
+static struct listing *cache[BUCKETS];
+static size_t listed;       // in cache, so glob_forget without any is free
+static char *dents_buf;
+
+/** The matches so far, keyed by their first 8 bytes for radix_sort. */
+static struct sort_key *found;
+static size_t nfound;
+static size_t capfound;
+static struct arena *out_arena;
+
+/** Compile the bracket expression at p into set. Returns what follows
+ * its ']', or NULL if there is none: '[' is a plain character then. */
+static const char *compile_set(const char *p, const char *end, uint8_t set[32]) {
+    p++;
+    bool neg = p < end && (*p == '!' || *p == '^');
+    p += neg;
+    Memset(set, 0, 32);
+    // a leading ']' is a member, not the end.
+    for (bool first = true; p < end && (first || *p != ']'); first = false) {
+        if (*p == '\\' && p + 1 < end) {
+            p++;
+        }
+        unsigned lo = (uint8_t)*p++;
+        unsigned hi = lo;
+        if (p + 1 < end && *p == '-' && p[1] != ']') {
+            hi = (uint8_t)p[1];
+            p += 2;
+        }
+        for (unsigned c = lo; c <= hi; c++) {
+            set[c >> 3] |= 1 << (c & 7);
+        }
+    }
+    if (p >= end) {
+        return NULL;
+    }
+    for (int i = 0; neg && i < 32; i++) {
+        set[i] = ~set[i];
+    }
+    return p + 1;
+}
+
+static bool magic(const char *p, const char *end) {
+    uint8_t set[32];
+    for (; p < end; p++) {
+        if (*p == '\\') {
+            p++;
+        } else if (*p == '*' || *p == '?' || (*p == '[' && compile_set(p, end, set) != NULL)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool glob_magic(const char *pat) {
+    return magic(pat, pat + Strlen(pat));
+}
+
+static bool compile(const char *p, const char *end, struct matcher *m) {
+    struct op *ops = arena_alloc(&ga, (end - p) * sizeof(*ops));
+    if (ops == NULL) {
+        return false;
+    }
+    *m = (struct matcher){
+        .ops = ops,
+        .dot = *p == '.' || (*p == '\\' && p + 1 < end && p[1] == '.'),
+    };
+    int n = 0;
+    while (p < end) {
+        struct op *o = &ops[n];
+        const char *next;
+        o->kind = OP_CHAR;
+        if (*p == '*') {
+            p++;
+            m->star = true;
+            if (n > 0 && ops[n - 1].kind == OP_STAR) {
+                continue;
+            }
+            o->kind = OP_STAR;
+        } else if (*p == '?') {
+            o->kind = OP_ANY;
+            p++;
+        } else if (*p == '[' && (next = compile_set(p, end, o->set)) != NULL) {
+            o->kind = OP_SET;
+            p = next;
+        } else {
+            if (*p == '\\' && p + 1 < end) {
+                p++;
+            }
+            o->ch = *p++;
+        }
+        m->min += o->kind != OP_STAR;
+        n++;
+    }
+    m->nops = n;
+    while (m->prefix < n && ops[m->prefix].kind == OP_CHAR) {
+        m->prefix++;
+    }
+    while (m->star && m->suffix < n && ops[n - 1 - m->suffix].kind == OP_CHAR) {
+        m->suffix++;
+    }
+    return true;
+}
+
+static bool step(const struct op *o, uint8_t c) {
+    switch (o->kind) {
+    case OP_CHAR:
+        return o->ch == c;
+    case OP_ANY:
+        return true;
+    default:
+        return o->set[c >> 3] >> (c & 7) & 1;
+    }
+}
+
+static bool match(const struct matcher *m, const struct dent *d) {
+    const uint8_t *s = (const uint8_t *)d->name;
+    uint32_t len = d->len;
+    if (s[0] == '.' && (!m->dot || len == 1 || (len == 2 && s[1] == '.'))) {
+        return false;
+    }
+    if (len < (uint32_t)m->min || (!m->star && len != (uint32_t)m->min)) {
+        return false;
+    }
+    for (int i = 0; i < m->prefix; i++) {
+        if (m->ops[i].ch != s[i]) {
+            return false;
+        }
+    }
+    const struct op *tail = m->ops + m->nops - m->suffix;
+    for (int i = 0; i < m->suffix; i++) {
+        if (tail[i].ch != s[len - m->suffix + i]) {
+            return false;
+        }
+    }
+
+    // only the last '*' is ever backtracked to, as in Fnmatch.
+    const struct op *o = m->ops + m->prefix;
+    const struct op *end = m->ops + m->nops;
+    const struct op *star = NULL;
+    const uint8_t *e = s + len;
+    const uint8_t *retry = NULL;
+    for (s += m->prefix; s < e; ) {
+        if (o < end && o->kind == OP_STAR) {
+            star = ++o;
+            retry = s;
+            continue;
+        }
+        if (o < end && step(o, *s)) {
+            o++;
+            s++;
+            continue;
+        }
+        if (star == NULL) {
+            return false;
+        }
+        o = star;
+        s = ++retry;
+    }
+    while (o < end && o->kind == OP_STAR) {
+        o++;
+    }
+    return o == end;
+}
+
+static uint32_t fnv1a(const char *s) {
+    uint32_t h = 2166136261u;
+    for (; *s; s++) {
+        h = (h ^ (uint8_t)*s) * 16777619u;
+    }
+    return h;
+}
+
+/** The entries of dir ("" for the current one), read on first use. A
+ * directory that cannot be read has none. */
+static struct listing *list_dir(const char *dir) {
+    uint32_t h = fnv1a(dir);
+    struct listing **bucket = &cache[h & (BUCKETS - 1)];
+    for (struct listing *l = *bucket; l != NULL; l = l->next) {
+        if (l->hash == h && Strcmp(l->dir, dir) == 0) {
+            return l;
+        }
+    }
+    struct listing *l = arena_alloc(&ga, sizeof(*l));
+    size_t dlen = Strlen(dir);
+    char *copy = arena_alloc(&ga, dlen + 1);
+    if (l == NULL || copy == NULL) {
+        return NULL;
+    }
+    *l = (struct listing){.dir = Memcpy(copy, dir, dlen + 1), .hash = h};
+
+    if (dents_buf == NULL) {
+        dents_buf = sys_mmap(NULL, DENTS_BUF, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if ((long)dents_buf < 0) {
+            dents_buf = NULL;
+            return NULL;
+        }
+    }
+    int fd = sys_openat(AT_FDCWD, *dir ? dir : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    size_t cap = 0;
+    long r;
+    while (fd >= 0 && (r = sys_getdents64(fd, (struct linux_dirent64 *)dents_buf, DENTS_BUF)) > 0) {
+        for (long off = 0; off < r; ) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(dents_buf + off);
+            off += d->d_reclen;
+            if (l->n == cap) {
+                cap = cap ? 2 * cap : 256;
+                struct dent *ents = arena_alloc(&ga, cap * sizeof(*ents));
+                if (ents == NULL) {
+                    break;
+                }
+                l->ents = Memcpy(ents, l->ents, l->n * sizeof(*ents));
+            }
+            size_t len = Strlen(d->d_name);
+            char *name = arena_alloc(&ga, len + 1);
+            if (name == NULL) {
+                break;
+            }
+            l->ents[l->n++] = (struct dent){Memcpy(name, d->d_name, len + 1), len, d->d_type};
+        }
+    }
+    if (fd >= 0) {
+        sys_close(fd);
+    }
+    l->next = *bucket;
+    *bucket = l;
+    listed++;
+    return l;
+}
+
+static bool is_dir(const struct dent *d, const char *path) {
+    if (d->type == DT_DIR) {
+        return true;
+    }
+    struct stat st;
+    return (d->type == DT_LNK || d->type == DT_UNKNOWN) &&
+           sys_fstatat(AT_FDCWD, path, &st, 0) == 0 && (st.st_mode & S_IFMT) == S_IFDIR;
+}
+
+static void add(const char *path, size_t len) {
+    if (nfound == capfound) {
+        capfound = capfound ? 2 * capfound : 64;
+        struct sort_key *keys = arena_alloc(&ga, capfound * sizeof(*keys));
+        if (keys == NULL) {
+            capfound = nfound;
+            return;
+        }
+        found = Memcpy(keys, found, nfound * sizeof(*keys));
+    }
+    char *s = arena_alloc(out_arena, len + 1);
+    if (s == NULL) {
+        return;
+    }
+    Memcpy(s, path, len + 1);
+    uint64_t key = 0;
+    for (size_t i = 0; i < 8; i++) {
+        key = key << 8 | (i < len ? (uint8_t)s[i] : 0);
+    }
+    found[nfound++] = (struct sort_key){key, s};
+}
+
+/** Match pat, the rest of the pattern, under path[0, plen). */
+static void walk(char *path, size_t plen, const char *pat) {
+    const char *end = pat;
+    while (*end && *end != '/') {
+        end++;
+    }
+    const char *rest = end;
+    while (*rest == '/') {
+        rest++;
+    }
+    size_t slashes = rest - end;
+
+    if (!magic(pat, end)) {
+        // a plain name: looked up, not listed.
+        for (const char *p = pat; p < end; p++) {
+            p += *p == '\\' && p + 1 < end;
+            if (plen + slashes + 1 >= PATH_MAX) {
+                return;
+            }
+            path[plen++] = *p;
+        }
+        Memcpy(path + plen, end, slashes);
+        plen += slashes;
+        path[plen] = 0;
+        struct stat st;
+        if (*rest != 0) {
+            walk(path, plen, rest);
+        } else if (sys_fstatat(AT_FDCWD, path, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+            add(path, plen);
+        }
+        return;
+    }
+
+    struct matcher m;
+    path[plen] = 0;
+    struct listing *l = list_dir(path);
+    if (l == NULL || !compile(pat, end, &m)) {
+        return;
+    }
+    for (size_t i = 0; i < l->n; i++) {
+        const struct dent *d = &l->ents[i];
+        if (!match(&m, d) || plen + d->len + slashes + 1 >= PATH_MAX) {
+            continue;
+        }
+        size_t n = plen + d->len;
+        Memcpy(path + plen, d->name, d->len);
+        path[n] = 0;
+        if (slashes > 0) {
+            // more to match below it, or a trailing '/': a directory only.
+            if (!is_dir(d, path)) {
+                continue;
+            }
+            Memcpy(path + n, end, slashes);
+            n += slashes;
+            path[n] = 0;
+        }
+        if (*rest == 0) {
+            add(path, n);
+        } else {
+            walk(path, n, rest);
+        }
+    }
+}
+
+static int by_path(const void *a, const void *b) {
+    return Strcmp(a, b);
+}
+
+/** Radix sort on the first 8 bytes; the few that agree on those are
+ * sorted by the rest after. */
+static void sort_found(void) {
+    struct sort_key *tmp = arena_alloc(&ga, nfound * sizeof(*tmp));
+    if (tmp == NULL) {
+        return;
+    }
+    radix_sort(found, tmp, nfound);
+    void **run = (void **)tmp;
+    for (size_t i = 0; i < nfound; ) {
+        size_t j = i + 1;
+        while (j < nfound && found[j].key == found[i].key) {
+            j++;
+        }
+        if (j - i > 1) {
+            for (size_t k = i; k < j; k++) {
+                run[k - i] = found[k].ptr;
+            }
+            sort_ptr(run, j - i, by_path);
+            for (size_t k = i; k < j; k++) {
+                found[k].ptr = run[k - i];
+            }
+        }
+        i = j;
+    }
+}
+
+char **glob_expand(const char *pat, struct arena *ar, size_t *n) {
+    static char path[PATH_MAX];
+    *n = 0;
+    if (ga.base == NULL && !arena_init(&ga, GLOB_ARENA)) {
+        return NULL;
+    }
+    found = NULL;
+    nfound = capfound = 0;
+    out_arena = ar;
+    walk(path, 0, pat);
+    if (nfound == 0) {
+        return NULL;
+    }
+    sort_found();
+    char **out = arena_alloc(ar, (nfound + 1) * sizeof(char *));
+    if (out == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < nfound; i++) {
+        out[i] = found[i].ptr;
+    }
+    out[nfound] = NULL;
+    *n = nfound;
+    return out;
+}
+
+void glob_forget(void) {
+    if (ga.base != NULL) {
+        arena_reset(&ga);
+    }
+    if (listed > 0) {
+        Memset(cache, 0, sizeof(cache));
+        listed = 0;
+    }
+}
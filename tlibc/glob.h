@@ -0,0 +1,28 @@
+#ifndef _GLOB_H_
+#define _GLOB_H_
+
+/** Pathname expansion as sh does it: '*', '?' and '[...]' in any
+ * component of a path, '\' quoting the next character. A component
+ * is compiled once into a matcher, and each directory is read with
+ * getdents64 only once: its listing is kept until glob_forget, so a
+ * command line with several patterns over one directory reads it once.
+ *
+ * Not thread-safe; the listings are shared. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "arena.h"
+
+/** Does pat have a '*', '?' or '[...]' that is not quoted? */
+extern bool glob_magic(const char *pat);
+
+/** The paths pat matches, in byte order, NULL-terminated, copied into
+ * ar; *n of them. NULL with *n == 0 when there is no match, or no
+ * memory. Names starting with '.' match only an explicit '.'; "." and
+ * ".." never do. */
+extern char **glob_expand(const char *pat, struct arena *ar, size_t *n);
+
+/** Drop the directory listings read so far: they may have changed. */
+extern void glob_forget(void);
+
+#endif // _GLOB_H_
@@ -0,0 +1,474 @@
+#include "std.h"
+
+#define MAXPAT 256
+#define CHUNK (1ul << 20)
+#define OUTBUF 65536
+
+static struct {
+    bool count;         // -c
+    bool invert;        // -v
+    bool number;        // -n
+    bool names;         // more than one file: prefix lines with the name
+} opt;
+
+static const char *pats[MAXPAT];
+static size_t patlen[MAXPAT];
+static int npat;
+
+/** Start of the first match in [p, e), or NULL. */
+static const char *(*find)(const char *p, const char *e);
+
+/** -- one literal: first/last byte filter -- */
+
+#ifdef __X86_64__
+/** No libgcc to provide __builtin_popcount() at this -march. */
+static inline unsigned popcount16(unsigned x) {
+    x = x - ((x >> 1) & 0x5555);
+    x = (x & 0x3333) + ((x >> 2) & 0x3333);
+    x = (x + (x >> 4)) & 0x0f0f;
+    return (x + (x >> 8)) & 0x1f;
+}
+#endif
+
+static const char *find_byte(const char *p, const char *e) {
+    return Memchr(p, *pats[0], e - p);
+}
+
+/** Compare 16 positions at once against the first and the last byte of
+ * the pattern and verify only where both agree. */
+static const char *find_literal(const char *p, const char *e) {
+    const char *pat = pats[0];
+    size_t m = patlen[0];
+    if ((size_t)(e - p) < m) {
+        return NULL;
+    }
+    const char *last = e - m;   // last possible start
+
+#ifdef __X86_64__
+    v16 first = splat16(pat[0]);
+    v16 final = splat16(pat[m - 1]);
+    for (; p + 16 <= last + 1; p += 16) {
+        v16 a = *(const v16u *)p;
+        v16 b = *(const v16u *)(p + m - 1);
+        unsigned bits = mask16((a == first) & (b == final));
+        while (bits != 0) {
+            int i = __builtin_ctz(bits);
+            if (Memcmp(p + i + 1, pat + 1, m - 2) == 0) {
+                return p + i;
+            }
+            bits &= bits - 1;
+        }
+    }
+#endif
+
+    for (; p <= last; p++) {
+        if (p[0] == pat[0] && p[m - 1] == pat[m - 1] && Memcmp(p + 1, pat + 1, m - 2) == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/** -- several literals: Aho-Corasick automaton -- */
+
+static struct {
+    uint32_t (*delta)[256];   // complete transition table
+    uint32_t *fail;
+    uint16_t *depth;          // length of the shortest pattern ending here, 0 if none
+    uint32_t n;
+} ac;
+
+static void *map_anon(size_t size) {
+    void *p = sys_mmap(NULL, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (long)p < 0 ? NULL : p;
+}
+
+static bool ac_build(void) {
+    size_t states = 1;
+    for (int i = 0; i < npat; i++) {
+        states += patlen[i];
+    }
+    ac.delta = map_anon(states * sizeof(*ac.delta));
+    ac.fail = map_anon(states * sizeof(*ac.fail));
+    ac.depth = map_anon(states * sizeof(*ac.depth));
+    uint32_t *queue = map_anon(states * sizeof(uint32_t));
+    uint16_t *len = map_anon(states * sizeof(uint16_t));
+    if (!ac.delta || !ac.fail || !ac.depth || !queue || !len) {
+        return false;
+    }
+
+    // the trie; 0 is the root and no edge leads back to it yet.
+    ac.n = 1;
+    for (int i = 0; i < npat; i++) {
+        uint32_t s = 0;
+        for (size_t j = 0; j < patlen[i]; j++) {
+            uint8_t c = pats[i][j];
+            if (ac.delta[s][c] == 0) {
+                len[ac.n] = len[s] + 1;
+                ac.delta[s][c] = ac.n++;
+            }
+            s = ac.delta[s][c];
+        }
+        ac.depth[s] = len[s];
+    }
+
+    // breadth first, turning missing edges into the failure's edges.
+    size_t head = 0, tail = 0;
+    for (int c = 0; c < 256; c++) {
+        if (ac.delta[0][c] != 0) {
+            queue[tail++] = ac.delta[0][c];
+        }
+    }
+    while (head < tail) {
+        uint32_t s = queue[head++];
+        uint32_t f = ac.fail[s];
+        if (ac.depth[s] == 0 || (ac.depth[f] != 0 && ac.depth[f] < ac.depth[s])) {
+            ac.depth[s] = ac.depth[f];
+        }
+        for (int c = 0; c < 256; c++) {
+            uint32_t t = ac.delta[s][c];
+            if (t != 0) {
+                ac.fail[t] = ac.delta[f][c];
+                queue[tail++] = t;
+            } else {
+                ac.delta[s][c] = ac.delta[f][c];
+            }
+        }
+    }
+
+    sys_munmap(queue, states * sizeof(uint32_t));
+    sys_munmap(len, states * sizeof(uint16_t));
+    return true;
+}
+
+static const char *find_multi(const char *p, const char *e) {
+    uint32_t s = 0;
+    for (; p < e; p++) {
+        s = ac.delta[s][(uint8_t)*p];
+        if (ac.depth[s] != 0) {
+            return p + 1 - ac.depth[s];
+        }
+    }
+    return NULL;
+}
+
+static const char *find_empty(const char *p, const char *e) {
+    return p;
+}
+
+/** -- output -- */
+
+static char out[OUTBUF];
+static size_t outlen;
+
+static void flush(void) {
+    for (size_t done = 0; done < outlen; ) {
+        long w = sys_write(1, out + done, outlen - done);
+        if (w <= 0) {
+            sys_exit(2);
+        }
+        done += w;
+    }
+    outlen = 0;
+}
+
+static void emit(const char *s, size_t len) {
+    if (outlen + len > sizeof(out)) {
+        flush();
+        if (len > sizeof(out)) {
+            for (size_t done = 0; done < len; ) {
+                long w = sys_write(1, s + done, len - done);
+                if (w <= 0) {
+                    sys_exit(2);
+                }
+                done += w;
+            }
+            return;
+        }
+    }
+    Memcpy(out + outlen, s, len);
+    outlen += len;
+}
+
+static void emit_str(const char *s) {
+    emit(s, Strlen(s));
+}
+
+/** -- searching -- */
+
+/** Where a file stands between the buffers it is read in. */
+struct scan {
+    const char *name;
+    uint64_t lineno;    // lines before the current buffer
+    uint64_t selected;  // lines selected so far
+};
+
+static size_t count_nl(const char *p, const char *e) {
+    size_t n = 0;
+#ifdef __X86_64__
+    v16 nl = splat16('\n');
+    for (; p + 16 <= e; p += 16) {
+        n += popcount16(mask16(*(const v16u *)p == nl));
+    }
+#endif
+    for (; p < e; p++) {
+        n += *p == '\n';
+    }
+    return n;
+}
+
+/** Print the line [p, e) (without its newline) numbered n. */
+static void emit_line(struct scan *sc, const char *p, const char *e, uint64_t n) {
+    char num[32];
+    if (opt.names) {
+        emit_str(sc->name);
+        emit(":", 1);
+    }
+    if (opt.number) {
+        Sprintf(num, "%L:", n);
+        emit_str(num);
+    }
+    emit(p, e - p);
+    emit("\n", 1);
+}
+
+/** Print the unselected lines [p, e) for -v. */
+static void emit_lines(struct scan *sc, const char *p, const char *e, uint64_t n) {
+    if (!opt.names && !opt.number) {
+        emit(p, e - p);
+        if (e[-1] != '\n') {
+            emit("\n", 1);
+        }
+        return;
+    }
+    while (p < e) {
+        const char *nl = Memchr(p, '\n', e - p);
+        nl = nl == NULL ? e : nl;
+        emit_line(sc, p, nl, n++);
+        p = nl + 1;
+    }
+}
+
+/** Search the whole lines in [p, e). Lines are only looked for around
+ * matches, the search itself runs over the buffer in one go. */
+static void scan_buf(struct scan *sc, const char *p, const char *e) {
+    const char *done = p;       // everything before is dealt with
+    const char *counted = p;    // newlines before are in lineno
+    uint64_t lineno = sc->lineno;
+
+    while (done < e) {
+        const char *m = find(done, e);
+        if (m == NULL) {
+            break;
+        }
+        const char *ls = Memrchr(done, '\n', m - done);
+        ls = ls == NULL ? done : ls + 1;
+        const char *le = Memchr(m, '\n', e - m);
+        le = le == NULL ? e : le;
+
+        if (opt.number || (opt.invert && opt.count)) {
+            lineno += count_nl(counted, ls);
+            counted = ls;
+        }
+        if (opt.invert) {
+            // the lines between the matches are the selected ones.
+            if (opt.count) {
+                sc->selected += count_nl(done, ls);
+            } else if (ls > done) {
+                uint64_t n = opt.number ? lineno - count_nl(done, ls) + 1 : 0;
+                sc->selected++;
+                emit_lines(sc, done, ls, n);
+            }
+        } else {
+            sc->selected++;
+            if (!opt.count) {
+                emit_line(sc, ls, le, lineno + 1);
+            }
+        }
+        done = le < e ? le + 1 : e;
+    }
+
+    if (opt.invert && done < e) {
+        size_t n = count_nl(done, e) + (e[-1] != '\n');
+        if (opt.count) {
+            sc->selected += n;
+        } else {
+            lineno += count_nl(counted, done);
+            counted = done;
+            sc->selected++;
+            emit_lines(sc, done, e, lineno + 1);
+        }
+    }
+    sc->lineno = lineno + count_nl(counted, e);
+}
+
+/** Read a pipe in buffers of whole lines. */
+static int scan_stream(struct scan *sc, int fd) {
+    size_t cap = CHUNK;
+    char *buf = map_anon(cap);
+    size_t len = 0;
+    if (buf == NULL) {
+        return -ENOMEM;
+    }
+
+    for (;;) {
+        long r = sys_read(fd, buf + len, cap - len);
+        if (r < 0) {
+            return r;
+        }
+        if (r == 0) {
+            if (len > 0) {
+                scan_buf(sc, buf, buf + len);
+            }
+            break;
+        }
+        len += r;
+
+        const char *nl = Memrchr(buf, '\n', len);
+        if (nl == NULL) {
+            if (len == cap) {
+                // a line longer than the buffer.
+                char *bigger = map_anon(2 * cap);
+                if (bigger == NULL) {
+                    return -ENOMEM;
+                }
+                Memcpy(bigger, buf, len);
+                sys_munmap(buf, cap);
+                buf = bigger;
+                cap *= 2;
+            }
+            continue;
+        }
+        size_t whole = nl + 1 - buf;
+        scan_buf(sc, buf, buf + whole);
+        len -= whole;
+        Memcpy(buf, buf + whole, len);
+    }
+    sys_munmap(buf, cap);
+    return 0;
+}
+
+static int scan_file(const char *path) {
+    struct scan sc = {
+        .name = path == NULL ? "(standard input)" : path,
+        .lineno = 0,
+        .selected = 0,
+    };
+    int fd = path == NULL ? 0 : sys_open(path, O_RDONLY);
+    if (fd < 0) {
+        return fd;
+    }
+
+    int r = 0;
+    struct stat st;
+    if (sys_fstat(fd, &st) == 0 && (st.st_mode & S_IFMT) == S_IFREG) {
+        if (st.st_size > 0) {
+            const char *p = sys_mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if ((long)p < 0) {
+                r = (long)p;
+            } else {
+                scan_buf(&sc, p, p + st.st_size);
+                sys_munmap((void *)p, st.st_size);
+            }
+        }
+    } else {
+        r = scan_stream(&sc, fd);
+    }
+    if (fd != 0) {
+        sys_close(fd);
+    }
+
+    if (opt.count) {
+        char num[32];
+        if (opt.names) {
+            emit_str(sc.name);
+            emit(":", 1);
+        }
+        Sprintf(num, "%L\n", sc.selected);
+        emit_str(num);
+    }
+    return r < 0 ? r : sc.selected > 0;
+}
+
+static int usage(void) {
+    static const char msg[] = "Usage: grep [-cnvF] [-e pattern]... [pattern] [file...]\n";
+    sys_write(2, msg, sizeof(msg) - 1);
+    return 2;
+}
+
+int main(int argc, char **argv) {
+    int first = 1;
+    for (; first < argc && argv[first][0] == '-' && argv[first][1] != 0; first++) {
+        if (Strcmp(argv[first], "--") == 0) {
+            first++;
+            break;
+        }
+        for (const char *f = argv[first] + 1; *f; f++) {
+            switch (*f) {
+            case 'c': opt.count = true; break;
+            case 'v': opt.invert = true; break;
+            case 'n': opt.number = true; break;
+            case 'F': break;    // patterns are always literal
+            case 'e': {
+                const char *v = f[1] ? f + 1 : argv[++first];
+                if (first >= argc || v == NULL || npat == MAXPAT) {
+                    return usage();
+                }
+                pats[npat++] = v;
+                f = " ";
+                break;
+            }
+            default: return usage();
+            }
+            if (*f == ' ') {
+                break;
+            }
+        }
+    }
+    if (npat == 0) {
+        if (first == argc) {
+            return usage();
+        }
+        pats[npat++] = argv[first++];
+    }
+
+    size_t shortest = (size_t)-1;
+    for (int i = 0; i < npat; i++) {
+        patlen[i] = Strlen(pats[i]);
+        shortest = patlen[i] < shortest ? patlen[i] : shortest;
+    }
+    if (shortest == 0) {
+        find = find_empty;
+    } else if (npat > 1) {
+        if (!ac_build()) {
+            sys_write(2, "grep: out of memory\n", 20);
+            return 2;
+        }
+        find = find_multi;
+    } else {
+        find = patlen[0] == 1 ? find_byte : find_literal;
+    }
+
+    opt.names = argc - first > 1;
+    int found = 0;
+    int err = 0;
+    if (first == argc) {
+        int r = scan_file(NULL);
+        found |= r > 0;
+        err |= r < 0;
+    }
+    for (int i = first; i < argc; i++) {
+        int r = scan_file(Strcmp(argv[i], "-") == 0 ? NULL : argv[i]);
+        if (r < 0) {
+            flush();
+            sys_write(2, "grep: ", 6);
+            sys_write(2, argv[i], Strlen(argv[i]));
+            sys_write(2, ": cannot read\n", 14);
+        }
+        found |= r > 0;
+        err |= r < 0;
+    }
+    flush();
+    return err ? 2 : !found;
+}
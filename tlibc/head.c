@@ -0,0 +1,112 @@
+#include "std.h"
+
+#define BUFSZ 65536
+
+static struct {
+    bool bytes;         // -c, otherwise -n
+    uint64_t count;
+} opt;
+
+static char buf[BUFSZ];
+
+static bool write_all(const char *p, size_t len) {
+    for (size_t done = 0; done < len; ) {
+        long w = sys_write(1, p + done, len - done);
+        if (w <= 0) {
+            return false;
+        }
+        done += w;
+    }
+    return true;
+}
+
+/** Copy the first opt.count lines or bytes and stop reading there. */
+static int head(int fd) {
+    uint64_t left = opt.count;
+    while (left > 0) {
+        // with -c never ask for more than is needed.
+        size_t want = opt.bytes && left < sizeof(buf) ? left : sizeof(buf);
+        long r = sys_read(fd, buf, want);
+        if (r <= 0) {
+            return r;
+        }
+
+        size_t n = r;
+        if (opt.bytes) {
+            left -= n;
+        } else {
+            const char *p = buf;
+            const char *e = buf + r;
+            while (left > 0 && (p = Memchr(p, '\n', e - p)) != NULL) {
+                p++;
+                left--;
+            }
+            if (left == 0) {
+                n = p - buf;
+                // give back what was read too far, if we can.
+                sys_lseek(fd, (long)n - r, SEEK_CUR);
+            }
+        }
+        if (!write_all(buf, n)) {
+            return -EIO;
+        }
+    }
+    return 0;
+}
+
+static uint64_t parse_count(const char *s, bool *ok) {
+    uint64_t v = 0;
+    *ok = *s != 0;
+    for (; *s; s++) {
+        if (*s < '0' || *s > '9') {
+            *ok = false;
+            break;
+        }
+        v = v * 10 + (*s - '0');
+    }
+    return v;
+}
+
+static int usage(void) {
+    static const char msg[] = "Usage: head [-n lines | -c bytes] [file...]\n";
+    sys_write(2, msg, sizeof(msg) - 1);
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    opt.count = 10;
+    int first = 1;
+    for (; first < argc && argv[first][0] == '-' && argv[first][1] != 0; first++) {
+        char f = argv[first][1];
+        if (f != 'n' && f != 'c') {
+            return usage();
+        }
+        const char *v = argv[first][2] ? argv[first] + 2 : argv[++first];
+        bool ok;
+        if (v == NULL || (opt.count = parse_count(v, &ok), !ok)) {
+            return usage();
+        }
+        opt.bytes = f == 'c';
+    }
+
+    int ret = 0;
+    if (first == argc) {
+        ret |= head(0) < 0;
+    }
+    for (int i = first; i < argc; i++) {
+        if (argc - first > 1) {
+            Printf("%s==> %s <==\n", i == first ? "" : "\n", argv[i]);
+        }
+        int fd = Strcmp(argv[i], "-") == 0 ? 0 : sys_open(argv[i], O_RDONLY);
+        if (fd < 0 || head(fd) < 0) {
+            sys_write(2, "head: cannot read ", 18);
+            sys_write(2, argv[i], Strlen(argv[i]));
+            sys_write(2, "\n", 1);
+            ret = 1;
+        }
+        if (fd > 0) {
+            sys_close(fd);
+        }
+    }
+    return ret;
+}
@@ -1,4 +1,11 @@
 #!/usr/bin/sh
 
 # install the programs in the /bin directory.
-for p in $( make collect ); do cp _$p ../initramfs/bin/$p; done
\ No newline at end of file
+# a multi-call build installs its one binary, and the programs as links.
+m=$( make -s multicall )
+if [ -n "$m" ]; then
+    cp _$m ../initramfs/bin/$m
+    for p in $( make collect ); do ln -sf $m ../initramfs/bin/$p; done
+else
+    for p in $( make collect ); do cp _$p ../initramfs/bin/$p; done
+fi
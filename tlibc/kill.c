@@ -5,21 +5,6 @@
 #define SIGCHLD 17
 #define SIGSTOP 19
 
-static int Strcmp(const char *s1, const char *s2) {
-    while (*s1 != 0 && *s2 != 0) {
-        if (*s1 != *s2) {
-            int ret = 0;
-            ret += (int)*s1;
-            ret -= (int)*s2;
-            return ret;
-        }
-        s1 ++;
-        s2 ++;
-    }
-
-    return (int)*s1 - (int)*s2;
-}
-
 int main(int argc, char **argv) {
     static const char *help = "Usage: kill [-h] or kill [-s signo] pid\n";
     if (argc < 2) {
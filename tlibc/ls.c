@@ -1,9 +1,13 @@
 #include "std.h"
+#include "arena.h"
+#include "sorting.h"
+#include "thread.h"
 
-/** Assume that path name length <= 14. */
-#define MAXFILE 16
-
-static char buf[32];
+/** Directories with at least this many entries are stat'ed in parallel. */
+#define STAT_PARALLEL_MIN 64
+#define STAT_NTHREAD 8
+/** Each worker claims this many entries at a time. */
+#define STAT_BATCH 16
 
 static char *ftype[] = {
     [DT_CHR] "character device",
@@ -16,17 +20,238 @@ static char *ftype[] = {
     [DT_SOCK] "domain socket",
 };
 
-int main(int argc, char **argv) {
-    int fd = sys_open(argc < 2 ? "." : argv[1], O_RDONLY | O_DIRECTORY);
+struct entry {
+    const char *name;
+    uint8_t type;      // DT_*
+    uint16_t mode;
+    uint32_t nlink;
+    uint64_t size;
+    int64_t mtime;
+    int err;           // statx failure, if any
+};
+
+enum sort_by {
+    SORT_NAME = 0,
+    SORT_SIZE,
+    SORT_TIME,
+};
+
+static struct {
+    bool lng;          // -l
+    bool reverse;      // -r
+    enum sort_by by;   // -S, -t
+} opt;
+
+/** Shared by the stat workers. */
+static struct {
+    int dirfd;
+    unsigned int mask;
+    struct entry *ents;
+    size_t n;
+    size_t next;       // next unclaimed entry
+} job;
+
+static void stat_entry(struct entry *e) {
+    struct statx stx;
+    int ret = sys_statx(job.dirfd, e->name,
+                        AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC,
+                        job.mask, &stx);
+    if (ret != 0) {
+        e->err = ret;
+        return;
+    }
+    e->mode = stx.stx_mode;
+    e->nlink = stx.stx_nlink;
+    e->size = stx.stx_size;
+    e->mtime = stx.stx_mtime.tv_sec;
+}
+
+static int stat_worker(void *arg) {
+    for (;;) {
+        size_t i = __atomic_fetch_add(&job.next, STAT_BATCH, __ATOMIC_RELAXED);
+        if (i >= job.n) {
+            return 0;
+        }
+        size_t end = i + STAT_BATCH < job.n ? i + STAT_BATCH : job.n;
+        for (; i < end; i++) {
+            stat_entry(&job.ents[i]);
+        }
+    }
+}
+
+/** statx every entry, spreading the calls over threads for big directories. */
+static void stat_all(int dirfd, struct entry *ents, size_t n, unsigned int mask) {
+    static struct thread workers[STAT_NTHREAD - 1];
+    job.dirfd = dirfd;
+    job.mask = mask;
+    job.ents = ents;
+    job.n = n;
+    job.next = 0;
+
+    int nworker = 0;
+    if (n >= STAT_PARALLEL_MIN) {
+        for (; nworker < STAT_NTHREAD - 1; nworker++) {
+            if (thread_create(&workers[nworker], stat_worker, NULL) != 0) {
+                break;
+            }
+        }
+    }
+
+    // the main thread works too.
+    stat_worker(NULL);
+    for (int i = 0; i < nworker; i++) {
+        thread_join(&workers[i]);
+    }
+}
+
+static int by_name(const void *a, const void *b) {
+    return Strcmp(((const struct entry *)a)->name, ((const struct entry *)b)->name);
+}
+
+/** Sort by name, then (stably) by size or time, largest/newest first. */
+static void sort_entries(struct arena *ar, struct entry **ptrs, size_t n) {
+    sort_ptr((void **)ptrs, n, by_name);
+    if (opt.by == SORT_NAME) {
+        return;
+    }
+
+    struct sort_key *keys = arena_alloc(ar, 2 * n * sizeof(struct sort_key));
+    if (keys == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        uint64_t k = opt.by == SORT_SIZE
+                   ? ptrs[i]->size
+                   : (uint64_t)ptrs[i]->mtime ^ (1ul << 63);
+        keys[i].key = ~k;
+        keys[i].ptr = ptrs[i];
+    }
+    radix_sort(keys, keys + n, n);
+    for (size_t i = 0; i < n; i++) {
+        ptrs[i] = keys[i].ptr;
+    }
+}
+
+/** Output is collected here and written in large chunks. */
+static char out[65536];
+static size_t outlen;
+
+static void flush(void) {
+    sys_write(1, out, outlen);
+    outlen = 0;
+}
+
+static void mode_string(char *dst, const struct entry *e) {
+    static const char types[] = {
+        [DT_FIFO] 'p', [DT_CHR] 'c', [DT_DIR] 'd', [DT_BLK] 'b',
+        [DT_REG] '-', [DT_LNK] 'l', [DT_SOCK] 's',
+    };
+    static const char rwx[] = "rwxrwxrwx";
+    char t = e->type < sizeof(types) ? types[e->type] : 0;
+    dst[0] = t ? t : '?';
+    for (int i = 0; i < 9; i++) {
+        dst[1 + i] = (e->mode & (0400 >> i)) ? rwx[i] : '-';
+    }
+    dst[10] = 0;
+}
+
+static void put2(char *dst, int v) {
+    dst[0] = '0' + v / 10;
+    dst[1] = '0' + v % 10;
+}
+
+/** Format seconds since the epoch as "YYYY-MM-DD hh:mm" (UTC). */
+static void time_string(char *dst, int64_t t) {
+    int64_t days = t / 86400;
+    int64_t rem = t % 86400;
+    if (rem < 0) {
+        rem += 86400;
+        days--;
+    }
+
+    // civil date from day number, see
+    // <https://howardhinnant.github.io/date_algorithms.html#civil_from_days>
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    int64_t doe = days - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    int d = doy - (153 * mp + 2) / 5 + 1;
+    int m = mp < 10 ? mp + 3 : mp - 9;
+    int y = yoe + era * 400 + (m <= 2);
+
+    int hh = rem / 3600;
+    int mm = rem / 60 % 60;
+    dst += Sprintf(dst, "%d-", y);
+    put2(dst, m);
+    dst[2] = '-';
+    put2(dst + 3, d);
+    dst[5] = ' ';
+    put2(dst + 6, hh);
+    dst[8] = ':';
+    put2(dst + 9, mm);
+    dst[11] = 0;
+}
+
+static void print_entry(const struct entry *e) {
+    if (outlen + 4096 > sizeof(out)) {
+        flush();
+    }
+    if (!opt.lng) {
+        const char *typename = e->type < sizeof(ftype) / sizeof(ftype[0])
+                             ? ftype[e->type] : NULL;
+        outlen += Sprintf(out + outlen, "%s %s\n", e->name,
+                          typename == NULL ? ftype[DT_UNKNOWN] : typename);
+        return;
+    }
+    if (e->err) {
+        outlen += Sprintf(out + outlen, "?????????? ? ? %s\n", e->name);
+        return;
+    }
+
+    char mode[12];
+    char tm[20];
+    mode_string(mode, e);
+    time_string(tm, e->mtime);
+    outlen += Sprintf(out + outlen, "%s %u\t%L\t%s %s\n",
+                      mode, e->nlink, e->size, tm, e->name);
+}
+
+static uint8_t mode_to_type(uint16_t mode) {
+    switch (mode & S_IFMT) {
+    case S_IFSOCK: return DT_SOCK;
+    case S_IFLNK: return DT_LNK;
+    case S_IFREG: return DT_REG;
+    case S_IFBLK: return DT_BLK;
+    case S_IFDIR: return DT_DIR;
+    case S_IFCHR: return DT_CHR;
+    case S_IFIFO: return DT_FIFO;
+    }
+    return DT_UNKNOWN;
+}
+
+static int ls(const char *path) {
+    int fd = sys_open(path, O_RDONLY | O_DIRECTORY);
     if (fd < 0) {
         sys_write(2, "Bad file descriptor\n", 21);
-        sys_exit(1);
+        return 1;
     }
 
+    // names, then the entry array, then the pointer array all live here.
+    static struct arena names;
+    static struct arena ents;
+    if (!arena_init(&names, 1ul << 32) || !arena_init(&ents, 1ul << 32)) {
+        sys_write(2, "out of memory\n", 14);
+        return 1;
+    }
+
+    static char buf[32768];
     struct linux_dirent *di = (struct linux_dirent *)buf;
     long nread;
+    size_t n = 0;
 
-    while ((nread = sys_getdents(fd, di, sizeof(struct linux_dirent) + 16)) != 0) {
+    while ((nread = sys_getdents(fd, di, sizeof(buf))) != 0) {
         if (nread < 0) {
             Puts("<too long> ??\n");
             sys_exit(1);
@@ -36,12 +261,89 @@ int main(int argc, char **argv) {
             const char *filename = (const char *)it;
             const char *typeaddr = filename + it->d_reclen - 1;
             filename += offsetof(struct linux_dirent, d_name);
-            const char *typename = ftype[*typeaddr];
-            Printf("%s %s\n", filename,
-                   typename == NULL ? ftype[DT_UNKNOWN] : typename);
+
+            size_t len = Strlen(filename);
+            char *name = arena_alloc(&names, len + 1);
+            struct entry *e = arena_alloc(&ents, sizeof(struct entry));
+            if (name == NULL || e == NULL) {
+                sys_write(2, "out of memory\n", 14);
+                sys_exit(1);
+            }
+            Memcpy(name, filename, len + 1);
+            Memset(e, 0, sizeof(*e));
+            e->name = name;
+            e->type = *typeaddr;
+            n++;
+
             it = (struct linux_dirent *)((uintptr_t)it + it->d_reclen);
         }
     }
 
+    // entries were allocated back to back, so they form an array.
+    struct entry *arr = (struct entry *)ents.base;
+
+    // only ask statx for what we are going to print or sort on.
+    unsigned int mask = 0;
+    if (opt.lng) {
+        mask |= STATX_TYPE | STATX_MODE | STATX_NLINK | STATX_SIZE | STATX_MTIME;
+    }
+    if (opt.by == SORT_SIZE) {
+        mask |= STATX_SIZE;
+    }
+    if (opt.by == SORT_TIME) {
+        mask |= STATX_MTIME;
+    }
+    if (mask != 0) {
+        stat_all(fd, arr, n, mask);
+        for (size_t i = 0; i < n; i++) {
+            if (arr[i].type == DT_UNKNOWN && !arr[i].err) {
+                arr[i].type = mode_to_type(arr[i].mode);
+            }
+        }
+    }
+
+    struct entry **ptrs = arena_alloc(&ents, n * sizeof(struct entry *));
+    if (ptrs == NULL) {
+        sys_write(2, "out of memory\n", 14);
+        sys_exit(1);
+    }
+    for (size_t i = 0; i < n; i++) {
+        ptrs[i] = &arr[i];
+    }
+    sort_entries(&ents, ptrs, n);
+
+    for (size_t i = 0; i < n; i++) {
+        print_entry(ptrs[opt.reverse ? n - 1 - i : i]);
+    }
+    flush();
+
+    arena_destroy(&names);
+    arena_destroy(&ents);
+    sys_close(fd);
     return 0;
 }
+
+int main(int argc, char **argv) {
+    const char *path = ".";
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-' || argv[i][1] == 0) {
+            path = argv[i];
+            continue;
+        }
+        for (const char *f = argv[i] + 1; *f; f++) {
+            switch (*f) {
+            case 'l': opt.lng = true; break;
+            case 'r': opt.reverse = true; break;
+            case 'S': opt.by = SORT_SIZE; break;
+            case 't': opt.by = SORT_TIME; break;
+            default: {
+                sys_write(2, "Usage: ls [-lrSt] [dir]\n", 24);
+                return 1;
+            }
+            }
+        }
+    }
+
+    return ls(path);
+}
@@ -53,6 +53,8 @@
 # define MAP_ANONYMOUS	0x20		/* Don't use a file.  */
 #endif
 #define MAP_ANON	MAP_ANONYMOUS
+#define MAP_NORESERVE	0x4000		/* Don't check for reservations.  */
+#define MAP_STACK	0x20000		/* Allocation is for a stack.  */
 
 /* When MAP_HUGETLB is set, bits [26:31] encode the log2 of the huge page size.
    The following definitions are associated with this huge page size encoding.
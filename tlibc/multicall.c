@@ -0,0 +1,84 @@
+#include "std.h"
+#include "multicall.h"
+
+#define PREFIX "_"
+
+#define APPLET(name) extern int name##_main(int argc, char **argv);
+#include "applets.h"
+#undef APPLET
+
+/** Sorted by name, as configure.py writes applets.h. */
+static const struct applet applets[] = {
+#define APPLET(name) {#name, name##_main},
+#include "applets.h"
+#undef APPLET
+};
+
+#define NAPPLETS (sizeof(applets) / sizeof(applets[0]))
+
+const struct applet *applet_find(const char *name) {
+    size_t lo = 0;
+    size_t hi = NAPPLETS;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        int c = Strcmp(name, applets[mid].name);
+        if (c == 0) {
+            return &applets[mid];
+        }
+        if (c < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+/** The applet name in a path: after the last slash and the prefix. */
+static const char *applet_name(const char *path) {
+    const char *name = path;
+    for (const char *p = path; *p; p++) {
+        if (*p == '/') {
+            name = p + 1;
+        }
+    }
+    size_t plen = sizeof(PREFIX) - 1;
+    if (Memcmp(name, PREFIX, plen) == 0 && name[plen] != 0) {
+        name += plen;
+    }
+    return name;
+}
+
+const struct applet *applet_at(const char *path) {
+    static struct stat self;
+    if (self.st_ino == 0 && sys_fstatat(AT_FDCWD, "/proc/self/exe", &self, 0) < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (sys_fstatat(AT_FDCWD, path, &st, 0) < 0 ||
+        st.st_dev != self.st_dev || st.st_ino != self.st_ino) {
+        return NULL;
+    }
+    return applet_find(applet_name(path));
+}
+
+int main(int argc, char **argv) {
+    const char *name = applet_name(argv[0]);
+    if (Strcmp(name, "tlibc") == 0 && argc > 1) {
+        argc--;
+        argv++;
+        name = applet_name(argv[0]);
+    }
+
+    const struct applet *a = applet_find(name);
+    if (a != NULL) {
+        return a->main(argc, argv);
+    }
+
+    Printf("tlibc: %s: no such applet; there are:\n", name);
+    for (size_t i = 0; i < NAPPLETS; i++) {
+        Printf("%s%s", i == 0 ? "" : " ", applets[i].name);
+    }
+    Printf("\n");
+    return 127;
+}
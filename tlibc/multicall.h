@@ -0,0 +1,22 @@
+#ifndef _MULTICALL_H_
+#define _MULTICALL_H_
+
+/** The multi-call build (configure.py): every utility is linked into
+ * one binary, its main renamed to <name>_main, and the binary runs the
+ * one named by argv[0] (without the program prefix), or by argv[1]
+ * when called as tlibc. applets.h is generated with an APPLET(name)
+ * line for each of them. */
+
+struct applet {
+    const char *name;
+    int (*main)(int argc, char **argv);
+};
+
+/** The applet called name, or NULL. */
+extern const struct applet *applet_find(const char *name);
+
+/** The applet that running path would run, if path is this very binary
+ * (under any name or link), or NULL. */
+extern const struct applet *applet_at(const char *path);
+
+#endif // _MULTICALL_H_
@@ -1,179 +1,3071 @@
 #include "sys.h"
 #include "std.h"
+#include "arena.h"
+#include "spawn.h"
+#include "zygote.h"
+#include "glob.h"
+#ifdef MULTICALL
+#include "multicall.h"
+#endif
 
+static void jobs_notify(void);
+static int run_text(const char *src, int len, bool *more);
+static int run_file(const char *path);
+static void var_init(void);
+
+/** Positional parameters: params[0] is $0. */
+static char **params;
+static int nparams;
+static int last_status;
+static bool interactive;
+
+/** Loops left to break out of; with continuing, the last one of them
+ * goes on instead. Set by break and continue, like returning by return. */
+static int loop_depth;
+static int breaking;
+static bool continuing;
+static int func_depth;
+static bool returning;
+
+/** sh, sh file [args...], or sh -c command [name [args...]]. A script
+ * is parsed whole before it runs; typed lines one command at a time,
+ * read on while one is unfinished. */
 int main(int argc, char **argv) {
-    // eg2();
+    var_init();
+    params = argv;
+    nparams = 1;
+    if (argc > 2 && Strcmp(argv[1], "-c") == 0) {
+        if (argc > 3) {
+            params = argv + 3;
+            nparams = argc - 3;
+        }
+        return run_text(argv[2], Strlen(argv[2]), NULL);
+    }
+    if (argc > 1) {
+        params = argv + 1;
+        nparams = argc - 1;
+        return run_file(argv[1]);
+    }
+
+    interactive = true;
     static struct buffered_reader br;
     static char buf[2048];
+    static char text[65536];
+    size_t len = 0;
     br.start = br.end = 0;
 
     sys_write(1, "(yrd) ", 6);
     while (fdgets(&br, buf, 0)) {
-        system(buf);
+        size_t n = Strlen(buf);
+        bool more = false;
+        if (len + n > sizeof(text)) {
+            sys_write(2, "sh: command too long\n", 21);
+        } else {
+            Memcpy(text + len, buf, n);
+            len += n;
+            run_text(text, len, &more);
+        }
+        if (more) {
+            sys_write(1, "> ", 2);
+            continue;
+        }
+        len = 0;
+        jobs_notify();
         sys_write(1, "(yrd) ", 6);
     }
-    return 0;
+    return last_status;
 }
 
-/* Return true if ch is in string s. */
-static bool contains(const char *s, char ch) {
-    if (ch == '\0') {
-        return true;
+/** Character classes of the lexer, one lookup per byte. */
+enum {
+    CH_WORD = 0,
+    CH_BLANK,
+    CH_OP,          // a token of its own, even without blanks around
+    CH_QUOTE,       // quotes a part of a word
+};
+
+static const uint8_t char_class[256] = {
+    [0] = CH_BLANK, [' '] = CH_BLANK, ['\t'] = CH_BLANK, ['\r'] = CH_BLANK,
+    ['\n'] = CH_OP, [';'] = CH_OP, ['&'] = CH_OP, ['|'] = CH_OP,
+    ['<'] = CH_OP, ['>'] = CH_OP, ['('] = CH_OP, [')'] = CH_OP,
+    ['\''] = CH_QUOTE, ['"'] = CH_QUOTE, ['\\'] = CH_QUOTE,
+};
+
+/** The tree of what is run, and what it expands to meanwhile. A
+ * script's tree stays while it runs; a typed line's only if it
+ * defined a function. */
+#define LINE_ARENA (64ul << 20)
+static struct arena line_arena;
+
+/** Format us as "1m2.345s" into dst; returns the length. */
+static unsigned fmt_time(char *dst, uint64_t us) {
+    uint64_t ms = us / 1000;
+    char frac[4] = {
+        '0' + ms % 1000 / 100, '0' + ms % 100 / 10, '0' + ms % 10, 0,
+    };
+    return Sprintf(dst, "%Lm%L.%ss", ms / 60000, ms / 1000 % 60, frac);
+}
+
+/** The time builtin's report, on stderr like bash's. */
+static void report_time(uint64_t wall_ns, const struct rusage *ru) {
+    static char buf[512];
+    char *p = buf;
+    p += Sprintf(p, "\nreal\t");
+    p += fmt_time(p, wall_ns / 1000);
+    p += Sprintf(p, "\nuser\t");
+    p += fmt_time(p, ru->ru_utime.tv_sec * 1000000ul + ru->ru_utime.tv_usec);
+    p += Sprintf(p, "\nsys\t");
+    p += fmt_time(p, ru->ru_stime.tv_sec * 1000000ul + ru->ru_stime.tv_usec);
+    p += Sprintf(p, "\nmaxrss\t%L KB\nfaults\t%L minor, %L major\n"
+                    "ctxsw\t%L voluntary, %L involuntary\n",
+                 ru->ru_maxrss, ru->ru_minflt, ru->ru_majflt,
+                 ru->ru_nvcsw, ru->ru_nivcsw);
+    sys_write(2, buf, p - buf);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    sys_clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/** Shell variables: open addressing over "name=value" strings, which
+ * is what an environment is made of too, so the exported ones go to
+ * commands as they are. A string that is replaced is garbage in
+ * var_strings until it is compacted. */
+#define VAR_ARENA (16ul << 20)
+#define VAR_MIN 256     // slots at first; a power of 2
+
+struct var {
+    uint32_t hash;
+    int nlen;           // of the name
+    bool exported;
+    char *str;          // "name=value", "name" exported but unset; NULL: free
+};
+
+static struct var *vars;
+static uint32_t var_cap;
+static uint32_t var_count;
+static struct arena var_strings;
+static struct arena var_old;    // what was compacted, until the next time
+static size_t var_garbage;
+/** The environment of commands, made from the exported variables
+ * again only once they changed. */
+static char **var_env;
+static size_t var_env_size;
+static bool env_dirty;
+
+static uint32_t var_hash(const char *name, int len) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)name[i]) * 16777619u;
     }
-    for (int i = 0; s[i]; i++) {
-        if (s[i] == ch) {
-            return true;
+    return h;
+}
+
+/** The slot of name, or the free slot where it would go. */
+static struct var *var_slot(const char *name, int len, uint32_t h) {
+    for (uint32_t i = h; ; i++) {
+        struct var *v = &vars[i & (var_cap - 1)];
+        if (v->str == NULL || (v->hash == h && v->nlen == len && Memcmp(v->str, name, len) == 0)) {
+            return v;
         }
     }
-    return false;
 }
 
-static int Strcmp(const char *s1, const char *s2) {
-    while (*s1 != 0 && *s2 != 0) {
-        if (*s1 != *s2) {
-            int ret = 0;
-            ret += (int)*s1;
-            ret -= (int)*s2;
-            return ret;
+static bool var_grow(void) {
+    uint32_t cap = var_cap ? var_cap * 2 : VAR_MIN;
+    struct var *old = vars;
+    uint32_t old_cap = var_cap;
+    struct var *fresh = sys_mmap(NULL, cap * sizeof(*fresh), PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ((long)fresh < 0) {
+        return false;
+    }
+    vars = fresh;
+    var_cap = cap;
+    for (uint32_t i = 0; i < old_cap; i++) {
+        if (old[i].str != NULL) {
+            *var_slot(old[i].str, old[i].nlen, old[i].hash) = old[i];
+        }
+    }
+    if (old != NULL) {
+        sys_munmap(old, old_cap * sizeof(*old));
+    }
+    return true;
+}
+
+static void env_sync(void);
+
+/** Copy the live strings to a new arena. The old one stays until the
+ * next time, for the strings a caller is in the middle of using. */
+static void var_compact(void) {
+    struct arena fresh;
+    if (!arena_init(&fresh, VAR_ARENA)) {
+        return;
+    }
+    for (uint32_t i = 0; i < var_cap; i++) {
+        if (vars[i].str != NULL) {
+            size_t n = Strlen(vars[i].str) + 1;
+            vars[i].str = Memcpy(arena_alloc(&fresh, n), vars[i].str, n);
         }
-        s1 ++;
-        s2 ++;
     }
+    arena_destroy(&var_old);
+    var_old = var_strings;
+    var_strings = fresh;
+    var_garbage = 0;
+    var_env_size = 0;
+    env_dirty = true;
+    env_sync();
+}
 
-    return (int)*s1 - (int)*s2;
+static void *var_alloc(size_t size) {
+    if (var_garbage > (1 << 20) && var_garbage > var_strings.used / 2) {
+        var_compact();
+    }
+    void *p = arena_alloc(&var_strings, size);
+    if (p == NULL) {
+        var_compact();
+        p = arena_alloc(&var_strings, size);
+    }
+    return p;
 }
 
-static int system_single(const char *cmd, int end) {
-    static job_t jobs[4];
-    if (*cmd == 0) {
-        return 0;
+/** The exported variables that are set, as envp; environ points there. */
+static void env_sync(void) {
+    if (!env_dirty) {
+        return;
     }
-    Memset(jobs, 0, sizeof(jobs));
-
-    static const char *blank = " \t\r\n";
-    int jobcnt = 1;
-    int narg = 0;
-    job_t *cur = (job_t *)jobs;
-    char *cp = (char *)cur->buf;
-    // is next token stdin, stdout or stderr?
-    bool prein = false;
-    bool preout = false;
-    bool preerr = false;
-
-    for (int i = 0; i < end; ) {
-        int next = i;
-        // -- search and record begin of token -- //
-        for (; next < end; next++) {
-            if (!contains(blank, cmd[next])) {
-                break;
-            }
+    size_t n = 0;
+    for (uint32_t i = 0; i < var_cap; i++) {
+        n += vars[i].str != NULL && vars[i].exported && vars[i].str[vars[i].nlen] == '=';
+    }
+    char **env = arena_alloc(&var_strings, (n + 1) * sizeof(char *));
+    if (env == NULL) {
+        return;     // keep the old one; dirty still
+    }
+    n = 0;
+    for (uint32_t i = 0; i < var_cap; i++) {
+        if (vars[i].str != NULL && vars[i].exported && vars[i].str[vars[i].nlen] == '=') {
+            env[n++] = vars[i].str;
         }
-        i = next;
+    }
+    env[n] = NULL;
+    var_garbage += var_env_size;
+    var_env_size = (n + 1) * sizeof(char *);
+    var_env = environ = env;
+    env_dirty = false;
+}
 
-        // -- search end of token -- //
-        for (next = i; next < end; next++) {
-            if (contains(blank, cmd[next])) {
-                break;
+static const char *var_get(const char *name, int len) {
+    if (var_cap == 0) {
+        return NULL;
+    }
+    struct var *v = var_slot(name, len, var_hash(name, len));
+    return v->str != NULL && v->str[len] == '=' ? v->str + len + 1 : NULL;
+}
+
+/** Set name[0, nlen) to value, or to nothing with NULL, which only
+ * makes sense to export it. With export, it goes to commands from now. */
+static void var_store(const char *name, int nlen, const char *value, bool export) {
+    if ((var_count + 1 > var_cap * 3 / 4 && !var_grow()) || nlen == 0) {
+        sys_write(2, "sh: cannot set a variable\n", 26);
+        return;
+    }
+    uint32_t h = var_hash(name, nlen);
+    struct var *v = var_slot(name, nlen, h);
+    if (value == NULL && v->str != NULL) {
+        v->exported |= export;
+        env_dirty |= export;
+        return;
+    }
+    size_t vlen = value != NULL ? Strlen(value) : 0;
+    char *s = var_alloc(nlen + (value != NULL) + vlen + 1);
+    if (s == NULL) {
+        sys_write(2, "sh: cannot set a variable\n", 26);
+        return;
+    }
+    Memcpy(s, name, nlen);
+    if (value != NULL) {
+        s[nlen] = '=';
+        Memcpy(s + nlen + 1, value, vlen);
+    }
+    s[nlen + (value != NULL) + vlen] = 0;
+    if (v->str == NULL) {
+        *v = (struct var){.hash = h, .nlen = nlen};
+        var_count++;
+    } else {
+        var_garbage += Strlen(v->str) + 1;
+    }
+    v->str = s;
+    v->exported |= export;
+    env_dirty |= v->exported;
+    if (nlen == 4 && Memcmp(name, "PATH", 4) == 0) {
+        hash_reset();       // commands may be elsewhere now
+    }
+}
+
+static void var_set(const char *name, const char *value) {
+    var_store(name, Strlen(name), value, false);
+}
+
+/** Remove name; as it is open addressing, later entries of its run
+ * move back, so no probe stops early. */
+static void var_unset(const char *name) {
+    int nlen = Strlen(name);
+    if (var_cap == 0) {
+        return;
+    }
+    struct var *v = var_slot(name, nlen, var_hash(name, nlen));
+    if (v->str == NULL) {
+        return;
+    }
+    env_dirty |= v->exported;
+    var_garbage += Strlen(v->str) + 1;
+    uint32_t mask = var_cap - 1;
+    uint32_t hole = v - vars;
+    for (uint32_t i = hole + 1; ; i++) {
+        struct var *next = &vars[i & mask];
+        if (next->str == NULL) {
+            break;
+        }
+        uint32_t home = next->hash & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            vars[hole] = *next;
+            hole = i & mask;
+        }
+    }
+    vars[hole].str = NULL;
+    var_count--;
+    if (nlen == 4 && Memcmp(name, "PATH", 4) == 0) {
+        hash_reset();
+    }
+}
+
+/** The environment main got becomes exported variables. */
+static void var_init(void) {
+    if (!arena_init(&var_strings, VAR_ARENA)) {
+        return;
+    }
+    for (char **e = environ; e != NULL && *e != NULL; e++) {
+        const char *eq = *e;
+        while (*eq && *eq != '=') {
+            eq++;
+        }
+        if (*eq == '=') {
+            var_store(*e, eq - *e, eq + 1, true);
+        }
+    }
+    env_sync();
+}
+
+static bool name_char(char c, bool first) {
+    return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (!first && c >= '0' && c <= '9');
+}
+
+/** How much of s[0, len) is a variable name. */
+static int name_len(const char *s, int len) {
+    int n = 0;
+    while (n < len && name_char(s[n], n == 0)) {
+        n++;
+    }
+    return n;
+}
+
+#define MAXJOBS 32
+
+/** Background jobs; job %n is bgjobs[n - 1], free if pgid is 0. */
+static struct bgjob {
+    int pgid;
+    int last;           // pid of the last stage
+    int status;         // the last stage's, once done
+    bool done;
+    char cmd[64];
+} bgjobs[MAXJOBS];
+
+/** SIGCHLD is blocked and arrives here instead, so looking for ended
+ * jobs costs one read when none has. */
+static int sigchld_fd = -1;
+
+static void jobs_init(void) {
+    if (sigchld_fd >= 0) {
+        return;
+    }
+    uint64_t mask = SIGMASK(SIGCHLD);
+    sys_rt_sigprocmask(SIG_BLOCK, &mask, NULL, sizeof(mask));
+    sigchld_fd = sys_signalfd4(-1, &mask, sizeof(mask), SFD_NONBLOCK | SFD_CLOEXEC);
+}
+
+/** Reap what is left of job j; wait for it with block. */
+static void job_reap(struct bgjob *j, bool block) {
+    while (!j->done) {
+        int st;
+        int r = sys_wait4(-j->pgid, &st, block ? 0 : WNOHANG, NULL);
+        if (r == -EINTR || (r > 0 && r != j->last)) {
+            continue;
+        }
+        if (r == 0) {
+            return;     // still running
+        }
+        if (r > 0) {
+            j->status = WIFEXITED(st) ? WEXITSTATUS(st) : 128 + WTERMSIG(st);
+        } else {
+            j->done = true;     // nothing left in the group
+        }
+    }
+}
+
+/** Process substitutions of the commands running: the shell's end of
+ * each pipe, to close once the command has it, and the process, to
+ * reap once the command is done. Those of a background command are
+ * strays, reaped as they end. */
+#define MAXPROCS 16
+static struct proc {
+    int fd;
+    int pid;
+} procs[MAXPROCS];
+static int nprocs;
+static int strays[MAXPROCS];
+static int nstrays;
+
+/** Close what the process substitutions from mark on left to the
+ * shell, and reap their processes: now with wait, later otherwise. */
+static void procs_done(int mark, bool wait) {
+    for (int i = mark; i < nprocs; i++) {
+        sys_close(procs[i].fd);
+    }
+    for (int i = mark; i < nprocs; i++) {
+        if (!wait && nstrays < MAXPROCS) {
+            strays[nstrays++] = procs[i].pid;
+            continue;
+        }
+        while (sys_wait4(procs[i].pid, NULL, 0, NULL) == -EINTR) {}
+    }
+    nprocs = mark;
+}
+
+static void strays_reap(void) {
+    for (int i = 0; i < nstrays; ) {
+        int r = sys_wait4(strays[i], NULL, WNOHANG, NULL);
+        if (r == 0 || r == -EINTR) {
+            i++;
+        } else {
+            strays[i] = strays[--nstrays];
+        }
+    }
+}
+
+/** Reap every job that ended since the last call, without waiting. */
+static void jobs_reap(void) {
+    static char info[128];
+    if (sigchld_fd < 0 || sys_read(sigchld_fd, info, sizeof(info)) <= 0) {
+        return;
+    }
+    while (sys_read(sigchld_fd, info, sizeof(info)) > 0) {}
+    strays_reap();
+    for (int i = 0; i < MAXJOBS; i++) {
+        if (bgjobs[i].pgid != 0) {
+            job_reap(&bgjobs[i], false);
+        }
+    }
+}
+
+static void job_print(int n, const struct bgjob *j) {
+    if (!j->done) {
+        Printf("[%d] Running\t%s\n", n, j->cmd);
+    } else if (j->status == 0) {
+        Printf("[%d] Done\t%s\n", n, j->cmd);
+    } else {
+        Printf("[%d] Exit %d\t%s\n", n, j->status, j->cmd);
+    }
+}
+
+/** Before a prompt: tell which jobs ended, and forget them. */
+static void jobs_notify(void) {
+    jobs_reap();
+    for (int i = 0; i < MAXJOBS; i++) {
+        if (bgjobs[i].pgid != 0 && bgjobs[i].done) {
+            job_print(i + 1, &bgjobs[i]);
+            bgjobs[i].pgid = 0;
+        }
+    }
+}
+
+/** Start jobs[0..cnt) in the background as a new job. */
+static int job_start(job_t *jobs, int cnt, int flags, const char *cmd, int len) {
+    int n = 0;
+    while (n < MAXJOBS && bgjobs[n].pgid != 0) {
+        n++;
+    }
+    if (n == MAXJOBS) {
+        sys_write(2, "sh: too many jobs\n", 18);
+        return 1;
+    }
+    jobs_init();
+    int pgid = exec_job(jobs, cnt, flags | EXEC_BACKGROUND, NULL);
+    if (pgid < 0) {
+        return 127;
+    }
+
+    struct bgjob *j = &bgjobs[n];
+    *j = (struct bgjob){.pgid = pgid, .last = jobs[cnt - 1].pid};
+    if (j->last < 0) {
+        j->status = jobs[cnt - 1].status;
+    }
+    while (len > 0 && char_class[(uint8_t)*cmd] == CH_BLANK) {
+        cmd++;
+        len--;
+    }
+    while (len > 0 && char_class[(uint8_t)cmd[len - 1]] == CH_BLANK) {
+        len--;
+    }
+    len = len < (int)sizeof(j->cmd) - 1 ? len : (int)sizeof(j->cmd) - 1;
+    Memcpy(j->cmd, cmd, len);
+    j->cmd[len] = 0;
+    if (interactive) {
+        Printf("[%d] %d\n", n + 1, pgid);
+    }
+    return 0;
+}
+
+/** wait: for all jobs, wait %n: for job n, and give its status. */
+static int job_wait(const char *arg) {
+    if (arg == NULL) {
+        for (int i = 0; i < MAXJOBS; i++) {
+            if (bgjobs[i].pgid != 0) {
+                job_reap(&bgjobs[i], true);
+                bgjobs[i].pgid = 0;
             }
         }
+        return 0;
+    }
+    int n = arg[0] == '%' ? atoi(arg + 1) : 0;
+    if (n < 1 || n > MAXJOBS || bgjobs[n - 1].pgid == 0) {
+        sys_write(2, "wait: ", 6);
+        sys_write(2, arg, Strlen(arg));
+        sys_write(2, ": no such job\n", 14);
+        return 127;
+    }
+    struct bgjob *j = &bgjobs[n - 1];
+    job_reap(j, true);
+    j->pgid = 0;
+    return j->status;
+}
+
+/** Flags for exec_job, changed by set -o/+o. */
+static int exec_flags;
+
+/** Output of the builtins, collected so that a line costs one write. */
+static struct {
+    char buf[4096];
+    int len;
+} out;
+
+static void out_flush(void) {
+    for (int done = 0; done < out.len; ) {
+        long w = sys_write(1, out.buf + done, out.len - done);
+        if (w <= 0) {
+            break;
+        }
+        done += w;
+    }
+    out.len = 0;
+}
+
+static void out_put(const char *p, size_t n) {
+    while (n > 0) {
+        if (out.len == sizeof(out.buf)) {
+            out_flush();
+        }
+        size_t k = sizeof(out.buf) - out.len;
+        k = k < n ? k : n;
+        Memcpy(out.buf + out.len, p, k);
+        out.len += k;
+        p += k;
+        n -= k;
+    }
+}
+
+static void out_str(const char *s) {
+    out_put(s, Strlen(s));
+}
+
+/** Parse a whole decimal integer, with a sign. */
+static bool to_long(const char *s, long *v) {
+    bool neg = *s == '-';
+    s += *s == '-' || *s == '+';
+    if (*s == 0) {
+        return false;
+    }
+    long n = 0;
+    for (; *s; s++) {
+        if (*s < '0' || *s > '9') {
+            return false;
+        }
+        n = n * 10 + (*s - '0');
+    }
+    *v = neg ? -n : n;
+    return true;
+}
+
+static int builtin_true(int argc, char **argv) {
+    return 0;
+}
+
+static int builtin_false(int argc, char **argv) {
+    return 1;
+}
+
+/** echo [-n] args... */
+static int builtin_echo(int argc, char **argv) {
+    int i = 1;
+    bool newline = true;
+    if (i < argc && Strcmp(argv[i], "-n") == 0) {
+        newline = false;
+        i++;
+    }
+    for (int first = i; i < argc; i++) {
+        if (i > first) {
+            out_put(" ", 1);
+        }
+        out_str(argv[i]);
+    }
+    if (newline) {
+        out_put("\n", 1);
+    }
+    out_flush();
+    return 0;
+}
+
+static int builtin_pwd(int argc, char **argv) {
+    static char buf[4096];
+    if ((long)sys_getcwd(buf, sizeof(buf)) < 0) {
+        sys_write(2, "pwd: cannot get the directory\n", 30);
+        return 1;
+    }
+    out_str(buf);
+    out_put("\n", 1);
+    out_flush();
+    return 0;
+}
+
+/** One conversion of printf with its flags and width. */
+static void put_conv(char conv, const char *arg, bool left, bool zero, int width) {
+    char num[32];
+    const char *s = num;
+    size_t len;
+    long v = 0;
+    if (conv == 's' || conv == 'c') {
+        s = arg;
+        len = conv == 'c' ? (*arg != 0) : Strlen(arg);
+        zero = false;
+    } else {
+        if (*arg != 0 && !to_long(arg, &v)) {
+            sys_write(2, "printf: not a number: ", 22);
+            sys_write(2, arg, Strlen(arg));
+            sys_write(2, "\n", 1);
+        }
+        bool neg = conv != 'x' && v < 0;
+        unsigned long u = neg ? -(unsigned long)v : (unsigned long)v;
+        char *p = num + sizeof(num);
+        int base = conv == 'x' ? 16 : 10;
+        do {
+            *--p = "0123456789abcdef"[u % base];
+            u /= base;
+        } while (u > 0);
+        if (neg) {
+            *--p = '-';
+        }
+        s = p;
+        len = num + sizeof(num) - p;
+    }
+
+    int pad = width > (int)len ? width - (int)len : 0;
+    if (zero && !left && *s == '-') {
+        out_put(s++, 1);
+        len--;
+    }
+    for (; !left && pad > 0; pad--) {
+        out_put(zero ? "0" : " ", 1);
+    }
+    out_put(s, len);
+    for (; pad > 0; pad--) {
+        out_put(" ", 1);
+    }
+}
 
-        // -- record in buffer -- //
-        if (next > i) {
-            char *old = cp;
-            bool is_argv = true;
-            for (int k = i; k < next; k++) {
-                *cp = cmd[k];
-                cp++;
-            }
-            *cp = 0;
-            cp++;
-
-            if (Strcmp(old, "|") == 0) {
-                // a pipe!
-                cur->pipe = false;
-                // turn to next job
-                is_argv = false;
-                jobcnt++;
-                cur++;
-                narg = 0;
-            }
-
-            // current token is dest of redirection
-            if (prein) {
-                prein = false;
-                is_argv = false;
-                cur->stdin_fo = old;
-            }
-            if (preout) {
-                preout = false;
-                is_argv = false;
-                cur->stdout_fo = old;
-            }
-            if (preerr) {
-                preerr = false;
-                is_argv = false;
-                cur->stderr_fo = old;
-            }
-            if (Strcmp(old, "<") == 0) {
-                prein = true;
-                is_argv = false;
-            }
-            if (Strcmp(old, ">") == 0) {
-                preout = true;
-                is_argv = false;
-            }
-            if (Strcmp(old, "2>") == 0) {
-                preerr = true;
-                is_argv = false;
-            }
-            
-            // is an argument
-            if (is_argv) {
-                if (narg == 0) {
-                    cur->exe = old;
+/** printf format args...: %s %c %d %i %u %x with - and 0 flags and a
+ * width, and the usual backslash escapes. The format is used again
+ * while arguments are left. */
+static int builtin_printf(int argc, char **argv) {
+    if (argc < 2) {
+        sys_write(2, "usage: printf format [args...]\n", 31);
+        return 1;
+    }
+    const char *fmt = argv[1];
+    int arg = 2;
+    do {
+        bool used = false;
+        for (const char *f = fmt; *f; f++) {
+            if (*f == '\\' && f[1]) {
+                static const char from[] = "ntr\\abfv0";
+                static const char to[] = "\n\t\r\\\a\b\f\v";
+                f++;
+                const char *k = Memchr(from, *f, sizeof(from) - 1);
+                if (k == NULL) {
+                    out_put(f - 1, 2);
+                } else if (*f != '0') {
+                    out_put(&to[k - from], 1);
                 }
-                cur->argv[narg++] = old;
+                continue;
+            }
+            if (*f != '%') {
+                out_put(f, 1);
+                continue;
+            }
+            f++;
+            if (*f == '%') {
+                out_put("%", 1);
+                continue;
             }
+            bool left = false;
+            bool zero = false;
+            for (; *f == '-' || *f == '0'; f++) {
+                left |= *f == '-';
+                zero |= *f == '0';
+            }
+            int width = 0;
+            for (; *f >= '0' && *f <= '9'; f++) {
+                width = width * 10 + (*f - '0');
+            }
+            char conv = *f == 'i' ? 'd' : *f;
+            if (conv != 's' && conv != 'c' && conv != 'd' && conv != 'u' && conv != 'x') {
+                sys_write(2, "printf: bad conversion\n", 23);
+                out_flush();
+                return 1;
+            }
+            put_conv(conv, arg < argc ? argv[arg] : "", left, zero, width);
+            arg += arg < argc;
+            used = true;
+        }
+        if (!used) {
+            break;
         }
+    } while (arg < argc);
+    out_flush();
+    return 0;
+}
+
+/** test's argument list, read by a recursive descent parser. */
+static struct {
+    char **argv;
+    int pos;
+    int end;
+    bool error;
+} t;
+
+static const char *t_peek(int k) {
+    return t.pos + k < t.end ? t.argv[t.pos + k] : NULL;
+}
+
+static bool t_is(int k, const char *s) {
+    const char *a = t_peek(k);
+    return a != NULL && Strcmp(a, s) == 0;
+}
 
-        // -- end loop -- //
-        i = next;
+static bool t_unary(char op, const char *arg) {
+    struct stat st;
+    int flags = op == 'L' || op == 'h' ? AT_SYMLINK_NOFOLLOW : 0;
+    switch (op) {
+    case 'n': return *arg != 0;
+    case 'z': return *arg == 0;
+    case 'r': return sys_faccessat(AT_FDCWD, arg, R_OK) == 0;
+    case 'w': return sys_faccessat(AT_FDCWD, arg, W_OK) == 0;
+    case 'x': return sys_faccessat(AT_FDCWD, arg, X_OK) == 0;
+    case 't': {
+        long fd;
+        int pgid;
+        return to_long(arg, &fd) && sys_ioctl(fd, TIOCGPGRP, (unsigned long)&pgid) == 0;
+    }
     }
+    if (sys_fstatat(AT_FDCWD, arg, &st, flags) != 0) {
+        return false;
+    }
+    switch (op) {
+    case 'e': return true;
+    case 's': return st.st_size > 0;
+    case 'f': return (st.st_mode & S_IFMT) == S_IFREG;
+    case 'd': return (st.st_mode & S_IFMT) == S_IFDIR;
+    case 'L': case 'h': return (st.st_mode & S_IFMT) == S_IFLNK;
+    case 'p': return (st.st_mode & S_IFMT) == S_IFIFO;
+    case 'S': return (st.st_mode & S_IFMT) == S_IFSOCK;
+    case 'b': return (st.st_mode & S_IFMT) == S_IFBLK;
+    case 'c': return (st.st_mode & S_IFMT) == S_IFCHR;
+    }
+    return false;
+}
 
-    // built in commands: cd, exit(q), pid
-    if (Strcmp("cd", jobs[0].exe) == 0) {
-        if (sys_chdir(jobs[0].argv[1]) != 0) {
-            sys_write(2, "cd failure\n", 11);
+static bool t_binary(const char *a, const char *op, const char *b) {
+    if (Strcmp(op, "=") == 0) {
+        return Strcmp(a, b) == 0;
+    }
+    if (Strcmp(op, "!=") == 0) {
+        return Strcmp(a, b) != 0;
+    }
+    static const char *ops[] = {"-eq", "-ne", "-lt", "-le", "-gt", "-ge"};
+    long x, y;
+    if (!to_long(a, &x) || !to_long(b, &y)) {
+        t.error = true;
+        return false;
+    }
+    bool r[] = {x == y, x != y, x < y, x <= y, x > y, x >= y};
+    for (int i = 0; i < 6; i++) {
+        if (Strcmp(op, ops[i]) == 0) {
+            return r[i];
         }
-        return 0;
     }
-    if (Strcmp("exit", jobs[0].exe) == 0 || 
-        Strcmp("q", jobs[0].exe) == 0) {
+    t.error = true;
+    return false;
+}
+
+static bool is_binary(const char *op) {
+    static const char *ops[] = {"=", "!=", "-eq", "-ne", "-lt", "-le", "-gt", "-ge"};
+    for (int i = 0; op != NULL && i < 8; i++) {
+        if (Strcmp(op, ops[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool t_or(void);
+
+static bool t_primary(void) {
+    const char *a = t_peek(0);
+    if (a == NULL) {
+        t.error = true;
+        return false;
+    }
+    if (is_binary(t_peek(1)) && t_peek(2) != NULL) {
+        t.pos += 3;
+        return t_binary(a, t.argv[t.pos - 2], t.argv[t.pos - 1]);
+    }
+    if (Strcmp(a, "!") == 0) {
+        t.pos++;
+        return !t_primary();
+    }
+    if (Strcmp(a, "(") == 0) {
+        t.pos++;
+        bool r = t_or();
+        if (!t_is(0, ")")) {
+            t.error = true;
+        }
+        t.pos++;
+        return r;
+    }
+    if (a[0] == '-' && a[1] != 0 && a[2] == 0 && t_peek(1) != NULL) {
+        t.pos += 2;
+        return t_unary(a[1], t.argv[t.pos - 1]);
+    }
+    t.pos++;
+    return *a != 0;
+}
+
+static bool t_and(void) {
+    bool r = t_primary();
+    while (t_is(0, "-a")) {
+        t.pos++;
+        r = t_primary() && r;
+    }
+    return r;
+}
+
+static bool t_or(void) {
+    bool r = t_and();
+    while (t_is(0, "-o")) {
+        t.pos++;
+        r = t_and() || r;
+    }
+    return r;
+}
+
+/** test expr, [ expr ]: 0 if true, 1 if false, 2 on errors. */
+static int builtin_test(int argc, char **argv) {
+    if (Strcmp(argv[0], "[") == 0) {
+        if (Strcmp(argv[argc - 1], "]") != 0) {
+            sys_write(2, "[: missing ]\n", 13);
+            return 2;
+        }
+        argc--;
+    }
+    t.argv = argv;
+    t.pos = 1;
+    t.end = argc;
+    t.error = false;
+    if (argc == 1) {
+        return 1;
+    }
+    bool r = t_or();
+    if (t.error || t.pos != t.end) {
+        sys_write(2, "test: bad expression\n", 21);
+        return 2;
+    }
+    return r ? 0 : 1;
+}
+
+static int builtin_cd(int argc, char **argv) {
+    const char *dir = argc > 1 ? argv[1] : Getenv("HOME");
+    if (dir == NULL || sys_chdir(dir) != 0) {
+        sys_write(2, "cd failure\n", 11);
+        return 1;
+    }
+    return 0;
+}
+
+static int builtin_exit(int argc, char **argv) {
+    long code = argc > 1 ? 0 : last_status;
+    if (argc > 1 && !to_long(argv[1], &code)) {
+        code = 2;
+    }
+    if (interactive) {
         sys_write(1, "Bye.\n", 5);
-        sys_exit(0);
-        return 0;
     }
-    if (Strcmp("pid", jobs[0].exe) == 0) {
-        Printf("%d\n", sys_getpid());
-        return 0;
+    sys_exit(code);
+}
+
+/** break [n], continue [n]: out of n loops, the last to go on. */
+static int builtin_break(int argc, char **argv) {
+    static char buf[64];    // argv[0] is our own name
+    long n = 1;
+    if (argc > 1 && (!to_long(argv[1], &n) || n < 1)) {
+        sys_write(2, buf, Sprintf(buf, "%s: bad count\n", argv[0]));
+        return 1;
+    }
+    if (loop_depth == 0) {
+        sys_write(2, buf, Sprintf(buf, "%s: only in a loop\n", argv[0]));
+        return 1;
     }
+    breaking = n < loop_depth ? n : loop_depth;
+    continuing = argv[0][0] == 'c';
+    return 0;
+}
 
-    return exec_job((job_t *)jobs, jobcnt);
+static int builtin_return(int argc, char **argv) {
+    long code = last_status;
+    if (argc > 1 && !to_long(argv[1], &code)) {
+        code = 2;
+    }
+    if (func_depth == 0) {
+        sys_write(2, "return: only in a function\n", 27);
+        return 1;
+    }
+    returning = true;
+    return code;
 }
 
-// implementation of system
-int system(const char *cmd) {
-    // end of cmd chars
-    static const char *eoc = "\n;&\0";
-    int it = 0;
-    int next = 0;
-    int ret = 0;
+static int builtin_shift(int argc, char **argv) {
+    long n = 1;
+    if ((argc > 1 && !to_long(argv[1], &n)) || n < 0 || n > nparams - 1) {
+        sys_write(2, "shift: bad count\n", 17);
+        return 1;
+    }
+    params[n] = params[0];
+    params += n;
+    nparams -= n;
+    return 0;
+}
+
+static int builtin_pid(int argc, char **argv) {
+    Printf("%d\n", sys_getpid());
+    return 0;
+}
 
-    while (cmd[it]) {
-        for (next = it; !contains(eoc, cmd[next]); next++) {}
-        ret |= system_single(cmd + it, next - it);
-        it = cmd[next] ? next + 1 : next;
+/** set -o|+o pipefail, set -o|+o zygote: programs spawned by a
+ * helper process (zygote.h). It is off by default: spawn's clone
+ * shares our memory and copies no page tables, so the helper only adds
+ * a round trip on its socket to every command. */
+static int builtin_set(int argc, char **argv) {
+    int flag = 0;
+    if (argc == 3 && (Strcmp(argv[1], "-o") == 0 || Strcmp(argv[1], "+o") == 0)) {
+        flag = Strcmp(argv[2], "pipefail") == 0 ? EXEC_PIPEFAIL :
+               Strcmp(argv[2], "zygote") == 0 ? EXEC_ZYGOTE : 0;
+    }
+    if (flag == 0) {
+        sys_write(2, "usage: set -o|+o pipefail|zygote\n", 33);
+        return 1;
+    }
+    if (argv[1][0] == '+') {
+        exec_flags &= ~flag;
+        if (flag == EXEC_ZYGOTE) {
+            zygote_stop();
+        }
+        return 0;
     }
+    if (flag == EXEC_ZYGOTE) {
+        int r = zygote_start();
+        if (r < 0) {
+            static char buf[64];
+            sys_write(2, buf, Sprintf(buf, "set: no zygote: %s\n", Strerror(r)));
+            return 1;
+        }
+    }
+    exec_flags |= flag;
+    return 0;
+}
 
+static int builtin_jobs(int argc, char **argv) {
+    jobs_reap();
+    for (int i = 0; i < MAXJOBS; i++) {
+        if (bgjobs[i].pgid != 0) {
+            job_print(i + 1, &bgjobs[i]);
+            bgjobs[i].pgid = bgjobs[i].done ? 0 : bgjobs[i].pgid;
+        }
+    }
+    return 0;
+}
+
+static int builtin_wait(int argc, char **argv) {
+    return job_wait(argv[1]);
+}
+
+/** hash: list, hash -r: forget all, hash name...: look them up. */
+static int builtin_hash(int argc, char **argv) {
+    if (argc == 1) {
+        hash_list();
+        return 0;
+    }
+    int ret = 0;
+    for (int k = 1; k < argc; k++) {
+        if (Strcmp(argv[k], "-r") == 0) {
+            hash_reset();
+        } else if (hash_lookup(argv[k]) == NULL) {
+            sys_write(2, "hash: ", 6);
+            sys_write(2, argv[k], Strlen(argv[k]));
+            sys_write(2, ": not found\n", 12);
+            ret = 1;
+        }
+    }
+    return ret;
+}
+
+/** export: list them, export name[=value]...: give them to commands. */
+static int builtin_export(int argc, char **argv) {
+    if (argc == 1) {
+        for (uint32_t i = 0; i < var_cap; i++) {
+            if (vars[i].str != NULL && vars[i].exported) {
+                Printf("export %s\n", vars[i].str);
+            }
+        }
+        return 0;
+    }
+    int ret = 0;
+    for (int k = 1; k < argc; k++) {
+        const char *a = argv[k];
+        int n = name_len(a, Strlen(a));
+        if (n == 0 || (a[n] != 0 && a[n] != '=')) {
+            sys_write(2, "export: ", 8);
+            sys_write(2, a, Strlen(a));
+            sys_write(2, ": bad variable name\n", 20);
+            ret = 1;
+            continue;
+        }
+        var_store(a, n, a[n] == '=' ? a + n + 1 : NULL, true);
+    }
+    return ret;
+}
+
+static int builtin_unset(int argc, char **argv) {
+    for (int k = 1; k < argc; k++) {
+        var_unset(argv[k]);
+    }
+    return 0;
+}
+
+/** read [-r] [name...]: a line of stdin into the names, split at
+ * blanks, the last one getting the rest; REPLY without names. Without
+ * -r a backslash quotes the next character and joins lines. A byte at
+ * a time, so what follows the line is left for whoever reads next. */
+static int builtin_read(int argc, char **argv) {
+    static char line[4096];
+    static bool lit[sizeof(line)];  // quoted: no blank to split at
+    bool raw = argc > 1 && Strcmp(argv[1], "-r") == 0;
+    char **names = argv + 1 + raw;
+    for (char **p = names; *p != NULL; p++) {
+        int n = Strlen(*p);
+        if (name_len(*p, n) != n) {
+            sys_write(2, "read: ", 6);
+            sys_write(2, *p, n);
+            sys_write(2, ": bad variable name\n", 20);
+            return 2;
+        }
+    }
+
+    int len = 0;
+    bool nl = false;
+    bool esc = false;
+    for (;;) {
+        char c;
+        long r = sys_read(0, &c, 1);
+        if (r == -EINTR) {
+            continue;
+        }
+        if (r != 1) {
+            break;
+        }
+        bool quoted = esc;
+        esc = false;
+        if (quoted && c == '\n') {
+            continue;
+        }
+        if (!quoted && !raw && c == '\\') {
+            esc = true;
+            continue;
+        }
+        if (!quoted && c == '\n') {
+            nl = true;
+            break;
+        }
+        if (len < (int)sizeof(line) - 1) {
+            lit[len] = quoted;
+            line[len++] = c;
+        }
+    }
+    line[len] = 0;
+    if (*names == NULL) {
+        var_set("REPLY", line);
+        return nl ? 0 : 1;
+    }
+
+#define SPLIT(i) (!lit[i] && char_class[(uint8_t)line[i]] == CH_BLANK)
+    int i = 0;
+    for (; *names != NULL; names++) {
+        while (i < len && SPLIT(i)) {
+            i++;
+        }
+        int start = i;
+        if (names[1] == NULL) {
+            i = len;
+            while (i > start && SPLIT(i - 1)) {
+                i--;
+            }
+        } else {
+            while (i < len && !SPLIT(i)) {
+                i++;
+            }
+        }
+        char c = line[i];
+        line[i] = 0;
+        var_set(*names, line + start);
+        line[i] = c;
+    }
+#undef SPLIT
+    return nl ? 0 : 1;
+}
+
+/** Commands run by the shell itself. Alone in the foreground they run
+ * in-process; in a pipeline or the background, in a fork. */
+static const struct builtin {
+    const char *name;
+    int (*fn)(int argc, char **argv);
+} builtins[] = {
+    {"echo", builtin_echo},
+    {"test", builtin_test},
+    {"[", builtin_test},
+    {"true", builtin_true},
+    {":", builtin_true},
+    {"false", builtin_false},
+    {"printf", builtin_printf},
+    {"pwd", builtin_pwd},
+    {"cd", builtin_cd},
+    {"exit", builtin_exit},
+    {"q", builtin_exit},
+    {"pid", builtin_pid},
+    {"set", builtin_set},
+    {"jobs", builtin_jobs},
+    {"wait", builtin_wait},
+    {"hash", builtin_hash},
+    {"break", builtin_break},
+    {"continue", builtin_break},
+    {"return", builtin_return},
+    {"shift", builtin_shift},
+    {"export", builtin_export},
+    {"unset", builtin_unset},
+    {"read", builtin_read},
+};
+
+static int (*find_builtin(const char *name))(int, char **) {
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++) {
+        if (Strcmp(builtins[i].name, name) == 0) {
+            return builtins[i].fn;
+        }
+    }
+    return NULL;
+}
+
+/** Point the shell's fds 0, 1 and 2 where job's redirections say, and
+ * keep the old ones in saved for unredirect. False if a file could not
+ * be opened; unredirect is still due then. */
+static bool redirect(const job_t *job, int saved[3]) {
+    for (int fd = 0; fd < 3; fd++) {
+        saved[fd] = -1;
+    }
+    for (int i = 0; i < job->nredir; i++) {
+        int fd = job->redirs[i].fd;
+        if (saved[fd] < 0) {
+            saved[fd] = sys_fcntl(fd, F_DUPFD_CLOEXEC, 10);
+        }
+    }
+    for (int i = 0; i < job->nredir; i++) {
+        const struct redir *r = &job->redirs[i];
+        if (r->from >= 0) {
+            sys_dup2(r->from, r->fd);
+            continue;
+        }
+        int f = sys_openat_mode(AT_FDCWD, r->path, r->flags | O_CLOEXEC, 0666);
+        if (f < 0) {
+            sys_write(2, "sh: ", 4);
+            sys_write(2, r->path, Strlen(r->path));
+            char buf[64];
+            sys_write(2, buf, Sprintf(buf, ": %s\n", Strerror(f)));
+            return false;
+        }
+        if (f == r->fd) {
+            // it was closed: the open took its place.
+            sys_fcntl(f, F_SETFD, 0);
+        } else {
+            sys_dup2(f, r->fd);
+            sys_close(f);
+        }
+    }
+    return true;
+}
+
+static void unredirect(const int saved[3]) {
+    for (int fd = 0; fd < 3; fd++) {
+        if (saved[fd] >= 0) {
+            sys_dup2(saved[fd], fd);
+            sys_close(saved[fd]);
+        }
+    }
+}
+
+/** Run a builtin in the shell, its redirections applied to the shell's
+ * own fds meanwhile. */
+static int run_builtin(job_t *job) {
+    int saved[3];
+    int ret = 1;
+    char **env = environ;
+    if (job->envp != NULL) {
+        environ = job->envp;
+    }
+    if (redirect(job, saved)) {
+        int argc = 0;
+        while (job->argv[argc] != NULL) {
+            argc++;
+        }
+        ret = job->builtin(argc, job->argv);
+    }
+    unredirect(saved);
+    if (job->envp != NULL) {
+        // the builtin may have synced another one meanwhile: sync again.
+        environ = env;
+        env_dirty = true;
+    }
+    return ret;
+}
+
+/* ---- lexer ---- */
+
+enum {
+    TOK_EOF,
+    TOK_WORD,
+    TOK_NL,
+    TOK_SEMI,       // ;
+    TOK_AMP,        // &
+    TOK_AND,        // &&
+    TOK_OR,         // ||
+    TOK_PIPE,       // |
+    TOK_IN,         // <, the first redirection
+    TOK_OUT,        // >
+    TOK_APPEND,     // >>
+    TOK_ERR,        // 2>
+    TOK_ERR_APPEND, // 2>>
+    TOK_ERR_OUT,    // 2>&1
+    TOK_OUT_ERR,    // >&2
+    TOK_DOC,        // << or <<-
+    TOK_STRING,     // <<<, the last redirection
+    TOK_PROC_IN,    // <(
+    TOK_PROC_OUT,   // >(
+    TOK_LPAREN,
+    TOK_RPAREN,
+};
+
+static bool is_redir(int kind) {
+    return kind >= TOK_IN && kind <= TOK_STRING;
+}
+
+/** A token is a slice of the source, not a copy. */
+struct token {
+    const char *p;
+    int len;
+    int kind;
+    bool quoted;    // has quotes or backslashes
+    bool dollar;    // has a $ outside single quotes
+};
+
+/** The parser: one token of lookahead over the whole source. */
+#define MAXDOCS 8
+#define MAXREDIRS 8     // output redirections of a command
+
+struct parser {
+    const char *src;
+    int len;
+    int pos;            // just after tok
+    struct token tok;
+    struct token bad;   // where the first error was
+    bool error;
+    bool more;          // the source ended inside a command
+    bool defined;       // a function was defined: keep the tree
+    struct doc {
+        struct word *w; // its delimiter until the text is read
+        bool strip;     // <<-: leading tabs go
+        bool quoted;    // a quoted delimiter: the text is not expanded
+    } docs[MAXDOCS];    // here-documents whose text is on the next lines
+    int ndocs;
+};
+
+/** The end of the word starting at i, quotes skipped as a whole. */
+static int scan_word(struct parser *ps, int i) {
+    const char *s = ps->src;
+    int end = ps->len;
+    struct token *t = &ps->tok;
+    while (i < end) {
+        uint8_t c = char_class[(uint8_t)s[i]];
+        if (c == CH_BLANK || c == CH_OP) {
+            break;
+        }
+        if (c != CH_QUOTE) {
+            t->dollar |= s[i] == '$';
+            i++;
+            continue;
+        }
+        t->quoted = true;
+        if (s[i] == '\\') {
+            i += 2;
+            continue;
+        }
+        char q = s[i++];
+        while (i < end && s[i] != q) {
+            t->dollar |= q == '"' && s[i] == '$';
+            i += q == '"' && s[i] == '\\' ? 2 : 1;
+        }
+        if (i >= end) {
+            ps->more = true;    // no closing quote yet
+            return end;
+        }
+        i++;
+    }
+    return i < end ? i : end;
+}
+
+/** Move to the next token. */
+static void read_docs(struct parser *ps);
+
+static void next(struct parser *ps) {
+    const char *s = ps->src;
+    int end = ps->len;
+    int i = ps->pos;
+    for (;;) {
+        while (i < end && char_class[(uint8_t)s[i]] == CH_BLANK) {
+            i++;
+        }
+        if (i + 1 < end && s[i] == '\\' && s[i + 1] == '\n') {
+            i += 2;             // a line goes on
+        } else if (i < end && s[i] == '#') {
+            while (i < end && s[i] != '\n') {
+                i++;
+            }
+        } else {
+            break;
+        }
+    }
+
+    struct token *t = &ps->tok;
+    *t = (struct token){.p = s + i, .len = 1};
+    if (i == end) {
+        t->kind = TOK_EOF;
+        t->len = 0;
+        ps->pos = i;
+        ps->more |= ps->ndocs > 0;      // a here-document to come
+        return;
+    }
+    bool twice = i + 1 < end && s[i + 1] == s[i];
+    switch (s[i]) {
+    case '\n':
+        t->kind = TOK_NL;
+        break;
+    case ';':
+        t->kind = TOK_SEMI;
+        break;
+    case '&':
+        t->kind = twice ? TOK_AND : TOK_AMP;
+        t->len += twice;
+        break;
+    case '|':
+        t->kind = twice ? TOK_OR : TOK_PIPE;
+        t->len += twice;
+        break;
+    case '<':
+        t->kind = TOK_IN;
+        if (i + 1 < end && s[i + 1] == '(') {
+            t->kind = TOK_PROC_IN;
+            t->len = 2;
+        } else if (twice) {
+            bool third = i + 2 < end && (s[i + 2] == '<' || s[i + 2] == '-');
+            t->kind = third && s[i + 2] == '<' ? TOK_STRING : TOK_DOC;
+            t->len = 2 + third;
+        }
+        break;
+    case '>':
+        t->kind = TOK_OUT;
+        if (i + 1 < end && s[i + 1] == '(') {
+            t->kind = TOK_PROC_OUT;
+            t->len = 2;
+        } else if (twice) {
+            t->kind = TOK_APPEND;
+            t->len = 2;
+        } else if (i + 2 < end && s[i + 1] == '&' && s[i + 2] == '2') {
+            t->kind = TOK_OUT_ERR;
+            t->len = 3;
+        }
+        break;
+    case '(':
+        t->kind = TOK_LPAREN;
+        break;
+    case ')':
+        t->kind = TOK_RPAREN;
+        break;
+    default:
+        t->kind = TOK_WORD;
+        t->len = scan_word(ps, i) - i;
+        // 2> is a word 2 right before the >.
+        if (t->len == 1 && s[i] == '2' && i + 1 < end && s[i + 1] == '>') {
+            t->kind = TOK_ERR;
+            t->len = 2;
+            if (i + 2 < end && s[i + 2] == '>') {
+                t->kind = TOK_ERR_APPEND;
+                t->len = 3;
+            } else if (i + 3 < end && s[i + 2] == '&' && s[i + 3] == '1') {
+                t->kind = TOK_ERR_OUT;
+                t->len = 4;
+            }
+        }
+        break;
+    }
+    ps->pos = i + t->len;
+    if (t->kind == TOK_NL && ps->ndocs > 0) {
+        read_docs(ps);
+    }
+}
+
+/* ---- the tree ---- */
+
+enum {
+    N_PIPELINE,     // stages
+    N_AND,          // a && b
+    N_OR,           // a || b
+    N_NOT,          // ! a
+    N_IF,           // if a; then b; else c; fi
+    N_WHILE,        // while a; do b; done
+    N_UNTIL,
+    N_FOR,          // for name in words; do a; done
+    N_FUNC,         // name() a
+    N_GROUP,        // { a; }
+    N_SUBSHELL,     // ( a )
+};
+
+/** A word as parsed: text if it is the same every time, otherwise
+ * expanded from raw each time it is run. */
+struct word {
+    struct word *next;
+    const char *raw;
+    int len;
+    const char *text;
+    bool split;         // an unquoted expansion: cut at blanks
+    bool glob;          // may be a pattern: replaced by the paths it matches
+    const char *pattern;    // what glob_expand gets, if the same every time
+    bool all;           // "$@": a word per parameter
+    bool doc;           // here-document text: quotes are no quotes
+    struct node *proc;  // <(list) or >(list): a /proc/self/fd path
+    bool proc_out;      // >(list)
+};
+
+/** An output redirection of a stage. */
+struct out_redir {
+    struct out_redir *next;
+    int fd;             // 1 or 2
+    int from;           // 2>&1 and >&2: the fd copied, else -1
+    struct word *w;     // the file otherwise
+    bool append;
+};
+
+/** One command of a pipeline. */
+struct stage {
+    struct stage *next;
+    struct word *words;
+    int nword;
+    struct word *assigns;   // name=value in front of the words
+    int nassign;
+    struct word *in;    // the last input redirection wins
+    int in_kind;
+    struct out_redir *outs; // in the order written, 2>&1 >f unlike >f 2>&1
+    int nout;
+    struct node *compound;  // run in a fork instead of words
+};
+
+/** What stage.in is. */
+enum {
+    IN_FILE,
+    IN_DOC,             // <<: the text itself
+    IN_STRING,          // <<<: the text, and a newline
+};
+
+struct node {
+    int kind;
+    bool bg;            // ended by &
+    bool timed;         // N_PIPELINE after time
+    struct node *next;  // the next command of its list
+    struct node *a, *b, *c;
+    struct stage *stages;
+    int nstage;
+    const char *name;
+    struct word *words;
+    bool params;        // N_FOR without in: over the parameters
+    struct stage *redir;    // a compound command's redirections
+    const char *text;   // the source of the command, for jobs
+    int len;
+};
+
+/** The parameter named at s (just after the $): its value, and in
+ * *used how much of s the name took; NULL for $@ and $*. */
+static const char *param(const char *s, int len, int *used) {
+    static char num[24];
+    *used = 1;
+    if (len == 0) {
+        return "$";
+    }
+    switch (*s) {
+    case '?':
+        Sprintf(num, "%d", last_status);
+        return num;
+    case '#':
+        Sprintf(num, "%d", nparams - 1);
+        return num;
+    case '$':
+        Sprintf(num, "%d", sys_getpid());
+        return num;
+    case '@':
+    case '*':
+        return NULL;
+    }
+    if (*s >= '0' && *s <= '9') {
+        return *s - '0' < nparams ? params[*s - '0'] : "";
+    }
+    int start = 0;
+    int n = 0;
+    if (*s == '{') {
+        start = 1;
+        while (start + n < len && s[start + n] != '}') {
+            n++;
+        }
+        *used = start + n + (start + n < len);
+    } else {
+        while (n < len && name_char(s[n], n == 0)) {
+            n++;
+        }
+        *used = n;
+    }
+    if (n == 0) {
+        *used = 0;
+        return "$";
+    }
+    const char *v = var_get(s + start, n);
+    return v != NULL ? v : "";
+}
+
+/** How expand_into takes quotes. */
+enum {
+    EXP_WORD,           // removed
+    EXP_DOC,            // plain characters: here-document text
+    EXP_GLOB,           // removed, what they quote escaped for glob_expand
+};
+
+static bool glob_char(char c) {
+    return c == '*' || c == '?' || c == '[' || c == '\\';
+}
+
+/** Expand s[0, len) into dst, if not NULL: quotes taken as mode says,
+ * parameters replaced. Returns the length, which a NULL dst only
+ * measures. */
+static size_t expand_into(const char *s, int len, char *dst, int mode) {
+#define PUT(ch) do { if (dst != NULL) dst[n] = (ch); n++; } while (0)
+#define QUOTED(ch) do { if (mode == EXP_GLOB && glob_char(ch)) PUT('\\'); PUT(ch); } while (0)
+    size_t n = 0;
+    bool dq = false;
+    bool doc = mode == EXP_DOC;
+    for (int i = 0; i < len; i++) {
+        char c = s[i];
+        if (c == '\'' && !dq && !doc) {
+            while (++i < len && s[i] != '\'') {
+                QUOTED(s[i]);
+            }
+        } else if (c == '"' && !doc) {
+            dq = !dq;
+        } else if (c == '\\' && i + 1 < len) {
+            char d = s[++i];
+            if (d == '\n') {
+                continue;
+            }
+            if ((dq || doc) && d != '$' && (d != '"' || doc) && d != '\\' && d != '`') {
+                QUOTED('\\');
+            }
+            QUOTED(d);
+        } else if (c == '$') {
+            int used;
+            const char *v = param(s + i + 1, len - i - 1, &used);
+            for (int k = 1; v == NULL && k < nparams; k++) {
+                for (const char *p = params[k]; *p; p++) {
+                    if (dq || *p == '\\') {
+                        QUOTED(*p);
+                    } else {
+                        PUT(*p);
+                    }
+                }
+                if (k + 1 < nparams) {
+                    PUT(' ');
+                }
+            }
+            for (; v != NULL && *v; v++) {
+                if (dq || *v == '\\') {
+                    QUOTED(*v);
+                } else {
+                    PUT(*v);
+                }
+            }
+            i += used;
+        } else if (dq) {
+            QUOTED(c);
+        } else {
+            PUT(c);
+        }
+    }
+    if (dst != NULL) {
+        dst[n] = 0;
+    }
+    return n;
+#undef QUOTED
+#undef PUT
+}
+
+/** raw[0, len) expanded, in the line arena; NULL if out of room. */
+static char *expand(const char *raw, int len, int mode) {
+    size_t n = expand_into(raw, len, NULL, mode);
+    char *s = arena_alloc(&line_arena, n + 1);
+    if (s != NULL) {
+        expand_into(raw, len, s, mode);
+    }
+    return s;
+}
+
+static char *proc_subst(const struct word *w);
+
+/** What w stands for, as one string: NULL if out of memory. */
+static char *word_value(const struct word *w) {
+    if (w->proc != NULL) {
+        return proc_subst(w);
+    }
+    return w->text != NULL ? (char *)w->text : expand(w->raw, w->len, w->doc ? EXP_DOC : EXP_WORD);
+}
+
+/** A growing argv in the line arena, which keeps what it outgrew. */
+struct args {
+    char **v;
+    int n;
+    int cap;
+};
+
+static bool args_push(struct args *a, char *s) {
+    if (a->n == a->cap) {
+        int cap = a->cap ? 2 * a->cap : 16;
+        char **v = arena_alloc(&line_arena, cap * sizeof(char *));
+        if (v == NULL) {
+            return false;
+        }
+        a->v = Memcpy(v, a->v, a->n * sizeof(char *));
+        a->cap = cap;
+    }
+    a->v[a->n++] = s;
+    return true;
+}
+
+/** Push the paths pattern matches; if none, literal, or pattern with
+ * its escapes taken out, which it then may be. */
+static bool args_glob(struct args *a, char *pattern, const char *literal) {
+    size_t n = 0;
+    char **paths = glob_magic(pattern) ? glob_expand(pattern, &line_arena, &n) : NULL;
+    for (size_t i = 0; i < n; i++) {
+        if (!args_push(a, paths[i])) {
+            return false;
+        }
+    }
+    if (n > 0) {
+        return true;
+    }
+    if (literal != NULL) {
+        return args_push(a, (char *)literal);
+    }
+    char *d = pattern;
+    for (const char *p = pattern; *p; p++) {
+        p += *p == '\\' && p[1] != 0;
+        *d++ = *p;
+    }
+    *d = 0;
+    return args_push(a, pattern);
+}
+
+/** The words expanded into an argv: $@ and unquoted expansions make
+ * fields, and patterns the paths they match. *count, if not NULL,
+ * gets the number of fields. */
+static char **expand_words(const struct word *words, int *count) {
+    struct args a = {0};
+    // the listings of the last command line may be out of date.
+    glob_forget();
+    for (const struct word *w = words; w != NULL; w = w->next) {
+        bool ok = true;
+        if (w->all) {
+            for (int p = 1; p < nparams && ok; p++) {
+                ok = args_push(&a, params[p]);
+            }
+        } else if (!w->glob) {
+            char *s = word_value(w);
+            ok = s != NULL && args_push(&a, s);
+        } else if (w->pattern != NULL) {
+            ok = args_glob(&a, (char *)w->pattern, w->text);
+        } else {
+            char *s = expand(w->raw, w->len, EXP_GLOB);
+            if (s == NULL) {
+                return NULL;
+            }
+            if (!w->split) {
+                ok = args_glob(&a, s, NULL);
+            }
+            // cut the expansion, which is ours, at its blanks.
+            for (char *p = s; w->split && ok && *p; ) {
+                char *field = p;
+                while (*p && *p != ' ' && *p != '\t' && *p != '\n') {
+                    p++;
+                }
+                bool more = *p != 0;
+                *p = 0;
+                ok = p == field || args_glob(&a, field, NULL);
+                p += more;
+            }
+        }
+        if (!ok) {
+            return NULL;
+        }
+    }
+    if (!args_push(&a, NULL)) {
+        return NULL;
+    }
+    if (count != NULL) {
+        *count = a.n - 1;
+    }
+    return a.v;
+}
+
+/* ---- parser ---- */
+
+/** Zeroed memory for the tree. Out of room, the parse fails, and gets
+ * scratch memory meanwhile so it need not check. */
+static void *palloc(struct parser *ps, size_t size) {
+    static uint64_t scratch[16];
+    void *p = arena_alloc(&line_arena, size);
+    if (p == NULL) {
+        ps->error = true;
+        p = scratch;
+        size = sizeof(scratch);
+    }
+    Memset(p, 0, size);
+    return p;
+}
+
+static struct node *new_node(struct parser *ps, int kind) {
+    struct node *n = palloc(ps, sizeof(*n));
+    n->kind = kind;
+    return n;
+}
+
+static void fail(struct parser *ps) {
+    if (!ps->error) {
+        ps->error = true;
+        ps->bad = ps->tok;
+        ps->more = ps->tok.kind == TOK_EOF;
+    }
+}
+
+/** Is the next token the reserved word w? Quoted, it is not. */
+static bool is_word(const struct parser *ps, const char *w) {
+    const struct token *t = &ps->tok;
+    return t->kind == TOK_WORD && !t->quoted && Strlen(w) == (size_t)t->len &&
+           Memcmp(t->p, w, t->len) == 0;
+}
+
+static bool accept(struct parser *ps, const char *w) {
+    if (is_word(ps, w)) {
+        next(ps);
+        return true;
+    }
+    return false;
+}
+
+static void expect(struct parser *ps, const char *w) {
+    if (!accept(ps, w)) {
+        fail(ps);
+    }
+}
+
+static void skip_newlines(struct parser *ps) {
+    while (ps->tok.kind == TOK_NL) {
+        next(ps);
+    }
+}
+
+/** The word token as a struct word, its text made once if it can be. */
+/** Has s[0, len) a '*', '?' or '[' outside quotes? */
+static bool unquoted_glob(const char *s, int len) {
+    char q = 0;
+    for (int i = 0; i < len; i++) {
+        if (s[i] == '\\' && q != '\'') {
+            i++;
+        } else if (q != 0) {
+            q = s[i] == q ? 0 : q;
+        } else if (s[i] == '\'' || s[i] == '"') {
+            q = s[i];
+        } else if (s[i] == '*' || s[i] == '?' || s[i] == '[') {
+            return true;
+        }
+    }
+    return false;
+}
+
+static struct word *make_word(struct parser *ps) {
+    const struct token *t = &ps->tok;
+    struct word *w = palloc(ps, sizeof(*w));
+    w->raw = t->p;
+    w->len = t->len;
+    w->split = t->dollar && !t->quoted;
+    w->glob = w->split || unquoted_glob(t->p, t->len);
+    w->all = t->len == 4 && Memcmp(t->p, "\"$@\"", 4) == 0;
+    if (!t->dollar) {
+        char *s = palloc(ps, expand_into(t->p, t->len, NULL, EXP_WORD) + 1);
+        expand_into(t->p, t->len, s, EXP_WORD);
+        w->text = s;
+    }
+    if (!t->dollar && w->glob) {
+        char *pat = palloc(ps, expand_into(t->p, t->len, NULL, EXP_GLOB) + 1);
+        expand_into(t->p, t->len, pat, EXP_GLOB);
+        w->pattern = pat;
+        w->glob = glob_magic(pat);
+    }
+    return w;
+}
+
+static struct node *parse_list(struct parser *ps);
+static struct node *parse_command(struct parser *ps);
+static struct node *parse_compound(struct parser *ps);
+
+/** A word, or <(list) or >(list) in its place; NULL if there is none. */
+static struct word *parse_word(struct parser *ps) {
+    int kind = ps->tok.kind;
+    if (kind == TOK_WORD) {
+        struct word *w = make_word(ps);
+        next(ps);
+        return w;
+    }
+    if (kind != TOK_PROC_IN && kind != TOK_PROC_OUT) {
+        fail(ps);
+        return NULL;
+    }
+    struct word *w = palloc(ps, sizeof(*w));
+    w->raw = ps->tok.p;
+    w->len = ps->tok.len;
+    w->proc_out = kind == TOK_PROC_OUT;
+    next(ps);
+    w->proc = parse_list(ps);
+    if (ps->tok.kind != TOK_RPAREN) {
+        fail(ps);
+    }
+    next(ps);
+    return w;
+}
+
+/** Append an output redirection to st's. */
+static struct out_redir *add_out(struct parser *ps, struct stage *st, int fd, int from) {
+    if (st->nout == MAXREDIRS) {
+        fail(ps);
+        return NULL;
+    }
+    struct out_redir **tail = &st->outs;
+    while (*tail != NULL) {
+        tail = &(*tail)->next;
+    }
+    struct out_redir *o = palloc(ps, sizeof(*o));
+    o->fd = fd;
+    o->from = from;
+    *tail = o;
+    st->nout++;
+    return o;
+}
+
+/** One redirection into st: the last input one wins, the output ones
+ * add up. False on a syntax error. */
+static bool parse_redir(struct parser *ps, struct stage *st) {
+    int kind = ps->tok.kind;
+    bool strip = kind == TOK_DOC && ps->tok.len == 3;
+    next(ps);
+    switch (kind) {
+    case TOK_ERR_OUT:
+        return add_out(ps, st, 2, 1) != NULL;
+    case TOK_OUT_ERR:
+        return add_out(ps, st, 1, 2) != NULL;
+    case TOK_DOC:
+        if (ps->tok.kind != TOK_WORD || ps->ndocs == MAXDOCS) {
+            fail(ps);
+            return false;
+        }
+        // the text comes after the next newline, which next() finds;
+        // until then the word has the delimiter.
+        st->in = make_word(ps);
+        if (st->in->text != NULL) {
+            st->in->raw = st->in->text;     // unquoted
+            st->in->len = Strlen(st->in->text);
+        }
+        st->in_kind = IN_DOC;
+        ps->docs[ps->ndocs++] = (struct doc){st->in, strip, ps->tok.quoted};
+        next(ps);
+        return !ps->error;
+    }
+    struct word *w = parse_word(ps);
+    if (w == NULL) {
+        return false;
+    }
+    if (kind == TOK_IN || kind == TOK_STRING) {
+        st->in = w;
+        st->in_kind = kind == TOK_IN ? IN_FILE : IN_STRING;
+        return !ps->error;
+    }
+    bool out = kind == TOK_OUT || kind == TOK_APPEND;
+    struct out_redir *o = add_out(ps, st, out ? 1 : 2, -1);
+    if (o == NULL) {
+        return false;
+    }
+    o->w = w;
+    o->append = kind == TOK_APPEND || kind == TOK_ERR_APPEND;
+    return !ps->error;
+}
+
+/** The end of the line at i, its newline excluded. */
+static int line_end(const struct parser *ps, int i) {
+    while (i < ps->len && ps->src[i] != '\n') {
+        i++;
+    }
+    return i;
+}
+
+/** After the newline of a line with <<: the text of its here-documents,
+ * each up to a line with only its delimiter. Where the source ends
+ * first, it is unfinished. */
+static void read_docs(struct parser *ps) {
+    const char *s = ps->src;
+    for (int k = 0; k < ps->ndocs; k++) {
+        const struct doc *d = &ps->docs[k];
+        struct word *w = d->w;
+        // find the delimiter, and how long the text is without tabs.
+        int i = ps->pos;
+        int size = 0;
+        for (;;) {
+            if (i >= ps->len) {
+                ps->more = true;
+                ps->pos = ps->len;
+                ps->ndocs = 0;
+                return;
+            }
+            int b = i;
+            int e = line_end(ps, i);
+            while (d->strip && b < e && s[b] == '\t') {
+                b++;
+            }
+            if (e - b == w->len && Memcmp(s + b, w->raw, w->len) == 0) {
+                break;
+            }
+            size += e - b + 1;
+            i = e + 1;
+        }
+        char *text = palloc(ps, size + 1);
+        int n = 0;
+        for (i = ps->pos; n < size; ) {
+            int b = i;
+            int e = line_end(ps, i);
+            while (d->strip && b < e && s[b] == '\t') {
+                b++;
+            }
+            Memcpy(text + n, s + b, e - b);
+            n += e - b;
+            text[n++] = '\n';
+            i = e + 1;
+        }
+        text[n] = 0;
+        ps->pos = line_end(ps, i) + 1;
+        ps->pos = ps->pos < ps->len ? ps->pos : ps->len;
+
+        w->raw = text;
+        w->len = n;
+        w->doc = true;
+        bool plain = d->quoted || (Memchr(text, '$', n) == NULL && Memchr(text, '\\', n) == NULL);
+        w->text = plain ? text : NULL;
+    }
+    ps->ndocs = 0;
+}
+
+/** Where a list ends: at the word closing what it is in. */
+static bool at_list_end(const struct parser *ps) {
+    static const char *const ends[] = {"then", "elif", "else", "fi", "do", "done", "}"};
+    if (ps->tok.kind == TOK_EOF || ps->tok.kind == TOK_RPAREN) {
+        return true;
+    }
+    for (size_t i = 0; i < sizeof(ends) / sizeof(ends[0]); i++) {
+        if (is_word(ps, ends[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/** name=value, the name unquoted. */
+static bool is_assignment(const struct token *t) {
+    int n = name_len(t->p, t->len);
+    return n > 0 && n < t->len && t->p[n] == '=';
+}
+
+/** Does a compound command start here? */
+static bool at_compound(const struct parser *ps) {
+    return ps->tok.kind == TOK_LPAREN || is_word(ps, "{") || is_word(ps, "if") ||
+           is_word(ps, "while") || is_word(ps, "until") || is_word(ps, "for");
+}
+
+/** The compound command c as the stage st, its redirections st's. */
+static void compound_stage(struct stage *st, struct node *c) {
+    if (c->redir != NULL) {
+        *st = *c->redir;
+        c->redir = NULL;
+    }
+    st->compound = c;
+}
+
+/** A pipeline, with time in front maybe; first, if not NULL, is its
+ * first stage, a compound command already parsed. Each stage is a
+ * simple command or a compound one with its redirections. */
+static struct node *parse_simple(struct parser *ps, struct node *first) {
+    struct node *n = new_node(ps, N_PIPELINE);
+    struct stage **st_tail = &n->stages;
+    for (;;) {
+        struct stage *st = palloc(ps, sizeof(*st));
+        struct word **w_tail = &st->words;
+        struct word **a_tail = &st->assigns;
+        bool redirected = false;
+        if (first != NULL) {
+            compound_stage(st, first);
+            first = NULL;
+        }
+        for (;;) {
+            int kind = ps->tok.kind;
+            bool simple = st->compound == NULL;
+            if (simple && st->nword == 0 && st->nassign == 0 && !redirected && at_compound(ps)) {
+                compound_stage(st, parse_compound(ps));
+                if (ps->error) {
+                    return n;
+                }
+            } else if (kind == TOK_WORD && simple) {
+                if (n->nstage == 0 && st->nword == 0 && !n->timed && is_word(ps, "time")) {
+                    n->timed = true;
+                } else if (st->nword == 0 && is_assignment(&ps->tok)) {
+                    *a_tail = make_word(ps);
+                    (*a_tail)->split = false;
+                    a_tail = &(*a_tail)->next;
+                    st->nassign++;
+                } else {
+                    *w_tail = make_word(ps);
+                    w_tail = &(*w_tail)->next;
+                    st->nword++;
+                }
+                next(ps);
+            } else if ((kind == TOK_PROC_IN || kind == TOK_PROC_OUT) && simple) {
+                *w_tail = parse_word(ps);
+                w_tail = &(*w_tail)->next;
+                st->nword++;
+            } else if (is_redir(kind)) {
+                if (!parse_redir(ps, st)) {
+                    return n;
+                }
+                redirected = true;
+            } else {
+                break;
+            }
+        }
+        if (st->compound == NULL && st->nword == 0 && st->nassign == 0 && !redirected &&
+            !(n->timed && n->nstage == 0)) {
+            fail(ps);
+            return n;
+        }
+        *st_tail = st;
+        st_tail = &st->next;
+        n->nstage++;
+        if (ps->tok.kind != TOK_PIPE) {
+            return n;
+        }
+        next(ps);
+        skip_newlines(ps);
+    }
+}
+
+/** After if: the rest of it, with its elifs as ifs in else. */
+static struct node *parse_if(struct parser *ps) {
+    struct node *n = new_node(ps, N_IF);
+    n->a = parse_list(ps);
+    expect(ps, "then");
+    n->b = parse_list(ps);
+    if (accept(ps, "elif")) {
+        n->c = parse_if(ps);
+        return n;
+    }
+    if (accept(ps, "else")) {
+        n->c = parse_list(ps);
+    }
+    expect(ps, "fi");
+    return n;
+}
+
+/** do list done */
+static struct node *parse_body(struct parser *ps) {
+    expect(ps, "do");
+    struct node *body = parse_list(ps);
+    expect(ps, "done");
+    return body;
+}
+
+static struct node *parse_for(struct parser *ps) {
+    struct node *n = new_node(ps, N_FOR);
+    if (ps->tok.kind != TOK_WORD || ps->tok.quoted || ps->tok.dollar) {
+        fail(ps);
+        return n;
+    }
+    n->name = make_word(ps)->text;
+    next(ps);
+    skip_newlines(ps);
+    if (accept(ps, "in")) {
+        struct word **tail = &n->words;
+        while (ps->tok.kind == TOK_WORD) {
+            *tail = make_word(ps);
+            tail = &(*tail)->next;
+            next(ps);
+        }
+        if (ps->tok.kind != TOK_SEMI && ps->tok.kind != TOK_NL) {
+            fail(ps);
+            return n;
+        }
+        next(ps);
+    } else {
+        n->params = true;
+        if (ps->tok.kind == TOK_SEMI) {
+            next(ps);
+        }
+    }
+    skip_newlines(ps);
+    n->a = parse_body(ps);
+    return n;
+}
+
+/** Redirections after a compound command, if any. */
+static struct node *parse_redirs(struct parser *ps, struct node *n) {
+    while (!ps->error && is_redir(ps->tok.kind)) {
+        if (n->redir == NULL) {
+            n->redir = palloc(ps, sizeof(*n->redir));
+        }
+        parse_redir(ps, n->redir);
+    }
+    return n;
+}
+
+static struct node *parse_compound(struct parser *ps) {
+    struct node *n;
+    if (accept(ps, "if")) {
+        return parse_if(ps);
+    }
+    if (is_word(ps, "while") || is_word(ps, "until")) {
+        n = new_node(ps, is_word(ps, "while") ? N_WHILE : N_UNTIL);
+        next(ps);
+        n->a = parse_list(ps);
+        n->b = parse_body(ps);
+        return n;
+    }
+    if (accept(ps, "for")) {
+        return parse_for(ps);
+    }
+    if (accept(ps, "{")) {
+        n = new_node(ps, N_GROUP);
+        n->a = parse_list(ps);
+        expect(ps, "}");
+        return n;
+    }
+    if (ps->tok.kind == TOK_LPAREN) {
+        next(ps);
+        n = new_node(ps, N_SUBSHELL);
+        n->a = parse_list(ps);
+        if (ps->tok.kind != TOK_RPAREN) {
+            fail(ps);
+        }
+        next(ps);
+        return n;
+    }
+    if (ps->tok.kind == TOK_WORD && !ps->tok.quoted && !ps->tok.dollar) {
+        // name() command defines a function.
+        struct parser save = *ps;
+        next(ps);
+        if (ps->tok.kind == TOK_LPAREN) {
+            next(ps);
+            if (ps->tok.kind != TOK_RPAREN) {
+                fail(ps);
+                return new_node(ps, N_FUNC);
+            }
+            next(ps);
+            skip_newlines(ps);
+            n = new_node(ps, N_FUNC);
+            n->name = make_word(&save)->text;
+            n->a = parse_command(ps);
+            ps->defined = true;
+            return n;
+        }
+        *ps = save;
+    }
+    int k = ps->tok.kind;
+    if (k != TOK_WORD && k != TOK_PROC_IN && k != TOK_PROC_OUT && !is_redir(k)) {
+        fail(ps);
+        return new_node(ps, N_PIPELINE);
+    }
+    return parse_simple(ps, NULL);
+}
+
+static struct node *parse_command(struct parser *ps) {
+    struct node *n = parse_compound(ps);
+    return n->kind == N_PIPELINE || n->kind == N_FUNC ? n : parse_redirs(ps, n);
+}
+
+/** A command, or the pipeline it starts: a compound command alone runs
+ * in the shell, piped in a fork like every stage. */
+static struct node *parse_piped(struct parser *ps) {
+    struct node *n = parse_command(ps);
+    bool compound = n->kind != N_PIPELINE && n->kind != N_FUNC;
+    return compound && ps->tok.kind == TOK_PIPE && !ps->error ? parse_simple(ps, n) : n;
+}
+
+/** A pipeline, ! in front maybe. */
+static struct node *parse_pipeline(struct parser *ps) {
+    if (accept(ps, "!")) {
+        struct node *n = new_node(ps, N_NOT);
+        n->a = parse_piped(ps);
+        return n;
+    }
+    return parse_piped(ps);
+}
+
+static struct node *parse_and_or(struct parser *ps) {
+    struct node *left = parse_pipeline(ps);
+    while (!ps->error && (ps->tok.kind == TOK_AND || ps->tok.kind == TOK_OR)) {
+        struct node *n = new_node(ps, ps->tok.kind == TOK_AND ? N_AND : N_OR);
+        next(ps);
+        skip_newlines(ps);
+        n->a = left;
+        n->b = parse_pipeline(ps);
+        left = n;
+    }
+    return left;
+}
+
+/** Commands separated by ; & or newlines, up to what closes the list. */
+static struct node *parse_list(struct parser *ps) {
+    struct node *head = NULL;
+    struct node **tail = &head;
+    for (;;) {
+        while (ps->tok.kind == TOK_NL || ps->tok.kind == TOK_SEMI) {
+            next(ps);
+        }
+        if (ps->error || at_list_end(ps)) {
+            return head;
+        }
+        const char *start = ps->tok.p;
+        struct node *n = parse_and_or(ps);
+        if (ps->error) {
+            return head;
+        }
+        n->text = start;
+        n->len = ps->tok.p - start;
+        if (ps->tok.kind == TOK_AMP) {
+            n->bg = true;
+            next(ps);
+        } else if (ps->tok.kind == TOK_SEMI || ps->tok.kind == TOK_NL) {
+            next(ps);
+        } else if (!at_list_end(ps)) {
+            fail(ps);
+        }
+        *tail = n;
+        tail = &n->next;
+    }
+}
+
+static void report_syntax(const struct parser *ps) {
+    static char buf[128];
+    char near[33];
+    int n = ps->bad.len < 32 ? ps->bad.len : 32;
+    Memcpy(near, ps->bad.p, n);
+    near[n] = 0;
+    unsigned len;
+    if (ps->bad.kind == TOK_EOF) {
+        len = Sprintf(buf, "sh: syntax error: unexpected end of input\n");
+    } else {
+        len = Sprintf(buf, "sh: syntax error near `%s'\n",
+                      ps->bad.kind == TOK_NL ? "newline" : near);
+    }
+    sys_write(2, buf, len);
+}
+
+/* ---- execution ---- */
+
+static int run_list(const struct node *n);
+static int run_node(const struct node *n);
+
+/** After a loop body: whether the loop goes on. */
+static bool loop_next(void) {
+    if (breaking == 0) {
+        return true;
+    }
+    breaking--;
+    if (breaking == 0 && continuing) {
+        continuing = false;
+        return true;
+    }
+    return false;
+}
+
+#define MAXFUNCS 64
+
+static struct func {
+    const char *name;
+    const struct node *body;
+} funcs[MAXFUNCS];
+static int nfuncs;
+
+static const struct func *func_find(const char *name) {
+    for (int i = 0; i < nfuncs; i++) {
+        if (Strcmp(funcs[i].name, name) == 0) {
+            return &funcs[i];
+        }
+    }
+    return NULL;
+}
+
+static int func_define(const char *name, const struct node *body) {
+    int i = 0;
+    while (i < nfuncs && Strcmp(funcs[i].name, name) != 0) {
+        i++;
+    }
+    if (i == MAXFUNCS) {
+        sys_write(2, "sh: too many functions\n", 23);
+        return 1;
+    }
+    nfuncs += i == nfuncs;
+    funcs[i] = (struct func){name, body};
+    return 0;
+}
+
+/** A function called like a builtin: argv are its parameters, $0 aside. */
+static int func_main(int argc, char **argv) {
+    const struct func *f = func_find(argv[0]);
+    char **saved = params;
+    int nsaved = nparams;
+    argv[0] = params[0];
+    params = argv;
+    nparams = argc;
+    func_depth++;
+    int ret = run_node(f->body);
+    func_depth--;
+    params = saved;
+    nparams = nsaved;
+    returning = false;
+    return ret;
+}
+
+/** What a fork runs for ( list ), a compound command in the background
+ * or in a pipeline, or a process substitution: the list comes after the
+ * argv the fork gets, so that each of a pipeline's finds its own. */
+struct subshell {
+    char *argv[2];
+    const struct node *list;
+};
+
+static int subshell_main(int argc, char **argv) {
+    return run_list(((const struct subshell *)argv)->list);
+}
+
+/** Run n, which must have no next, in a fork like a one-stage pipeline. */
+static int run_subshell(const struct node *n, bool bg) {
+    struct subshell sub = {{"sh", NULL}, n};
+    job_t job = {.exe = sub.argv[0], .argv = sub.argv, .builtin = subshell_main};
+    if (bg) {
+        return job_start(&job, 1, exec_flags, n->text, n->len);
+    }
+    return exec_job(&job, 1, exec_flags, NULL);
+}
+
+/** Start w's list with a pipe as its stdout, or its stdin for >(list);
+ * the command gets the other end as a path. */
+static char *proc_subst(const struct word *w) {
+    int pip[2];
+    if (nprocs == MAXPROCS || sys_pipe2(pip, O_CLOEXEC) < 0) {
+        sys_write(2, "sh: cannot substitute a process\n", 32);
+        return NULL;
+    }
+    int theirs = w->proc_out ? pip[0] : pip[1];
+    int ours = w->proc_out ? pip[1] : pip[0];
+    struct spawn sp;
+    spawn_init(&sp);
+    spawn_setsigmask(&sp, 0);
+    spawn_dup2(&sp, theirs, w->proc_out ? 0 : 1);
+    struct subshell sub = {{"sh", NULL}, w->proc};
+    int pid = spawn_fork(&sp, subshell_main, sub.argv);
+    sys_close(theirs);
+    char *path = arena_alloc(&line_arena, 32);
+    if (pid < 0 || path == NULL) {
+        sys_close(ours);
+        return NULL;
+    }
+    // the command inherits it across exec, to open it by that name.
+    sys_fcntl(ours, F_SETFD, 0);
+    procs[nprocs++] = (struct proc){ours, pid};
+    Sprintf(path, "/proc/self/fd/%d", ours);
+    return path;
+}
+
+/** A here-document as a file to read: a pipe if it fits in one, so
+ * writing it cannot block, memory otherwise. -1 if neither works. */
+#define DOC_PIPE 4096
+
+static int doc_fd(const char *text, size_t len, bool nl) {
+    int pip[2];
+    if (len + nl <= DOC_PIPE && sys_pipe2(pip, O_CLOEXEC) == 0) {
+        sys_write(pip[1], text, len);
+        sys_write(pip[1], "\n", nl);
+        sys_close(pip[1]);
+        return pip[0];
+    }
+    int fd = sys_memfd_create("sh-doc", MFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    for (size_t off = 0; off < len; ) {
+        long r = sys_write(fd, text + off, len - off);
+        if (r <= 0) {
+            sys_close(fd);
+            return -1;
+        }
+        off += r;
+    }
+    sys_write(fd, "\n", nl);
+    sys_lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+/** job's redirections, from st's words. False, and told why, if one
+ * could not be expanded; job->stdin_fd is for the caller to close. */
+static bool stage_redirs(const struct stage *st, job_t *job) {
+    job->nredir = 0;
+    job->redirs = arena_alloc(&line_arena, (1 + st->nout) * sizeof(struct redir));
+    char *in = st->in ? word_value(st->in) : NULL;
+    if (job->redirs == NULL || (st->in && !in)) {
+        sys_write(2, "sh: out of memory\n", 18);
+        return false;
+    }
+    if (in != NULL && st->in_kind == IN_FILE) {
+        job->redirs[job->nredir++] = (struct redir){0, -1, in, O_RDONLY};
+    } else if (in != NULL) {
+        if ((job->stdin_fd = doc_fd(in, Strlen(in), st->in_kind == IN_STRING)) < 0) {
+            job->stdin_fd = 0;
+            sys_write(2, "sh: cannot make a here-document\n", 32);
+            return false;
+        }
+        job->redirs[job->nredir++] = (struct redir){0, job->stdin_fd, NULL, 0};
+    }
+    for (const struct out_redir *o = st->outs; o != NULL; o = o->next) {
+        struct redir *r = &job->redirs[job->nredir++];
+        int how = o->append ? O_APPEND : O_TRUNC;
+        *r = (struct redir){o->fd, o->from, NULL, O_WRONLY | O_CREAT | how};
+        if (o->from < 0 && (r->path = word_value(o->w)) == NULL) {
+            sys_write(2, "sh: out of memory\n", 18);
+            return false;
+        }
+    }
+    return true;
+}
+
+/** The value of the assignment w, expanded; its name is w->raw[0, *nlen). */
+static const char *assign_value(const struct word *w, int *nlen) {
+    *nlen = name_len(w->raw, w->len);
+    return w->text != NULL ? w->text + *nlen + 1 : expand(w->raw + *nlen + 1, w->len - *nlen - 1, EXP_WORD);
+}
+
+/** environ with the assignments of st on top, for its command alone. */
+static char **assign_env(const struct stage *st) {
+    size_t n = 0;
+    while (environ != NULL && environ[n] != NULL) {
+        n++;
+    }
+    char **env = arena_alloc(&line_arena, (n + st->nassign + 1) * sizeof(char *));
+    if (env == NULL) {
+        return NULL;
+    }
+    Memcpy(env, environ, n * sizeof(char *));
+    for (const struct word *w = st->assigns; w != NULL; w = w->next) {
+        int nlen;
+        const char *v = assign_value(w, &nlen);
+        size_t vlen = v != NULL ? Strlen(v) : 0;
+        char *e = arena_alloc(&line_arena, nlen + vlen + 2);
+        if (e == NULL) {
+            return NULL;
+        }
+        Memcpy(e, w->raw, nlen + 1);
+        Memcpy(e + nlen + 1, v, vlen + 1);
+        size_t i = 0;
+        while (i < n && !(Memcmp(env[i], e, nlen + 1) == 0)) {
+            i++;
+        }
+        env[i] = e;
+        n += i == n;
+    }
+    env[n] = NULL;
+    return env;
+}
+
+/** A function with assignments in front: they are its variables
+ * while it runs, then the old ones again. */
+static int run_func_assigned(job_t *job, const struct stage *st) {
+    char **old = arena_alloc(&line_arena, st->nassign * sizeof(char *));
+    if (old == NULL) {
+        sys_write(2, "sh: out of memory\n", 18);
+        return 1;
+    }
+    int i = 0;
+    for (const struct word *w = st->assigns; w != NULL; w = w->next, i++) {
+        int nlen;
+        const char *v = assign_value(w, &nlen);
+        const char *was = var_get(w->raw, nlen);
+        old[i] = NULL;
+        if (was != NULL && (old[i] = arena_alloc(&line_arena, Strlen(was) + 1)) != NULL) {
+            Strcpy(old[i], was);
+        }
+        var_store(w->raw, nlen, v != NULL ? v : "", false);
+    }
+    int ret = run_builtin(job);
+    i = 0;
+    for (const struct word *w = st->assigns; w != NULL; w = w->next, i++) {
+        int nlen = name_len(w->raw, w->len);
+        if (old[i] != NULL) {
+            var_store(w->raw, nlen, old[i], false);
+        } else {
+            char *name = expand(w->raw, nlen, EXP_WORD);
+            if (name != NULL) {
+                var_unset(name);
+            }
+        }
+    }
+    return ret;
+}
+
+/** A mask as taskset takes it, in hexadecimal with or without "0x":
+ * "5" is CPUs 0 and 2. False if it is not one, or has no CPU. */
+static bool cpu_mask(const char *s, struct sched *sc) {
+    s += s[0] == '0' && (s[1] == 'x' || s[1] == 'X') ? 2 : 0;
+    int n = Strlen(s);
+    if (n == 0 || n > SCHED_CPU_WORDS * 16) {
+        return false;
+    }
+    uint64_t any = 0;
+    for (int i = 0; i < n; i++) {
+        char c = s[n - 1 - i] | 0x20;
+        int d = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+        if (d < 0) {
+            return false;
+        }
+        sc->cpus[i / 16] |= (uint64_t)d << (i % 16 * 4);
+        any |= d;
+    }
+    sc->cpu_words = (n + 15) / 16;
+    return any != 0;
+}
+
+/** A CPU number in a list; what follows it, NULL if there is none. */
+static const char *cpu_num(const char *s, long *v) {
+    if (*s < '0' || *s > '9') {
+        return NULL;
+    }
+    for (*v = 0; *s >= '0' && *s <= '9'; s++) {
+        *v = *v * 10 + (*s - '0');
+        if (*v >= SCHED_CPU_WORDS * 64) {
+            return NULL;
+        }
+    }
+    return s;
+}
+
+/** A list as taskset -c takes it: "0,2-3" is CPUs 0, 2 and 3. */
+static bool cpu_list(const char *s, struct sched *sc) {
+    do {
+        long lo, hi;
+        if ((s = cpu_num(s, &lo)) == NULL) {
+            return false;
+        }
+        hi = lo;
+        if (*s == '-' && ((s = cpu_num(s + 1, &hi)) == NULL || hi < lo)) {
+            return false;
+        }
+        for (long c = lo; c <= hi; c++) {
+            sc->cpus[c / 64] |= 1ull << (c % 64);
+        }
+        sc->cpu_words = hi / 64 + 1 > sc->cpu_words ? hi / 64 + 1 : sc->cpu_words;
+    } while (*s++ == ',');
+    return s[-1] == 0;
+}
+
+/** taskset [-c] mask|list: how many words of argv it takes, 0 if wrong. */
+static int sched_taskset(char **argv, struct sched *sc) {
+    Memset(sc->cpus, 0, sizeof(sc->cpus));
+    sc->cpu_words = 0;
+    if (argv[1] != NULL && Strcmp(argv[1], "-c") == 0) {
+        return argv[2] != NULL && cpu_list(argv[2], sc) ? 3 : 0;
+    }
+    return argv[1] != NULL && cpu_mask(argv[1], sc) ? 2 : 0;
+}
+
+/** nice [-n inc], nice -inc: 10 without one. */
+static int sched_nice(char **argv, struct sched *sc) {
+    long inc = 10;
+    int used = 1;
+    if (argv[1] != NULL && Strcmp(argv[1], "-n") == 0) {
+        used = argv[2] != NULL && to_long(argv[2], &inc) ? 3 : 0;
+    } else if (argv[1] != NULL && argv[1][0] == '-') {
+        used = to_long(argv[1] + 1, &inc) ? 2 : 0;
+    }
+    sc->nice += inc;
+    return used;
+}
+
+/** chrt [-o|-f|-r|-b|-i] priority: round robin without a policy. */
+static int sched_chrt(char **argv, struct sched *sc) {
+    static const char policies[] = {
+        ['o'] = SCHED_OTHER + 1, ['f'] = SCHED_FIFO + 1, ['r'] = SCHED_RR + 1,
+        ['b'] = SCHED_BATCH + 1, ['i'] = SCHED_IDLE + 1,
+    };
+    int used = 1;
+    sc->policy = SCHED_RR;
+    if (argv[1] != NULL && argv[1][0] == '-') {
+        unsigned char c = argv[1][1];
+        if (c >= sizeof(policies) || policies[c] == 0 || argv[1][2] != 0) {
+            return 0;
+        }
+        sc->policy = policies[c] - 1;
+        used++;
+    }
+    long prio;
+    if (argv[used] == NULL || !to_long(argv[used], &prio)) {
+        return 0;
+    }
+    sc->priority = prio;
+    return used + 1;
+}
+
+/** taskset, nice and chrt in front of a command only say how it is
+ * scheduled: take them off job's argv into job->sched, for the spawn
+ * to apply in the child before it runs the command. Each stage of a
+ * pipeline has its own, so taskset 1 a | taskset 2 b keeps a on CPU 0
+ * and b on CPU 1. False, said why, if one is wrong. */
+static bool sched_prefix(job_t *job) {
+    static const struct {
+        const char *name;
+        int (*parse)(char **argv, struct sched *sc);
+        const char *usage;
+    } prefixes[] = {
+        {"taskset", sched_taskset, "[-c] mask|list"},
+        {"nice", sched_nice, "[-n inc]"},
+        {"chrt", sched_chrt, "[-o|-f|-r|-b|-i] priority"},
+    };
+    const size_t n = sizeof(prefixes) / sizeof(prefixes[0]);
+    struct sched *sc = NULL;
+    char **argv = job->argv;
+    while (argv[0] != NULL) {
+        size_t i = 0;
+        while (i < n && Strcmp(argv[0], prefixes[i].name) != 0) {
+            i++;
+        }
+        if (i == n || func_find(argv[0]) != NULL) {
+            break;
+        }
+        if (sc == NULL) {
+            if ((sc = arena_alloc(&line_arena, sizeof(*sc))) == NULL) {
+                sys_write(2, "sh: out of memory\n", 18);
+                return false;
+            }
+            Memset(sc, 0, sizeof(*sc));
+            sc->policy = -1;
+        }
+        int used = prefixes[i].parse(argv, sc);
+        if (used == 0 || argv[used] == NULL) {
+            static char buf[128];
+            unsigned len = Sprintf(buf, "usage: %s %s command [args...]\n",
+                                   prefixes[i].name, prefixes[i].usage);
+            sys_write(2, buf, len);
+            return false;
+        }
+        argv += used;
+    }
+    job->argv = argv;
+    job->exe = argv[0];
+    job->sched = sc;
+    return true;
+}
+
+/** Fill in jobs for the pipeline n, and run them. */
+static int run_jobs(const struct node *n, job_t *jobs, bool bg) {
+    int jobcnt = n->nstage;
+    job_t *cur = jobs;
+    for (const struct stage *st = n->stages; st != NULL; st = st->next, cur++) {
+        if (st->compound != NULL) {
+            // a subshell's list, as it is in a fork anyway.
+            const struct node *c = st->compound;
+            struct subshell *sub = arena_alloc(&line_arena, sizeof(*sub));
+            if (sub == NULL) {
+                sys_write(2, "sh: out of memory\n", 18);
+                return 1;
+            }
+            *sub = (struct subshell){{"sh", NULL}, c->kind == N_SUBSHELL ? c->a : c};
+            cur->argv = sub->argv;
+            cur->exe = sub->argv[0];
+            cur->builtin = subshell_main;
+            if (!stage_redirs(st, cur)) {
+                return 1;
+            }
+            continue;
+        }
+        cur->argv = expand_words(st->words, NULL);
+        if (cur->argv == NULL) {
+            sys_write(2, "sh: out of memory\n", 18);
+            return 1;
+        }
+        cur->exe = cur->argv[0];
+        if (!sched_prefix(cur)) {
+            return 2;
+        }
+        if (!stage_redirs(st, cur)) {
+            return 1;
+        }
+        if (st->nassign > 0 && st->nword > 0 && (cur->envp = assign_env(st)) == NULL) {
+            sys_write(2, "sh: out of memory\n", 18);
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < jobcnt; i++) {
+        const char *exe = jobs[i].exe;
+        if (jobs[i].builtin == NULL && exe != NULL) {
+            jobs[i].builtin = func_find(exe) ? func_main : find_builtin(exe);
+        }
+    }
+    // scheduled otherwise, a builtin too is for a fork; a compound
+    // command after time is for one anyway.
+    bool in_shell = jobcnt == 1 && jobs[0].builtin != NULL && jobs[0].sched == NULL &&
+                    n->stages->compound == NULL;
+#ifdef MULTICALL
+    // the other programs are in this binary too: fork and call them,
+    // with no exec. Never in the shell itself, like a builtin alone.
+    // Only where the PATH leads here, though, not to a program of the
+    // same name elsewhere.
+    for (int i = 0; i < jobcnt; i++) {
+        const char *exe = jobs[i].exe;
+        const char *path = exe == NULL || jobs[i].builtin ? NULL :
+                           Memchr(exe, '/', Strlen(exe)) ? exe : hash_lookup(exe);
+        const struct applet *a = path != NULL ? applet_at(path) : NULL;
+        if (a != NULL && Strcmp(a->name, "sh") != 0) {
+            jobs[i].builtin = a->main;
+        }
+    }
+#endif
+
+    struct rusage ru;
+    Memset(&ru, 0, sizeof(ru));
+    uint64_t start = now_ns();
+    int ret = 0;
+    if (jobs[0].exe == NULL) {
+        // time alone, only redirections, or assignments to the shell's
+        // variables, which in a pipeline would be the fork's
+        for (const struct word *w = n->stages->assigns; w != NULL && jobcnt == 1 && !bg; w = w->next) {
+            int nlen;
+            const char *v = assign_value(w, &nlen);
+            var_store(w->raw, nlen, v != NULL ? v : "", false);
+        }
+    } else if (bg) {
+        ret = job_start(jobs, jobcnt, exec_flags, n->text, n->len);
+    } else if (in_shell) {
+        ret = jobs[0].builtin == func_main && n->stages->nassign > 0 ?
+              run_func_assigned(&jobs[0], n->stages) : run_builtin(&jobs[0]);
+    } else {
+        ret = exec_job(jobs, jobcnt, exec_flags, n->timed ? &ru : NULL);
+    }
+    if (n->timed) {
+        report_time(now_ns() - start, &ru);
+    }
+    return ret;
+}
+
+/** Run the pipeline n; in the background as a job with bg. */
+static int run_pipeline(const struct node *n, bool bg) {
+    env_sync();
+    int jobcnt = n->nstage;
+    job_t *jobs = arena_alloc(&line_arena, jobcnt * sizeof(job_t));
+    if (jobs == NULL) {
+        sys_write(2, "sh: out of memory\n", 18);
+        return 1;
+    }
+    Memset(jobs, 0, jobcnt * sizeof(job_t));
+    int mark = nprocs;
+    int ret = run_jobs(n, jobs, bg);
+    for (int i = 0; i < jobcnt; i++) {
+        if (jobs[i].stdin_fd > 0) {
+            sys_close(jobs[i].stdin_fd);
+        }
+    }
+    procs_done(mark, !bg);
+    return ret;
+}
+
+static int run_loop(const struct node *n) {
+    int ret = 0;
+    loop_depth++;
+    while (breaking == 0 && !returning) {
+        int cond = run_list(n->a);
+        if ((cond == 0) != (n->kind == N_WHILE) || breaking > 0 || returning) {
+            break;
+        }
+        ret = run_list(n->b);
+        if (!loop_next()) {
+            break;
+        }
+    }
+    loop_depth--;
+    return ret;
+}
+
+static int run_for(const struct node *n) {
+    int count = nparams - 1;
+    char **list = params + 1;
+    if (!n->params) {
+        list = expand_words(n->words, &count);
+        if (list == NULL) {
+            sys_write(2, "sh: out of memory\n", 18);
+            return 1;
+        }
+    }
+    int ret = 0;
+    loop_depth++;
+    for (int i = 0; i < count; i++) {
+        var_set(n->name, list[i]);
+        ret = run_list(n->a);
+        // return keeps its status: no more bodies to overwrite it.
+        if (returning || !loop_next()) {
+            break;
+        }
+    }
+    loop_depth--;
+    return ret;
+}
+
+/** Run one command of a list. What it expands goes back to the arena
+ * after. */
+static int run_node(const struct node *n) {
+    size_t mark = line_arena.used;
+    int ret = 0;
+    if (n->bg) {
+        if (n->kind == N_PIPELINE) {
+            ret = run_pipeline(n, true);
+        } else {
+            struct node alone = *n;
+            alone.bg = false;
+            alone.next = NULL;
+            ret = run_subshell(&alone, true);
+        }
+    } else if (n->redir != NULL) {
+        job_t job = {0};
+        int saved[3] = {-1, -1, -1};
+        int procs_mark = nprocs;
+        struct node bare = *n;
+        bare.redir = NULL;
+        ret = stage_redirs(n->redir, &job) && redirect(&job, saved) ? run_node(&bare) : 1;
+        unredirect(saved);
+        if (job.stdin_fd > 0) {
+            sys_close(job.stdin_fd);
+        }
+        procs_done(procs_mark, true);
+    } else {
+        switch (n->kind) {
+        case N_PIPELINE:
+            ret = run_pipeline(n, false);
+            break;
+        case N_AND:
+            ret = run_node(n->a);
+            ret = ret == 0 && breaking == 0 && !returning ? run_node(n->b) : ret;
+            break;
+        case N_OR:
+            ret = run_node(n->a);
+            ret = ret != 0 && breaking == 0 && !returning ? run_node(n->b) : ret;
+            break;
+        case N_NOT:
+            ret = run_node(n->a) == 0;
+            break;
+        case N_IF:
+            if (run_list(n->a) == 0) {
+                ret = run_list(n->b);
+            } else {
+                ret = run_list(n->c);
+            }
+            break;
+        case N_WHILE:
+        case N_UNTIL:
+            ret = run_loop(n);
+            break;
+        case N_FOR:
+            ret = run_for(n);
+            break;
+        case N_FUNC:
+            ret = func_define(n->name, n->a);
+            break;
+        case N_GROUP:
+            ret = run_list(n->a);
+            break;
+        case N_SUBSHELL:
+            ret = run_subshell(n->a, false);
+            break;
+        }
+    }
+    line_arena.used = mark;
+    last_status = ret;
+    return ret;
+}
+
+static int run_list(const struct node *n) {
+    int ret = 0;
+    for (; n != NULL && breaking == 0 && !returning; n = n->next) {
+        ret = run_node(n);
+    }
+    return ret;
+}
+
+/** Parse all of src[0, len) and run it. With more not NULL, src is a
+ * line typed in: it is copied, for the functions it defines, and
+ * *more is set instead of an error when a command goes on in the next
+ * line. */
+static int run_text(const char *src, int len, bool *more) {
+    if (line_arena.base == NULL && !arena_init(&line_arena, LINE_ARENA)) {
+        sys_write(2, "sh: out of memory\n", 18);
+        return 1;
+    }
+    // a builtin may run this again: give back only what this took.
+    size_t mark = line_arena.used;
+    if (more != NULL) {
+        *more = false;
+        char *copy = arena_alloc(&line_arena, len);
+        if (copy == NULL) {
+            sys_write(2, "sh: out of memory\n", 18);
+            return 1;
+        }
+        src = Memcpy(copy, src, len);
+    }
+
+    struct parser ps = {.src = src, .len = len};
+    next(&ps);
+    struct node *tree = parse_list(&ps);
+    // an open quote leaves the last word unfinished.
+    if (!ps.error && (ps.more || ps.tok.kind != TOK_EOF)) {
+        fail(&ps);
+    }
+    if (ps.error) {
+        // arena_alloc counts what it refused too.
+        bool full = line_arena.used > line_arena.cap;
+        line_arena.used = mark;
+        if (full) {
+            sys_write(2, "sh: out of memory\n", 18);
+            return 1;
+        }
+        if (more != NULL && ps.more) {
+            *more = true;
+            return 0;
+        }
+        report_syntax(&ps);
+        return last_status = 2;
+    }
+    int ret = run_list(tree);
+    if (!ps.defined) {
+        line_arena.used = mark;
+    }
+    return ret;
+}
+
+/** sh file: the file is mapped and parsed at once, then run. */
+static int run_file(const char *path) {
+    int fd = sys_openat(AT_FDCWD, path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || sys_fstat(fd, &st) != 0) {
+        static char buf[256];
+        unsigned n = Sprintf(buf, "sh: cannot open %s\n", path);
+        sys_write(2, buf, n);
+        return 127;
+    }
+    if (st.st_size == 0) {
+        sys_close(fd);
+        return 0;
+    }
+    char *src = sys_mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    sys_close(fd);
+    if ((long)src < 0) {
+        sys_write(2, "sh: cannot map the script\n", 26);
+        return 126;
+    }
+    return run_text(src, st.st_size, NULL);
+}
+
+int system(const char *cmd) {
+    bool more;
+    int ret = run_text(cmd, Strlen(cmd), &more);
+    if (more) {
+        sys_write(2, "sh: syntax error: unexpected end of input\n", 42);
+        ret = 2;
+    }
     return ret;
 }
@@ -0,0 +1,54 @@
+#include "std.h"
+#include "checksum.h"
+
+#define BUFSZ (1 << 20)
+
+static char buf[BUFSZ];
+
+static int sum(const char *path) {
+    int fd = path == NULL ? 0 : sys_open(path, O_RDONLY);
+    if (fd < 0) {
+        return fd;
+    }
+
+    struct sha256 ctx;
+    sha256_init(&ctx);
+    long r;
+    while ((r = sys_read(fd, buf, sizeof(buf))) > 0) {
+        sha256_update(&ctx, buf, r);
+    }
+    if (fd != 0) {
+        sys_close(fd);
+    }
+    if (r < 0) {
+        return r;
+    }
+
+    static const char hex[] = "0123456789abcdef";
+    uint8_t digest[SHA256_DIGEST];
+    char line[2 * SHA256_DIGEST + 1];
+    sha256_final(&ctx, digest);
+    for (int i = 0; i < SHA256_DIGEST; i++) {
+        line[2 * i] = hex[digest[i] >> 4];
+        line[2 * i + 1] = hex[digest[i] & 0xf];
+    }
+    line[2 * SHA256_DIGEST] = 0;
+    Printf("%s  %s\n", line, path == NULL ? "-" : path);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int ret = 0;
+    if (argc == 1) {
+        ret |= sum(NULL) < 0;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (sum(Strcmp(argv[i], "-") == 0 ? NULL : argv[i]) < 0) {
+            sys_write(2, "sha256sum: cannot read ", 23);
+            sys_write(2, argv[i], Strlen(argv[i]));
+            sys_write(2, "\n", 1);
+            ret = 1;
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,856 @@
+#include "std.h"
+#include "arena.h"
+#include "thread.h"
+
+#define NTHREAD 8
+/** Memory budget (-S): input held at once plus its records. */
+#define DEFAULT_BUDGET (256ul << 20)
+/** Smallest piece of input a worker sorts on its own. */
+#define PART_MIN (1ul << 20)
+#define MAXPART 1024
+#define MAXRUN 4096
+/** Below this many records MSD radix sort hands over to merge sort. */
+#define MSD_MIN 32
+/** Radix sort at most this many key bytes deep, then merge sort. */
+#define MSD_MAXDEPTH 48
+#define OUTBUF (1 << 20)
+
+/** One line, pointing into the input. */
+struct rec {
+    uint64_t prefix;    // first 8 key bytes big endian, or the integer part with -n
+    const char *key;
+    const char *line;
+    uint32_t klen;
+    uint32_t len;       // without the newline
+};
+
+static struct {
+    bool numeric;       // -n
+    bool reverse;       // -r
+    bool unique;        // -u
+    int kbeg;           // -k kbeg[,kend], fields count from 1; 0: whole line
+    int kend;           // 0: to the end of the line
+    size_t budget;      // -S
+    const char *tmpdir;
+} opt;
+
+static void die(const char *msg) {
+    sys_write(2, "sort: ", 6);
+    sys_write(2, msg, Strlen(msg));
+    sys_write(2, "\n", 1);
+    sys_exit(2);
+}
+
+static void *map_anon(size_t size) {
+    void *p = sys_mmap(NULL, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ((long)p < 0) {
+        die("out of memory");
+    }
+    return p;
+}
+
+/** -- keys -- */
+
+static bool blank(char c) {
+    return c == ' ' || c == '\t';
+}
+
+/** Start of field n: the blanks before it belong to it, as in POSIX sort
+ * without -b. e if there is no such field. */
+static const char *field_start(const char *s, const char *e, int n) {
+    for (int i = 1; i < n; i++) {
+        while (s < e && blank(*s)) {
+            s++;
+        }
+        while (s < e && !blank(*s)) {
+            s++;
+        }
+    }
+    return s;
+}
+
+static uint64_t load_be8(const char *p, size_t len) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < 8; i++) {
+        v = (v << 8) | (i < len ? (uint8_t)p[i] : 0);
+    }
+    return v;
+}
+
+/** The integer part, saturated and biased so that it sorts unsigned. */
+static uint64_t num_prefix(const char *s, const char *e) {
+    while (s < e && blank(*s)) {
+        s++;
+    }
+    bool neg = s < e && *s == '-';
+    if (neg) {
+        s++;
+    }
+    // saturate at 2^63 - 1 before the multiply can wrap; the full
+    // compare sorts out the rest.
+    const uint64_t max = (1ul << 63) - 1;
+    uint64_t v = 0;
+    for (; s < e && *s >= '0' && *s <= '9'; s++) {
+        unsigned d = *s - '0';
+        v = v > (max - d) / 10 ? max : v * 10 + d;
+    }
+    int64_t sv = neg ? -(int64_t)v : (int64_t)v;
+    return (uint64_t)sv ^ (1ul << 63);
+}
+
+static void make_rec(struct rec *r, const char *line, size_t len) {
+    const char *e = line + len;
+    const char *k = line;
+    const char *ke = e;
+    if (opt.kbeg > 0) {
+        k = field_start(line, e, opt.kbeg);
+        if (opt.kend > 0) {
+            ke = field_start(line, e, opt.kend);
+            while (ke < e && blank(*ke)) {
+                ke++;
+            }
+            while (ke < e && !blank(*ke)) {
+                ke++;
+            }
+            if (ke < k) {
+                ke = k;
+            }
+        }
+    }
+
+    r->line = line;
+    r->len = len;
+    r->key = k;
+    r->klen = ke - k;
+    r->prefix = opt.numeric ? num_prefix(k, ke) : load_be8(k, ke - k);
+}
+
+/** True if the number at s (after its sign) has no nonzero digit. */
+static bool num_zero(const char *s, const char *e) {
+    while (s < e && *s == '0') {
+        s++;
+    }
+    if (s < e && *s == '.') {
+        s++;
+        while (s < e && *s == '0') {
+            s++;
+        }
+    }
+    return s == e || *s < '1' || *s > '9';
+}
+
+/** Compare two numbers digit by digit, like 'sort -n'. */
+static int num_cmp(const char *a, const char *ae, const char *b, const char *be) {
+    while (a < ae && blank(*a)) {
+        a++;
+    }
+    while (b < be && blank(*b)) {
+        b++;
+    }
+    bool na = a < ae && *a == '-';
+    bool nb = b < be && *b == '-';
+    a += na;
+    b += nb;
+    // a negative zero is still zero
+    na = na && !num_zero(a, ae);
+    nb = nb && !num_zero(b, be);
+    if (na != nb) {
+        return na ? -1 : 1;
+    }
+
+    // integer parts without leading zeros
+    while (a < ae && *a == '0') {
+        a++;
+    }
+    while (b < be && *b == '0') {
+        b++;
+    }
+    const char *ai = a;
+    const char *bi = b;
+    while (a < ae && *a >= '0' && *a <= '9') {
+        a++;
+    }
+    while (b < be && *b >= '0' && *b <= '9') {
+        b++;
+    }
+
+    int c = (a - ai > b - bi) - (a - ai < b - bi);
+    if (c == 0) {
+        c = Memcmp(ai, bi, a - ai);
+    }
+    if (c == 0) {
+        // fractions, the shorter one padded with zeros
+        a += a < ae && *a == '.';
+        b += b < be && *b == '.';
+        for (;;) {
+            bool da = a < ae && *a >= '0' && *a <= '9';
+            bool db = b < be && *b >= '0' && *b <= '9';
+            if (!da && !db) {
+                break;
+            }
+            char ca = da ? *a++ : '0';
+            char cb = db ? *b++ : '0';
+            if (ca != cb) {
+                c = ca - cb;
+                break;
+            }
+        }
+    }
+    return na ? -c : c;
+}
+
+static int key_cmp(const struct rec *a, const struct rec *b) {
+    if (opt.numeric) {
+        return num_cmp(a->key, a->key + a->klen, b->key, b->key + b->klen);
+    }
+    int c = Memcmp(a->key, b->key, a->klen < b->klen ? a->klen : b->klen);
+    return c != 0 ? c : (a->klen > b->klen) - (a->klen < b->klen);
+}
+
+static int line_cmp(const struct rec *a, const struct rec *b) {
+    int c = Memcmp(a->line, b->line, a->len < b->len ? a->len : b->len);
+    return c != 0 ? c : (a->len > b->len) - (a->len < b->len);
+}
+
+/** Keys first, then the whole line as a last resort. Ascending.
+ *
+ * With -u the first line of equal keys in the input is kept, so the last
+ * resort is the input order instead: the position within a part, which is
+ * one buffer. It is turned around with -r, as reversed runs are read
+ * backwards. */
+static int rec_cmp(const struct rec *a, const struct rec *b) {
+    if (a->prefix != b->prefix) {
+        return a->prefix < b->prefix ? -1 : 1;
+    }
+    int c = key_cmp(a, b);
+    if (c != 0) {
+        return c;
+    }
+    if (opt.unique) {
+        c = (a->line > b->line) - (a->line < b->line);
+        return opt.reverse ? -c : c;
+    }
+    return line_cmp(a, b);
+}
+
+/** The output order of records from different runs. 0 for equal keys
+ * with -u, the run that came first in the input wins then. */
+static int order(const struct rec *a, const struct rec *b) {
+    int c;
+    if (a->prefix != b->prefix) {
+        c = a->prefix < b->prefix ? -1 : 1;
+    } else {
+        c = key_cmp(a, b);
+        if (c == 0 && !opt.unique) {
+            c = line_cmp(a, b);
+        }
+    }
+    return opt.reverse ? -c : c;
+}
+
+/** -- sorting a run -- */
+
+static void merge_sort(struct rec *a, struct rec *tmp, size_t n) {
+    if (n < 2) {
+        return;
+    }
+    if (n <= 8) {
+        for (size_t i = 1; i < n; i++) {
+            struct rec v = a[i];
+            size_t j = i;
+            for (; j > 0 && rec_cmp(&a[j - 1], &v) > 0; j--) {
+                a[j] = a[j - 1];
+            }
+            a[j] = v;
+        }
+        return;
+    }
+
+    size_t h = n / 2;
+    merge_sort(a, tmp, h);
+    merge_sort(a + h, tmp + h, n - h);
+    size_t i = 0, j = h, k = 0;
+    while (i < h && j < n) {
+        tmp[k++] = rec_cmp(&a[j], &a[i]) < 0 ? a[j++] : a[i++];
+    }
+    while (i < h) {
+        tmp[k++] = a[i++];
+    }
+    while (j < n) {
+        tmp[k++] = a[j++];
+    }
+    Memcpy(a, tmp, n * sizeof(struct rec));
+}
+
+/** Bucket of a record at key byte pos: 0 if the key ended, byte + 1 otherwise. */
+static inline unsigned bucket(const struct rec *r, size_t pos) {
+    if (pos < 8) {
+        if (!opt.numeric && r->klen <= pos) {
+            return 0;
+        }
+        return 1 + ((r->prefix >> (56 - 8 * pos)) & 0xff);
+    }
+    return r->klen <= pos ? 0 : 1 + (uint8_t)r->key[pos];
+}
+
+/** MSD radix sort, all records agree on the key bytes before pos. */
+static void msd(struct rec *a, struct rec *tmp, size_t n, size_t pos) {
+    uint32_t count[257];
+
+    for (;;) {
+        if (n < MSD_MIN || pos >= MSD_MAXDEPTH || (opt.numeric && pos >= 8)) {
+            merge_sort(a, tmp, n);
+            return;
+        }
+
+        Memset(count, 0, sizeof(count));
+        for (size_t i = 0; i < n; i++) {
+            count[bucket(&a[i], pos)]++;
+        }
+        // all keys share this byte, look at the next one.
+        unsigned b0 = bucket(&a[0], pos);
+        if (count[b0] == n && b0 != 0) {
+            pos++;
+            continue;
+        }
+        break;
+    }
+
+    uint32_t start[257];
+    uint32_t sum = 0;
+    for (int b = 0; b < 257; b++) {
+        start[b] = sum;
+        sum += count[b];
+    }
+    for (size_t i = 0; i < n; i++) {
+        tmp[start[bucket(&a[i], pos)]++] = a[i];
+    }
+    Memcpy(a, tmp, n * sizeof(struct rec));
+
+    // keys that ended here are equal, only the last resort is left.
+    merge_sort(a, tmp, count[0]);
+    size_t off = count[0];
+    for (int b = 1; b < 257; b++) {
+        if (count[b] > 1) {
+            msd(a + off, tmp + off, count[b], pos + 1);
+        }
+        off += count[b];
+    }
+}
+
+/** -- input -- */
+
+/** A piece of input made of whole lines, sorted by one worker. */
+struct part {
+    const char *p;
+    size_t len;
+    struct rec *recs;
+    size_t n;
+};
+
+static struct {
+    struct part parts[MAXPART];
+    int nparts;
+    size_t bytes;
+    size_t next;          // next part for the workers
+    struct arena recs;    // records of all parts
+    // stream buffers owned by the batch
+    void *bufs[MAXPART];
+    size_t bufsz[MAXPART];
+    int nbufs;
+} batch;
+
+static void sort_part(struct part *pt) {
+    size_t n = 0;
+    const char *p = pt->p;
+    const char *e = pt->p + pt->len;
+    for (const char *q = p; q < e; ) {
+        const char *nl = Memchr(q, '\n', e - q);
+        q = nl == NULL ? e : nl + 1;
+        n++;
+    }
+
+    struct rec *r = arena_alloc(&batch.recs, 2 * n * sizeof(struct rec));
+    if (r == NULL) {
+        die("out of memory");
+    }
+    for (size_t i = 0; i < n; i++) {
+        const char *nl = Memchr(p, '\n', e - p);
+        const char *end = nl == NULL ? e : nl;
+        make_rec(&r[i], p, end - p);
+        p = nl == NULL ? e : nl + 1;
+    }
+    msd(r, r + n, n, 0);
+    pt->recs = r;
+    pt->n = n;
+}
+
+static int sort_worker(void *arg) {
+    for (;;) {
+        size_t i = __atomic_fetch_add(&batch.next, 1, __ATOMIC_RELAXED);
+        if (i >= (size_t)batch.nparts) {
+            return 0;
+        }
+        sort_part(&batch.parts[i]);
+    }
+}
+
+/** Sort the parts of the batch, independent parts on separate threads. */
+static void sort_batch(void) {
+    static struct thread workers[NTHREAD - 1];
+    batch.next = 0;
+    int nworker = 0;
+    for (; nworker < NTHREAD - 1 && nworker + 1 < batch.nparts; nworker++) {
+        if (thread_create(&workers[nworker], sort_worker, NULL) != 0) {
+            break;
+        }
+    }
+    sort_worker(NULL);
+    for (int i = 0; i < nworker; i++) {
+        thread_join(&workers[i]);
+    }
+}
+
+/** Queue p[0, len) (whole lines) for sorting, cut in pieces for the workers. */
+static void add_block(const char *p, size_t len) {
+    size_t piece = opt.budget / 2 / NTHREAD;
+    if (piece < PART_MIN) {
+        piece = PART_MIN;
+    }
+    while (len > 0) {
+        size_t n = len;
+        if (n > piece) {
+            const char *nl = Memchr(p + piece, '\n', len - piece);
+            n = nl == NULL ? len : (size_t)(nl + 1 - p);
+        }
+        if (batch.nparts == MAXPART) {
+            die("too many parts");
+        }
+        struct part *pt = &batch.parts[batch.nparts++];
+        pt->p = p;
+        pt->len = n;
+        pt->n = 0;
+        p += n;
+        len -= n;
+        batch.bytes += n;
+    }
+}
+
+/** -- output and merging -- */
+
+static struct {
+    int fd;
+    char *buf;
+    size_t len;
+    bool have_last;
+    struct rec last;      // for -u
+} out;
+
+static void out_flush(void) {
+    for (size_t done = 0; done < out.len; ) {
+        long w = sys_write(out.fd, out.buf + done, out.len - done);
+        if (w <= 0) {
+            die("write error");
+        }
+        done += w;
+    }
+    out.len = 0;
+}
+
+static void out_begin(int fd) {
+    out.fd = fd;
+    out.len = 0;
+    out.have_last = false;
+}
+
+static void out_rec(const struct rec *r) {
+    if (opt.unique && out.have_last && key_cmp(&out.last, r) == 0) {
+        return;
+    }
+    out.last = *r;
+    out.have_last = true;
+
+    if (out.len + r->len + 1 > OUTBUF) {
+        out_flush();
+    }
+    if (r->len + 1 > OUTBUF) {
+        sys_write(out.fd, r->line, r->len);
+        sys_write(out.fd, "\n", 1);
+        return;
+    }
+    Memcpy(out.buf + out.len, r->line, r->len);
+    out.len += r->len;
+    out.buf[out.len++] = '\n';
+}
+
+/** A sorted sequence of records: a sorted part, or a spilled run file. */
+struct cursor {
+    struct rec cur;
+    bool done;
+    // in memory: walks the records in output order
+    struct rec *recs;
+    size_t n;
+    size_t i;
+    // run file: parses the mapped file
+    const char *p;
+    const char *e;
+};
+
+static void cursor_next(struct cursor *c) {
+    if (c->recs != NULL) {
+        if (c->i == c->n) {
+            c->done = true;
+            return;
+        }
+        c->cur = c->recs[opt.reverse ? c->n - 1 - c->i : c->i];
+        c->i++;
+        return;
+    }
+
+    if (c->p >= c->e) {
+        c->done = true;
+        return;
+    }
+    const char *nl = Memchr(c->p, '\n', c->e - c->p);
+    const char *end = nl == NULL ? c->e : nl;
+    make_rec(&c->cur, c->p, end - c->p);
+    c->p = nl == NULL ? c->e : nl + 1;
+}
+
+/** Loser tree: node[0] is the winner, node[1..k) hold the losers of
+ * each match. Leaf k stands for -infinity while building. */
+static struct cursor *lt_cur;
+static int *lt_node;
+static int lt_k;
+
+static bool beats(int a, int b) {
+    if (a == lt_k || b == lt_k) {
+        return a == lt_k;
+    }
+    if (lt_cur[a].done || lt_cur[b].done) {
+        return !lt_cur[a].done;
+    }
+    int c = order(&lt_cur[a].cur, &lt_cur[b].cur);
+    return c < 0 || (c == 0 && a < b);
+}
+
+static void lt_adjust(int s) {
+    for (int t = (s + lt_k) / 2; t > 0; t /= 2) {
+        if (beats(lt_node[t], s)) {
+            int w = lt_node[t];
+            lt_node[t] = s;
+            s = w;
+        }
+    }
+    lt_node[0] = s;
+}
+
+static void merge(struct cursor *cur, int k) {
+    static int node[MAXRUN + MAXPART];
+    lt_cur = cur;
+    lt_node = node;
+    lt_k = k;
+
+    for (int i = 0; i < k; i++) {
+        cursor_next(&cur[i]);
+        node[i] = k;
+    }
+    for (int i = k - 1; i >= 0; i--) {
+        lt_adjust(i);
+    }
+
+    for (;;) {
+        int w = node[0];
+        if (k == 0 || cur[w].done) {
+            break;
+        }
+        out_rec(&cur[w].cur);
+        cursor_next(&cur[w]);
+        lt_adjust(w);
+    }
+    out_flush();
+}
+
+/** Merge the sorted parts of the batch to fd. */
+static void merge_batch(int fd) {
+    static struct cursor cur[MAXPART];
+    for (int i = 0; i < batch.nparts; i++) {
+        Memset(&cur[i], 0, sizeof(cur[i]));
+        cur[i].recs = batch.parts[i].recs;
+        cur[i].n = batch.parts[i].n;
+    }
+    out_begin(fd);
+    merge(cur, batch.nparts);
+}
+
+/** -- spilling -- */
+
+static struct {
+    int fd[MAXRUN];
+    size_t size[MAXRUN];
+    int n;
+} runs;
+
+static int make_temp(void) {
+    int fd = sys_openat_mode(AT_FDCWD, opt.tmpdir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0) {
+        return fd;
+    }
+
+    // no O_TMPFILE: create a file and unlink it right away.
+    static char path[4096];
+    static int seq;
+    if (Strlen(opt.tmpdir) > sizeof(path) - 64) {
+        die("TMPDIR too long");
+    }
+    Sprintf(path, "%s/.sort.%d.%d", opt.tmpdir, sys_getpid(), seq++);
+    fd = sys_openat_mode(AT_FDCWD, path, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        die("cannot create temporary file");
+    }
+    sys_unlinkat(AT_FDCWD, path, 0);
+    return fd;
+}
+
+static void batch_reset(void) {
+    for (int i = 0; i < batch.nbufs; i++) {
+        sys_munmap(batch.bufs[i], batch.bufsz[i]);
+    }
+    batch.nbufs = 0;
+    batch.nparts = 0;
+    batch.bytes = 0;
+    arena_reset(&batch.recs);
+}
+
+/** The batch does not fit with the rest: sort it into a run file. */
+static void spill(void) {
+    if (batch.nparts == 0) {
+        return;
+    }
+    if (runs.n == MAXRUN) {
+        die("too many runs, raise -S");
+    }
+    sort_batch();
+    int fd = make_temp();
+    merge_batch(fd);
+    runs.fd[runs.n] = fd;
+    runs.size[runs.n] = sys_lseek(fd, 0, SEEK_END);
+    runs.n++;
+    batch_reset();
+}
+
+/** -- reading -- */
+
+static void add_mapped(const char *p, size_t size) {
+    size_t limit = opt.budget / 2;
+    while (size > 0) {
+        size_t room = batch.bytes < limit ? limit - batch.bytes : 0;
+        size_t n = size;
+        if (n > room) {
+            const char *nl = Memchr(p + room, '\n', size - room);
+            n = nl == NULL ? size : (size_t)(nl + 1 - p);
+        }
+        add_block(p, n);
+        p += n;
+        size -= n;
+        if (batch.bytes >= limit) {
+            spill();
+        }
+    }
+}
+
+/** Read a pipe or terminal in batch sized buffers. */
+static void add_stream(int fd) {
+    size_t cap = opt.budget / 2;
+    char *buf = map_anon(cap);
+    size_t len = 0;
+    bool eof = false;
+
+    while (!eof) {
+        long r = sys_read(fd, buf + len, cap - len);
+        if (r < 0) {
+            die("read error");
+        }
+        eof = r == 0;
+        len += r;
+        if (len < cap && !eof) {
+            continue;
+        }
+
+        // keep the partial last line for the next buffer
+        size_t whole = len;
+        if (!eof) {
+            while (whole > 0 && buf[whole - 1] != '\n') {
+                whole--;
+            }
+            if (whole == 0) {
+                // a single line longer than the buffer: grow it.
+                char *bigger = map_anon(2 * cap);
+                Memcpy(bigger, buf, len);
+                sys_munmap(buf, cap);
+                buf = bigger;
+                cap *= 2;
+                continue;
+            }
+        }
+
+        if (batch.nbufs == MAXPART) {
+            spill();
+        }
+        size_t carry = len - whole;
+        char *next = eof ? NULL : map_anon(cap);
+        if (carry > 0) {
+            Memcpy(next, buf + whole, carry);
+        }
+        batch.bufs[batch.nbufs] = buf;
+        batch.bufsz[batch.nbufs] = cap;
+        batch.nbufs++;
+        add_block(buf, whole);
+        if (batch.bytes >= opt.budget / 2) {
+            spill();
+        }
+
+        buf = next;
+        len = carry;
+    }
+}
+
+static void add_input(const char *path) {
+    int fd = path == NULL ? 0 : sys_open(path, O_RDONLY);
+    if (fd < 0) {
+        die("cannot open input");
+    }
+
+    struct stat st;
+    if (sys_fstat(fd, &st) == 0 && (st.st_mode & S_IFMT) == S_IFREG) {
+        if (st.st_size > 0) {
+            // mapped files are never copied; the mapping stays until exit.
+            const char *p = sys_mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if ((long)p < 0) {
+                die("cannot map input");
+            }
+            add_mapped(p, st.st_size);
+        }
+    } else {
+        add_stream(fd);
+    }
+    if (fd != 0) {
+        sys_close(fd);
+    }
+}
+
+static size_t parse_size(const char *s) {
+    size_t v = 0;
+    for (; *s >= '0' && *s <= '9'; s++) {
+        v = v * 10 + (*s - '0');
+    }
+    switch (*s) {
+    case 'k': case 'K': return v << 10;
+    case 'm': case 'M': return v << 20;
+    case 'g': case 'G': return v << 30;
+    }
+    return v;
+}
+
+static const char *parse_field(int *field, const char *s) {
+    *field = 0;
+    for (; *s >= '0' && *s <= '9'; s++) {
+        *field = *field * 10 + (*s - '0');
+    }
+    return s;
+}
+
+static int usage(void) {
+    static const char msg[] = "Usage: sort [-nru] [-k field[,field]] [-S size] [file...]\n";
+    sys_write(2, msg, sizeof(msg) - 1);
+    return 2;
+}
+
+int main(int argc, char **argv) {
+    opt.budget = DEFAULT_BUDGET;
+    opt.tmpdir = "/tmp";
+    for (char **e = environ; e != NULL && *e; e++) {
+        if (Memcmp(*e, "TMPDIR=", 7) == 0 && (*e)[7]) {
+            opt.tmpdir = *e + 7;
+        }
+    }
+
+    int first = 1;
+    for (; first < argc && argv[first][0] == '-' && argv[first][1] != 0; first++) {
+        for (const char *f = argv[first] + 1; *f; f++) {
+            switch (*f) {
+            case 'n': opt.numeric = true; break;
+            case 'r': opt.reverse = true; break;
+            case 'u': opt.unique = true; break;
+            case 'k':
+            case 'S': {
+                // the value is the rest of this argument, or the next one.
+                const char *v = f[1] ? f + 1 : argv[++first];
+                if (first >= argc || v == NULL) {
+                    return usage();
+                }
+                if (*f == 'S') {
+                    opt.budget = parse_size(v);
+                } else {
+                    // atoi() would skip the comma.
+                    v = parse_field(&opt.kbeg, v);
+                    opt.kend = 0;
+                    if (*v == ',') {
+                        parse_field(&opt.kend, v + 1);
+                    }
+                    if (opt.kbeg <= 0) {
+                        return usage();
+                    }
+                }
+                f = " ";  // done with this argument
+                break;
+            }
+            default: return usage();
+            }
+            if (*f == ' ') {
+                break;
+            }
+        }
+    }
+    if (opt.budget < 2 * PART_MIN) {
+        opt.budget = 2 * PART_MIN;
+    }
+
+    if (!arena_init(&batch.recs, 1ul << 36)) {
+        die("out of memory");
+    }
+    out.buf = map_anon(OUTBUF);
+
+    if (first == argc) {
+        add_input(NULL);
+    }
+    for (int i = first; i < argc; i++) {
+        add_input(Strcmp(argv[i], "-") == 0 ? NULL : argv[i]);
+    }
+
+    if (runs.n == 0) {
+        // everything fit: merge the sorted parts straight to stdout.
+        sort_batch();
+        merge_batch(1);
+        return 0;
+    }
+
+    spill();
+    static struct cursor cur[MAXRUN];
+    for (int i = 0; i < runs.n; i++) {
+        Memset(&cur[i], 0, sizeof(cur[i]));
+        if (runs.size[i] == 0) {
+            continue;
+        }
+        const char *p = sys_mmap(NULL, runs.size[i], PROT_READ, MAP_PRIVATE, runs.fd[i], 0);
+        if ((long)p < 0) {
+            die("cannot map run");
+        }
+        cur[i].p = p;
+        cur[i].e = p + runs.size[i];
+    }
+    out_begin(1);
+    merge(cur, runs.n);
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include "sorting.h"
+
+#define INSERTION_MAX 16
+
+static void insertion_sort(void **a, size_t n, int (*cmp)(const void *, const void *)) {
+    for (size_t i = 1; i < n; i++) {
+        void *v = a[i];
+        size_t j = i;
+        for (; j > 0 && cmp(a[j - 1], v) > 0; j--) {
+            a[j] = a[j - 1];
+        }
+        a[j] = v;
+    }
+}
+
+static void sift_down(void **a, size_t root, size_t n,
+                      int (*cmp)(const void *, const void *)) {
+    for (;;) {
+        size_t child = 2 * root + 1;
+        if (child >= n) {
+            return;
+        }
+        if (child + 1 < n && cmp(a[child], a[child + 1]) < 0) {
+            child++;
+        }
+        if (cmp(a[root], a[child]) >= 0) {
+            return;
+        }
+        void *t = a[root];
+        a[root] = a[child];
+        a[child] = t;
+        root = child;
+    }
+}
+
+static void heap_sort(void **a, size_t n, int (*cmp)(const void *, const void *)) {
+    for (size_t i = n / 2; i > 0; i--) {
+        sift_down(a, i - 1, n, cmp);
+    }
+    for (size_t end = n - 1; end > 0; end--) {
+        void *t = a[0];
+        a[0] = a[end];
+        a[end] = t;
+        sift_down(a, 0, end, cmp);
+    }
+}
+
+static void intro_sort(void **a, size_t n, int depth,
+                       int (*cmp)(const void *, const void *)) {
+    while (n > INSERTION_MAX) {
+        if (depth-- == 0) {
+            heap_sort(a, n, cmp);
+            return;
+        }
+
+        // median of three goes to a[0] as the pivot
+        size_t mid = n / 2;
+        void *t;
+        if (cmp(a[mid], a[0]) < 0) { t = a[mid]; a[mid] = a[0]; a[0] = t; }
+        if (cmp(a[n - 1], a[0]) < 0) { t = a[n - 1]; a[n - 1] = a[0]; a[0] = t; }
+        if (cmp(a[n - 1], a[mid]) < 0) { t = a[n - 1]; a[n - 1] = a[mid]; a[mid] = t; }
+        t = a[mid]; a[mid] = a[0]; a[0] = t;
+
+        // Hoare partition around a[0]
+        void *pivot = a[0];
+        size_t i = 0, j = n;
+        for (;;) {
+            do { i++; } while (i < n && cmp(a[i], pivot) < 0);
+            do { j--; } while (cmp(a[j], pivot) > 0);
+            if (i >= j) {
+                break;
+            }
+            t = a[i]; a[i] = a[j]; a[j] = t;
+        }
+        a[0] = a[j];
+        a[j] = pivot;
+
+        // recurse into the smaller half, loop on the larger one
+        if (j < n - j - 1) {
+            intro_sort(a, j, depth, cmp);
+            a += j + 1;
+            n -= j + 1;
+        } else {
+            intro_sort(a + j + 1, n - j - 1, depth, cmp);
+            n = j;
+        }
+    }
+    insertion_sort(a, n, cmp);
+}
+
+void sort_ptr(void **base, size_t n, int (*cmp)(const void *, const void *)) {
+    int depth = 0;
+    for (size_t m = n; m > 1; m >>= 1) {
+        depth += 2;
+    }
+    intro_sort(base, n, depth, cmp);
+}
+
+void radix_sort(struct sort_key *a, struct sort_key *tmp, size_t n) {
+    size_t count[256];
+    struct sort_key *src = a;
+    struct sort_key *dst = tmp;
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        for (int i = 0; i < 256; i++) {
+            count[i] = 0;
+        }
+        for (size_t i = 0; i < n; i++) {
+            count[(src[i].key >> shift) & 0xff]++;
+        }
+        // every key has the same byte here: nothing to do.
+        if (n == 0 || count[(src[0].key >> shift) & 0xff] == n) {
+            continue;
+        }
+
+        size_t sum = 0;
+        for (int i = 0; i < 256; i++) {
+            size_t c = count[i];
+            count[i] = sum;
+            sum += c;
+        }
+        for (size_t i = 0; i < n; i++) {
+            dst[count[(src[i].key >> shift) & 0xff]++] = src[i];
+        }
+
+        struct sort_key *t = src;
+        src = dst;
+        dst = t;
+    }
+
+    if (src != a) {
+        for (size_t i = 0; i < n; i++) {
+            a[i] = src[i];
+        }
+    }
+}
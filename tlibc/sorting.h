@@ -0,0 +1,22 @@
+#ifndef _SORTING_H_
+#define _SORTING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Introsort over an array of pointers: quicksort with median-of-3,
+ * falling back to heapsort when recursion gets too deep and to
+ * insertion sort for short ranges. Not stable. */
+extern void sort_ptr(void **base, size_t n, int (*cmp)(const void *, const void *));
+
+/** An integer key and the record it belongs to. */
+struct sort_key {
+    uint64_t key;
+    void *ptr;
+};
+
+/** Stable LSD radix sort on key, ascending. tmp must hold n entries.
+ * Byte positions where all keys agree are skipped. */
+extern void radix_sort(struct sort_key *a, struct sort_key *tmp, size_t n);
+
+#endif // _SORTING_H_
@@ -0,0 +1,318 @@
+#include "std.h"
+#include "spawn.h"
+
+#define STACK_SIZE 65536
+#define FORK_STACK_SIZE (8 << 20)   // what a program gets from the kernel
+
+/** What the child needs; on the caller's stack, which it shares. */
+struct child {
+    const struct spawn *sp;
+    char **argv;
+    int errfd;          // write end of the error pipe, -1 for spawn_fork
+    int (*fn)(int argc, char **argv);   // spawn_fork: run this, not argv[0]
+};
+
+/** What the child sends back through the error pipe when it fails. */
+struct failure {
+    int err;
+    int step;       // the action, or SPAWN_*
+};
+
+// the child runs here; the caller is suspended meanwhile, or forked.
+static char stack[STACK_SIZE] __attribute__((aligned(16)));
+
+static int add(struct spawn *sp, struct spawn_action act) {
+    if (sp->nact == SPAWN_MAX_ACTIONS) {
+        return -ENOMEM;
+    }
+    sp->act[sp->nact++] = act;
+    return 0;
+}
+
+void spawn_init(struct spawn *sp) {
+    sp->nact = 0;
+    sp->pgroup = -1;
+    sp->tty = -1;
+    sp->setmask = false;
+    sp->envp = NULL;
+    sp->cpus = NULL;
+    sp->nice = 0;
+    sp->policy = -1;
+    sp->failed = SPAWN_EXEC;
+}
+
+void spawn_setpgroup(struct spawn *sp, int pgid) {
+    sp->pgroup = pgid;
+}
+
+void spawn_settty(struct spawn *sp, int tty) {
+    sp->tty = tty;
+}
+
+void spawn_setsigmask(struct spawn *sp, uint64_t mask) {
+    sp->setmask = true;
+    sp->sigmask = mask;
+}
+
+void spawn_setenv(struct spawn *sp, char **envp) {
+    sp->envp = envp;
+}
+
+void spawn_setaffinity(struct spawn *sp, const uint64_t *cpus, int words) {
+    sp->cpus = cpus;
+    sp->cpu_words = words;
+}
+
+void spawn_setnice(struct spawn *sp, int inc) {
+    sp->nice += inc;
+}
+
+void spawn_setscheduler(struct spawn *sp, int policy, int priority) {
+    sp->policy = policy;
+    sp->priority = priority;
+}
+
+int spawn_open(struct spawn *sp, int fd, const char *path, int flags, int mode) {
+    return add(sp, (struct spawn_action){
+        .op = SPAWN_OPEN, .fd = fd, .path = path, .flags = flags, .mode = mode,
+    });
+}
+
+int spawn_dup2(struct spawn *sp, int fd, int newfd) {
+    return add(sp, (struct spawn_action){
+        .op = SPAWN_DUP2, .fd = fd, .newfd = newfd,
+    });
+}
+
+int spawn_close(struct spawn *sp, int fd) {
+    return add(sp, (struct spawn_action){
+        .op = SPAWN_CLOSE, .fd = fd,
+    });
+}
+
+int spawn_fchdir(struct spawn *sp, int fd) {
+    return add(sp, (struct spawn_action){
+        .op = SPAWN_FCHDIR, .fd = fd,
+    });
+}
+
+static int apply(const struct spawn_action *a) {
+    int r;
+    switch (a->op) {
+    case SPAWN_OPEN:
+        r = sys_openat_mode(AT_FDCWD, a->path, a->flags, a->mode);
+        if (r >= 0 && r != a->fd) {
+            int fd = r;
+            r = sys_dup2(fd, a->fd);
+            sys_close(fd);
+        }
+        return r < 0 ? r : 0;
+    case SPAWN_DUP2:
+        r = sys_dup2(a->fd, a->newfd);
+        return r < 0 ? r : 0;
+    case SPAWN_CLOSE:
+        sys_close(a->fd);
+        return 0;
+    case SPAWN_FCHDIR:
+        return sys_fchdir(a->fd);
+    }
+    return -EINVAL;
+}
+
+/** What execve would do to the fds: a spawn_fork child runs on
+ * without one, and must not keep the other ends of its pipes open. */
+static void close_on_exec(void) {
+    int dir = sys_openat(AT_FDCWD, "/proc/self/fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir < 0) {
+        // no /proc: try every fd a process has by default.
+        for (int fd = 3; fd < 1024; fd++) {
+            int fl = sys_fcntl(fd, F_GETFD, 0);
+            if (fl >= 0 && (fl & FD_CLOEXEC)) {
+                sys_close(fd);
+            }
+        }
+        return;
+    }
+    char buf[1024] __attribute__((aligned(8)));
+    long n;
+    while ((n = sys_getdents64(dir, (struct linux_dirent64 *)buf, sizeof(buf))) > 0) {
+        for (long off = 0; off < n; ) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + off);
+            off += d->d_reclen;
+            if (d->d_name[0] < '0' || d->d_name[0] > '9') {
+                continue;
+            }
+            int fd = 0;
+            for (const char *p = d->d_name; *p; p++) {
+                fd = fd * 10 + (*p - '0');
+            }
+            int fl = sys_fcntl(fd, F_GETFD, 0);
+            if (fd != dir && fl >= 0 && (fl & FD_CLOEXEC)) {
+                sys_close(fd);
+            }
+        }
+    }
+    sys_close(dir);
+}
+
+/** The child's CPUs, policy and nice value, as sp asks. */
+static int sched(const struct spawn *sp) {
+    int err = 0;
+    if (sp->cpus != NULL) {
+        err = sys_sched_setaffinity(0, sp->cpu_words * sizeof(uint64_t), sp->cpus);
+    }
+    if (err == 0 && sp->policy >= 0) {
+        struct sched_param param = {sp->priority};
+        err = sys_sched_setscheduler(0, sp->policy, &param);
+    }
+    if (err == 0 && sp->nice != 0) {
+        // relative to what it has from us; the kernel clamps it.
+        int nice = 20 - sys_getpriority(PRIO_PROCESS, 0) + sp->nice;
+        err = sys_setpriority(PRIO_PROCESS, 0, nice);
+    }
+    return err;
+}
+
+/** A spawn_fork child's word on the action a that failed with err:
+ * there is no one waiting to hear it. */
+static void action_failed(const char *name, const struct spawn_action *a, int err) {
+    char buf[64];
+    sys_write(2, name, Strlen(name));
+    if (a->op == SPAWN_OPEN) {
+        sys_write(2, ": ", 2);
+        sys_write(2, a->path, Strlen(a->path));
+        sys_write(2, buf, Sprintf(buf, ": %s\n", Strerror(err)));
+    } else {
+        sys_write(2, buf, Sprintf(buf, ": %d: %s\n", a->fd, Strerror(err)));
+    }
+}
+
+/** The child: runs in the caller's memory while the caller sleeps, so
+ * it only changes its own fd table, and the command hash on purpose.
+ * For spawn_fork it has a copy of the memory instead. */
+static int child_main(void *arg) {
+    struct child *c = arg;
+    int err = 0;
+    int step = SPAWN_SETUP;
+    if (c->sp != NULL && c->sp->pgroup >= 0) {
+        err = sys_setpgid(0, c->sp->pgroup);
+    }
+    if (err == 0 && c->sp != NULL && c->sp->tty >= 0) {
+        // a background group may only take the terminal with SIGTTOU
+        // ignored; the handlers are the child's own, not the caller's.
+        static const struct sigaction ign = {.sa_handler = SIG_IGN};
+        static const struct sigaction dfl = {.sa_handler = SIG_DFL};
+        int pgid = sys_getpgid(0);
+        sys_rt_sigaction(SIGTTOU, &ign, NULL, sizeof(uint64_t));
+        err = sys_ioctl(c->sp->tty, TIOCSPGRP, (unsigned long)&pgid);
+        sys_rt_sigaction(SIGTTOU, &dfl, NULL, sizeof(uint64_t));
+    }
+    if (err == 0 && c->sp != NULL) {
+        err = sched(c->sp);
+    }
+    if (err == 0 && c->sp != NULL && c->sp->setmask) {
+        err = sys_rt_sigprocmask(SIG_SETMASK, &c->sp->sigmask, NULL, sizeof(uint64_t));
+    }
+    for (int i = 0; c->sp != NULL && i < c->sp->nact && err == 0; i++) {
+        step = i;
+        err = apply(&c->sp->act[i]);
+    }
+    char **envp = c->sp != NULL && c->sp->envp != NULL ? c->sp->envp : environ;
+    if (err == 0 && c->fn != NULL) {
+        // a fork: environ is its own to change.
+        environ = envp;
+        close_on_exec();
+        int argc = 0;
+        while (c->argv[argc] != NULL) {
+            argc++;
+        }
+        sys_exit(c->fn(argc, c->argv));
+    }
+    if (err == 0) {
+        step = SPAWN_EXEC;
+        err = Execvpe(c->argv[0], c->argv, envp);
+    }
+    if (c->errfd >= 0) {
+        struct failure f = {err, step};
+        sys_write(c->errfd, (const char *)&f, sizeof(f));
+    } else if (step >= 0) {
+        action_failed(c->argv[0], &c->sp->act[step], err);
+    }
+    // a redirection that fails is the command's failure, as in a shell.
+    sys_exit(step >= 0 ? 1 : err == -ENOENT ? 127 : 126);
+}
+
+/** Clone a child that execs argv with clone flags on top of the
+ * vfork ones; *err as spawn_sibling. */
+static int start(struct spawn *sp, char **argv, unsigned long flags, int *err) {
+    *err = 0;
+    int pip[2];
+    int r = sys_pipe2(pip, O_CLOEXEC);
+    if (r < 0) {
+        return r;
+    }
+    struct child c = {
+        .sp = sp,
+        .argv = argv,
+        .errfd = pip[1],
+    };
+    int pid = sys_clone(child_main, stack + sizeof(stack),
+                        CLONE_VM | CLONE_VFORK | SIGCHLD | flags, &c, NULL);
+    sys_close(pip[1]);
+    if (pid < 0) {
+        sys_close(pip[0]);
+        return pid;
+    }
+
+    // nothing to read but EOF once the exec closed the pipe.
+    struct failure f;
+    long n = sys_read(pip[0], (char *)&f, sizeof(f));
+    sys_close(pip[0]);
+    if (n == sizeof(f)) {
+        *err = f.err;
+        if (sp != NULL) {
+            sp->failed = f.step;
+        }
+    }
+    return pid;
+}
+
+int spawn(struct spawn *sp, char **argv) {
+    int err;
+    int pid = start(sp, argv, 0, &err);
+    if (pid > 0 && err < 0) {
+        sys_wait4(pid, NULL, 0, NULL);
+        return err;
+    }
+    return pid;
+}
+
+int spawn_sibling(struct spawn *sp, char **argv, int *err) {
+    return start(sp, argv, CLONE_PARENT, err);
+}
+
+int spawn_fork(const struct spawn *sp, int (*fn)(int argc, char **argv), char **argv) {
+    struct child c = {
+        .sp = sp,
+        .argv = argv,
+        .errfd = -1,
+        .fn = fn,
+    };
+    // fn may be a whole program (the multi-call build): give it a stack
+    // like one, touched only as it grows. The child has its own copy of
+    // the mapping once forked.
+    char *big = sys_mmap(NULL, FORK_STACK_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ((long)big < 0) {
+        return (long)big;
+    }
+    // without CLONE_VM this is a fork, on both architectures.
+    int pid = sys_clone(child_main, big + FORK_STACK_SIZE, SIGCHLD, &c, NULL);
+    sys_munmap(big, FORK_STACK_SIZE);
+    if (pid > 0 && sp != NULL && sp->pgroup >= 0) {
+        // the child does the same, but may not have yet: whoever waits
+        // for the group next must find it there.
+        sys_setpgid(pid, sp->pgroup > 0 ? sp->pgroup : pid);
+    }
+    return pid;
+}
@@ -0,0 +1,99 @@
+#ifndef _SPAWN_H_
+#define _SPAWN_H_
+
+/** posix_spawn for tlibc. The child is a clone(CLONE_VM | CLONE_VFORK)
+ * on a small stack of its own: no page tables are copied, and the
+ * caller sleeps until the child has called execve. The file actions
+ * run in the child, in order, before the exec. An exec that fails is
+ * reported to the caller through a close-on-exec pipe.
+ *
+ * Only one thread may spawn at a time; the child stack is shared. */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SPAWN_MAX_ACTIONS 16
+
+enum {
+    SPAWN_OPEN,
+    SPAWN_DUP2,
+    SPAWN_CLOSE,
+    SPAWN_FCHDIR,
+};
+
+/** Where a spawn that failed stopped, in struct spawn's failed when
+ * it is not the index of an action. */
+#define SPAWN_EXEC (-1)     // running the program, or anything unnamed
+#define SPAWN_SETUP (-2)    // the group, terminal, scheduling or mask
+
+struct spawn_action {
+    int op;
+    int fd;
+    int newfd;          // SPAWN_DUP2
+    const char *path;   // SPAWN_OPEN
+    int flags;
+    int mode;
+};
+
+struct spawn {
+    struct spawn_action act[SPAWN_MAX_ACTIONS];
+    int nact;
+    int pgroup;         // process group to join, 0 for a new one, -1 to stay
+    int tty;            // terminal to give the child's group, or -1
+    bool setmask;       // give the child sigmask as its blocked signals
+    uint64_t sigmask;
+    char **envp;        // the child's environment, NULL for environ
+    const uint64_t *cpus;   // the CPUs it may run on, NULL for ours
+    int cpu_words;          // the words of cpus
+    int nice;               // added to its nice value
+    int policy;             // its SCHED_* policy, -1 for ours
+    int priority;           // its priority under policy
+    int failed;             // set by a spawn that fails: the action, or SPAWN_*
+};
+
+extern void spawn_init(struct spawn *sp);
+
+/** Put the child into process group pgid, or a new one of its own for
+ * 0, before any action runs. */
+extern void spawn_setpgroup(struct spawn *sp, int pgid);
+/** Make the child's process group the foreground one of terminal tty. */
+extern void spawn_settty(struct spawn *sp, int tty);
+/** Block the signals in mask in the child, instead of what the caller
+ * blocks. */
+extern void spawn_setsigmask(struct spawn *sp, uint64_t mask);
+/** Give the child envp as its environment; NULL for environ. */
+extern void spawn_setenv(struct spawn *sp, char **envp);
+/** Let the child run only on the CPUs set in the words of cpus, which
+ * must live until the spawn. */
+extern void spawn_setaffinity(struct spawn *sp, const uint64_t *cpus, int words);
+/** Add inc to the child's nice value, as nice(1) does. */
+extern void spawn_setnice(struct spawn *sp, int inc);
+/** Give the child scheduling policy SCHED_* at priority. */
+extern void spawn_setscheduler(struct spawn *sp, int policy, int priority);
+
+/** Open path onto fd in the child. Returns 0, or -ENOMEM when full. */
+extern int spawn_open(struct spawn *sp, int fd, const char *path, int flags, int mode);
+extern int spawn_dup2(struct spawn *sp, int fd, int newfd);
+extern int spawn_close(struct spawn *sp, int fd);
+/** Make the directory open on fd the child's working directory. */
+extern int spawn_fchdir(struct spawn *sp, int fd);
+
+/** Run argv[0], searched for as Execve does, with sp's actions (sp may
+ * be NULL). Returns the pid, or a negative errno: the one of the first
+ * action or exec that failed, the child already reaped then, and
+ * sp->failed what failed. */
+extern int spawn(struct spawn *sp, char **argv);
+
+/** Like spawn, but the child is cloned with CLONE_PARENT: it is our
+ * parent's child, for a helper that spawns on its parent's behalf.
+ * *err gets 0, or the errno of the action or exec that failed, with
+ * sp->failed set; the child is left for our parent to reap either way. */
+extern int spawn_sibling(struct spawn *sp, char **argv, int *err);
+
+/** Like spawn, but the child is a fork that returns from fn(argc,
+ * argv) instead of running a program, for code that must not hold the
+ * caller up: it may block, on a pipe for instance. A child whose
+ * actions fail says so on its stderr, as argv[0], and exits 1. */
+extern int spawn_fork(const struct spawn *sp, int (*fn)(int argc, char **argv), char **argv);
+
+#endif // _SPAWN_H_
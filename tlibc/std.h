@@ -31,24 +31,100 @@ extern unsigned int Printf(const char *fmt, ...);
 
 extern size_t Strlen(const char *fmt);
 extern char *Strcpy(char *dst, const char *src);
+extern int Strcmp(const char *s1, const char *s2);
 extern void *Memset(void *addr, int val, size_t len);
+extern void *Memcpy(void *dst, const void *src, size_t len);
+extern void *Memmove(void *dst, const void *src, size_t len);
+extern int Memcmp(const void *s1, const void *s2, size_t len);
+extern void *Memchr(const void *addr, int ch, size_t len);
+extern void *Memrchr(const void *addr, int ch, size_t len);
+/** What errno err (or -err, as the sys_ calls return it) means. */
+extern const char *Strerror(int err);
+
+#ifdef __X86_64__
+/** 16 bytes compared at once; pmovmskb turns the result into a bitmask. */
+typedef char v16 __attribute__((vector_size(16)));
+typedef char v16u __attribute__((vector_size(16), aligned(1)));
+
+static inline unsigned mask16(v16 v) {
+    return __builtin_ia32_pmovmskb128(v);
+}
+
+static inline v16 splat16(char c) {
+    return (v16){c, c, c, c, c, c, c, c, c, c, c, c, c, c, c, c};
+}
+#endif
+
+/** fnmatch.h */
+
+extern bool Fnmatch(const char *pat, const char *s);
 
 /** stdlib.h */
 
 extern int atoi(const char *nptr);
+extern char *Getenv(const char *name);
+/** How a command is scheduled: what taskset, nice and chrt in front
+ * of it ask for. */
+#define SCHED_CPU_WORDS 16  // 1024 CPUs
+struct sched {
+    uint64_t cpus[SCHED_CPU_WORDS];
+    int cpu_words;      // 0 to keep ours
+    int nice;           // added to ours
+    int policy;         // SCHED_*, -1 to keep ours
+    int priority;
+};
+
+/** A redirection of a job: fd opened from path, or made a copy of
+ * from. A job's apply in order, after its pipes. */
+struct redir {
+    int fd;             // 0, 1 or 2
+    int from;           // dup2 this onto fd, or -1 to open path
+    const char *path;
+    int flags;          // for opening path
+};
+
 typedef struct job {
-    char *stdin_fo;   // redirent stdin to
-    char *stdout_fo;  // redirent stdout to
-    char *stderr_fo;  // redirent stderr to
+    struct redir *redirs;   // nredir of them
+    int nredir;
+    int stdin_fd;     // a here-document among them, to close if > 0
     char *exe;     // executable
-    char *argv[64];   // argv
-    int used;         // # bytes in the buffer
+    char **argv;      // argv, NULL-terminated
     bool pipe;        // pipe to next prog?
-    char buf[3545];  // buffer to store some data
+    int pid;          // set by exec_job, -1 if it could not start
+    int status;       // exit status, 128 + signal if killed
+    int (*builtin)(int argc, char **argv);  // run in a fork instead of exe
+    char **envp;      // environment, NULL for environ
+    const struct sched *sched;  // NULL to schedule it as we are
 } job_t;
 
-extern void Execve(char *exe, char **argv);
-extern int exec_job(job_t *job, int cnt);
+/** Run exe, searched for in PATH unless it has a slash; returns
+ * only if it could not, with a negative errno. */
+extern int Execve(char *exe, char **argv);
+/** Execve with envp as the environment instead of environ. */
+extern int Execvpe(char *exe, char **argv, char **envp);
+/** The command hash: where PATH leads to name, remembered. NULL if
+ * name is not found. */
+extern const char *hash_lookup(const char *name);
+extern void hash_forget(const char *name);
+extern void hash_reset(void);
+/** Print the hash as the hash builtin does. */
+extern void hash_list(void);
+/** exec_job: the status is the last failed command's, not the last's. */
+#define EXEC_PIPEFAIL 1
+/** exec_job: start the pipeline with stdin from /dev/null and return
+ * its process group at once; the caller reaps it. */
+#define EXEC_BACKGROUND 2
+/** exec_job: have the zygote helper spawn the programs; see zygote.h.
+ * The caller must have started it. */
+#define EXEC_ZYGOTE 4
+
+/** Run a pipeline in a process group of its own and wait for all of
+ * it. Returns the exit status of the last command (128 + signal if
+ * killed); ru, if not NULL, gets the resources the pipeline used. */
+extern int exec_job(job_t *job, int cnt, int flags, struct rusage *ru);
+/** Run argv in the background: returns the child's pid, or a negative
+ * errno if it could not be started. */
+extern int exec_async(char **argv);
 extern int system(const char *cmd);
 
 /** fcntl.h */
@@ -57,6 +133,9 @@ extern int system(const char *cmd);
 /** mman.h */
 #include "mman.h"
 
+/** errno.h */
+#include "errno.h"
+
 /** assert.h */
 #define Assert(cond) \
     do {  \
@@ -20,9 +20,9 @@ void Puts(const char *s)
 static bool fill_buf(struct buffered_reader *br, int fd) {
     if (br->start == br->end) {
         br->start = br->end = 0;
-        // fill the queue
+        // fill the queue; a full one would look empty.
         char *cp = br->buf;
-        long ret = sys_read(fd, cp, sizeof(br->buf));
+        long ret = sys_read(fd, cp, sizeof(br->buf) - 1);
 
         // EOF
         if (ret <= 0) {
@@ -239,10 +239,10 @@ static unsigned int putl(char *dst, long val)
     }
 
     int i = 0;
-    while (v > 0) {
+    do {
         buf[i++] = digits[v % 0xa];
         v /= 0xa;
-    }
+    } while (v > 0);
     while (i > 0) {
         i--;
         dst[ret++] = buf[i];
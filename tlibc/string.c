@@ -27,3 +27,114 @@ char *Strcpy(char *dst, const char *src) {
     *dst = '\0';
     return dst;
 }
+
+int Strcmp(const char *s1, const char *s2) {
+    while (*s1 != 0 && *s2 != 0) {
+        if (*s1 != *s2) {
+            break;
+        }
+        s1 ++;
+        s2 ++;
+    }
+
+    return (int)(unsigned char)*s1 - (int)(unsigned char)*s2;
+}
+
+void *Memcpy(void *dst, const void *src, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        ((uint8_t *)dst)[i] = ((const uint8_t *)src)[i];
+    }
+    return dst;
+}
+
+void *Memmove(void *dst, const void *src, size_t len) {
+    if (dst <= src) {
+        return Memcpy(dst, src, len);
+    }
+    while (len > 0) {
+        len--;
+        ((uint8_t *)dst)[len] = ((const uint8_t *)src)[len];
+    }
+    return dst;
+}
+
+int Memcmp(const void *s1, const void *s2, size_t len) {
+    const uint8_t *a = s1;
+    const uint8_t *b = s2;
+    for (size_t i = 0; i < len; i++) {
+        if (a[i] != b[i]) {
+            return (int)a[i] - (int)b[i];
+        }
+    }
+    return 0;
+}
+
+#ifdef __X86_64__
+static inline unsigned match16(const uint8_t *p, uint8_t ch) {
+    return mask16(*(const v16u *)p == splat16(ch));
+}
+#endif
+
+void *Memchr(const void *addr, int ch, size_t len) {
+    const uint8_t *p = addr;
+    size_t i = 0;
+#ifdef __X86_64__
+    for (; i + 16 <= len; i += 16) {
+        unsigned m = match16(p + i, ch);
+        if (m != 0) {
+            return (void *)(p + i + __builtin_ctz(m));
+        }
+    }
+#endif
+    for (; i < len; i++) {
+        if (p[i] == (uint8_t)ch) {
+            return (void *)(p + i);
+        }
+    }
+    return NULL;
+}
+
+void *Memrchr(const void *addr, int ch, size_t len) {
+    const uint8_t *p = addr;
+#ifdef __X86_64__
+    for (; len >= 16; len -= 16) {
+        unsigned m = match16(p + len - 16, ch);
+        if (m != 0) {
+            return (void *)(p + len - 16 + 31 - __builtin_clz(m));
+        }
+    }
+#endif
+    while (len > 0) {
+        if (p[--len] == (uint8_t)ch) {
+            return (void *)(p + len);
+        }
+    }
+    return NULL;
+}
+
+const char *Strerror(int err) {
+    static const char *const msgs[] = {
+        [EPERM] = "Operation not permitted",
+        [ENOENT] = "No such file or directory",
+        [EIO] = "Input/output error",
+        [ENOEXEC] = "Exec format error",
+        [EBADF] = "Bad file descriptor",
+        [ENOMEM] = "Cannot allocate memory",
+        [EACCES] = "Permission denied",
+        [EEXIST] = "File exists",
+        [ENOTDIR] = "Not a directory",
+        [EISDIR] = "Is a directory",
+        [EINVAL] = "Invalid argument",
+        [EMFILE] = "Too many open files",
+        [ETXTBSY] = "Text file busy",
+        [ENOSPC] = "No space left on device",
+        [EROFS] = "Read-only file system",
+        [ENAMETOOLONG] = "File name too long",
+        [ELOOP] = "Too many levels of symbolic links",
+    };
+    err = err < 0 ? -err : err;
+    if (err < (int)(sizeof(msgs) / sizeof(msgs[0])) && msgs[err] != NULL) {
+        return msgs[err];
+    }
+    return "Unknown error";
+}
@@ -12,7 +12,11 @@
 /** State Machine Operation */
 
 extern void sys_exit(int code) __attribute__((noreturn));
-extern void sys_execve(char *exe, char **argv, char **env);
+/** Only returns on failure, with a negative errno. */
+extern int sys_execve(const char *exe, char **argv, char **env);
+
+/** The environment main got, set up before it is called. */
+extern char **environ;
 
 extern int sys_vfork(void);
 
@@ -33,20 +37,91 @@ static inline int sys_fork(void) {
 extern void sys_pause(void);
 extern int sys_waitid(uint32_t idtype, uint32_t id, siginfo_t *infop, int options);
 extern int sys_kill(int pid, int sig);
+extern int sys_setpgid(int pid, int pgid);
+extern int sys_getpgid(int pid);
+
+#define SIGINT 2
+#define SIGQUIT 3
+#define SIGKILL 9
+#define SIGPIPE 13
+#define SIGTERM 15
+#define SIGCHLD 17
+#define SIGCONT 18
+#define SIGSTOP 19
+#define SIGTSTP 20
+#define SIGTTIN 21
+#define SIGTTOU 22
+
+#define SIG_DFL ((void (*)(int))0)
+#define SIG_IGN ((void (*)(int))1)
+
+/** The kernel's struct sigaction; handlers other than SIG_DFL and
+ * SIG_IGN would need a restorer. */
+struct sigaction {
+    void (*sa_handler)(int);
+    unsigned long sa_flags;
+    void (*sa_restorer)(void);
+    uint64_t sa_mask;
+};
+
+extern int sys_rt_sigaction(int sig, const struct sigaction *act,
+                            struct sigaction *old, size_t setsize);
+
+/** Signal sets are one word: bit sig - 1 for each signal. */
+#define SIGMASK(sig) (1ull << ((sig) - 1))
+
+#define SIG_BLOCK 0
+#define SIG_UNBLOCK 1
+#define SIG_SETMASK 2
+extern int sys_rt_sigprocmask(int how, const uint64_t *set, uint64_t *old, size_t setsize);
+
+/** Read the blocked signals in mask as 128-byte siginfos from an fd. */
+#define SFD_NONBLOCK 04000
+#define SFD_CLOEXEC 02000000
+extern int sys_signalfd4(int fd, const uint64_t *mask, size_t setsize, int flags);
 extern int sys_getpid(void);
 
+#define PR_SET_CHILD_SUBREAPER 36
+extern int sys_prctl(int option, unsigned long arg2, unsigned long arg3,
+                     unsigned long arg4, unsigned long arg5);
+
+/** Scheduling, of the caller for pid 0: the CPUs it may run on, a
+ * bitmap of size bytes; its nice value; its policy. */
+extern int sys_sched_setaffinity(int pid, size_t size, const uint64_t *mask);
+#define PRIO_PROCESS 0
+/** Returns 20 - nice, never negative: 1 to 40. */
+extern int sys_getpriority(int which, int who);
+extern int sys_setpriority(int which, int who, int nice);
+
+#define SCHED_OTHER 0
+#define SCHED_FIFO 1
+#define SCHED_RR 2
+#define SCHED_BATCH 3
+#define SCHED_IDLE 5
+struct sched_param {
+    int sched_priority;
+};
+extern int sys_sched_setscheduler(int pid, int policy, const struct sched_param *param);
+
 struct timespec {
     long tv_sec;  // seconds
     long tv_nsec;  // nanoseconds
 };
 extern int sys_nanosleep(const struct timespec *req, struct timespec *rem);
 
+#define CLOCK_REALTIME 0
+#define CLOCK_MONOTONIC 1
+extern int sys_clock_gettime(int clk, struct timespec *tp);
+
 /** System IO */
 
 extern int sys_chdir(const char *path);
+extern int sys_fchdir(int fd);
 extern char *sys_getcwd(char *buf, size_t siz);
 extern long sys_write(int fd, const char *buf, size_t cnt);
 extern long sys_read(int fd, char *buf, size_t cnt);
+extern long sys_pread(int fd, char *buf, size_t cnt, long off);
+extern long sys_pwrite(int fd, const char *buf, size_t cnt, long off);
 
 // Handle sys_open differently.
 #ifdef __X86_64__
@@ -54,8 +129,9 @@ extern int sys_openat(int dirfd, const char *path, uint64_t mode);
 extern int sys_open(const char *path, uint64_t mode);
 #endif // __X86_64__
 
-#ifdef __AARCH64__
 #define AT_FDCWD (-100)
+
+#ifdef __AARCH64__
 extern int sys_openat(int dirfd, const char *path, uint64_t mode);
 
 static inline int sys_open(const char *path, uint64_t mode) {
@@ -63,31 +139,220 @@ static inline int sys_open(const char *path, uint64_t mode) {
                         : sys_openat(AT_FDCWD, path, mode); 
 }
 #endif // __AARCH64__
+/** sys_openat with the permissions of a file created by O_CREAT/O_TMPFILE. */
+extern int sys_openat_mode(int dirfd, const char *path, uint64_t flags, int mode);
+extern int sys_unlinkat(int dirfd, const char *path, int flags);
 extern void sys_close(int fd);
 extern long sys_lseek(int fd, long off, int whence);
 extern int sys_dup(int fd);
 extern int sys_dup2(int oldfd, int newfd);
 extern int sys_pipe(int *pip);
+extern int sys_pipe2(int *pip, int flags);
+/** A file in memory only, gone with its last fd. */
+extern int sys_memfd_create(const char *name, unsigned flags);
+#define MFD_CLOEXEC 0x0001U
 extern int sys_link(const char *oldpath, const char *newpath);
 extern int sys_mkdir(const char *path, int mode);
+extern int sys_ftruncate(int fd, long length);
+extern int sys_fchmodat(int dirfd, const char *path, int mode);
+extern int sys_fchmod(int fd, int mode);
+extern long sys_readlinkat(int dirfd, const char *path, char *buf, size_t siz);
+extern int sys_symlinkat(const char *target, int dirfd, const char *path);
+extern int sys_ioctl(int fd, unsigned long req, unsigned long arg);
+#define TIOCGPGRP 0x540F    // the terminal's foreground process group
+#define TIOCSPGRP 0x5410
+extern int sys_fcntl(int fd, int cmd, unsigned long arg);
+
+/** Pipe to pipe duplication and pipe to/from fd moves, in the kernel. */
+#define SPLICE_F_MOVE     1
+#define SPLICE_F_NONBLOCK 2
+#define SPLICE_F_MORE     4
+extern long sys_tee(int fd_in, int fd_out, size_t len, unsigned int flags);
+extern long sys_splice(int fd_in, long *off_in, int fd_out, long *off_out,
+                       size_t len, unsigned int flags);
+extern int sys_fsync(int fd);
+
+/** Share the extents of src with dst (ioctl on dst, arg is src). */
+#define FICLONE 0x40049409
+
+/** Copy in the kernel. Offsets may be NULL to use and update the file positions. */
+extern long sys_copy_file_range(int fd_in, long *off_in, int fd_out, long *off_out,
+                                size_t len, unsigned int flags);
+extern long sys_sendfile(int out_fd, int in_fd, long *offset, size_t count);
+
+/** Unix sockets: a connected pair, and messages that may carry fds
+ * (SCM_RIGHTS), which arrive as new fds of the receiver. */
+#define AF_UNIX 1
+#define SOCK_SEQPACKET 5
+#define SOCK_CLOEXEC 02000000
+#define SOL_SOCKET 1
+#define SCM_RIGHTS 1
+#define MSG_NOSIGNAL 0x4000         // EPIPE without SIGPIPE
+#define MSG_CMSG_CLOEXEC 0x40000000
+
+struct iovec {
+    void *iov_base;
+    size_t iov_len;
+};
 
+struct msghdr {
+    void *msg_name;
+    int msg_namelen;
+    struct iovec *msg_iov;
+    size_t msg_iovlen;
+    void *msg_control;
+    size_t msg_controllen;
+    int msg_flags;
+};
+
+/** A control message; its data follows, at the next 8-byte boundary. */
+struct cmsghdr {
+    size_t cmsg_len;
+    int cmsg_level;
+    int cmsg_type;
+};
+
+extern int sys_socketpair(int domain, int type, int protocol, int *sv);
+extern long sys_sendmsg(int fd, const struct msghdr *msg, int flags);
+extern long sys_recvmsg(int fd, struct msghdr *msg, int flags);
+
+#ifdef __X86_64__
 struct stat {
     uint64_t st_dev;
     uint64_t st_ino;
-    uint32_t st_mode;
     uint64_t st_nlink;
+    uint32_t st_mode;
     uint32_t st_uid;
     uint32_t st_gid;
+    uint32_t __pad0;
     uint64_t st_rdev;
     uint64_t st_size;
     uint64_t st_blksize;
     uint64_t st_blocks;
-    uint8_t st_atime[16];
-    uint8_t st_mtime[16];
-    uint8_t st_ctime[16];
+    struct timespec st_atim;
+    struct timespec st_mtim;
+    struct timespec st_ctim;
+    int64_t __unused[3];
 };
+#endif // __X86_64__
+
+#ifdef __AARCH64__
+struct stat {
+    uint64_t st_dev;
+    uint64_t st_ino;
+    uint32_t st_mode;
+    uint32_t st_nlink;
+    uint32_t st_uid;
+    uint32_t st_gid;
+    uint64_t st_rdev;
+    uint64_t __pad1;
+    uint64_t st_size;
+    uint32_t st_blksize;
+    uint32_t __pad2;
+    uint64_t st_blocks;
+    struct timespec st_atim;
+    struct timespec st_mtim;
+    struct timespec st_ctim;
+    uint32_t __unused[2];
+};
+#endif // __AARCH64__
 
 extern int sys_fstat(int fd, struct stat *statbuf);
+extern int sys_fstatat(int dirfd, const char *path, struct stat *statbuf, int flags);
+
+#define R_OK 4
+#define W_OK 2
+#define X_OK 1
+extern int sys_faccessat(int dirfd, const char *path, int mode);
+
+/* file type bits of st_mode/stx_mode */
+#define S_IFMT   0170000
+#define S_IFSOCK 0140000
+#define S_IFLNK  0120000
+#define S_IFREG  0100000
+#define S_IFBLK  0060000
+#define S_IFDIR  0040000
+#define S_IFCHR  0020000
+#define S_IFIFO  0010000
+
+#define AT_SYMLINK_NOFOLLOW 0x100
+#define AT_EMPTY_PATH       0x1000
+#define AT_STATX_DONT_SYNC  0x4000  /* do not sync with remote fs */
+
+/* which fields sys_statx should fill in */
+#define STATX_TYPE   0x001
+#define STATX_MODE   0x002
+#define STATX_NLINK  0x004
+#define STATX_UID    0x008
+#define STATX_GID    0x010
+#define STATX_ATIME  0x020
+#define STATX_MTIME  0x040
+#define STATX_CTIME  0x080
+#define STATX_INO    0x100
+#define STATX_SIZE   0x200
+#define STATX_BLOCKS 0x400
+
+struct statx_timestamp {
+    int64_t tv_sec;
+    uint32_t tv_nsec;
+    int32_t __reserved;
+};
+
+struct statx {
+    uint32_t stx_mask;     /* fields actually filled in */
+    uint32_t stx_blksize;
+    uint64_t stx_attributes;
+    uint32_t stx_nlink;
+    uint32_t stx_uid;
+    uint32_t stx_gid;
+    uint16_t stx_mode;
+    uint16_t __spare0;
+    uint64_t stx_ino;
+    uint64_t stx_size;
+    uint64_t stx_blocks;
+    uint64_t stx_attributes_mask;
+    struct statx_timestamp stx_atime;
+    struct statx_timestamp stx_btime;
+    struct statx_timestamp stx_ctime;
+    struct statx_timestamp stx_mtime;
+    uint32_t stx_rdev_major;
+    uint32_t stx_rdev_minor;
+    uint32_t stx_dev_major;
+    uint32_t stx_dev_minor;
+    uint64_t __spare2[14];
+};
+
+/** Only the fields in mask are guaranteed to be valid on return. */
+extern int sys_statx(int dirfd, const char *path, int flags, unsigned int mask,
+                     struct statx *buf);
+
+/** Threads */
+
+#define CLONE_VM             0x00000100
+#define CLONE_FS             0x00000200
+#define CLONE_FILES          0x00000400
+#define CLONE_SIGHAND        0x00000800
+#define CLONE_VFORK          0x00004000
+#define CLONE_PARENT         0x00008000
+#define CLONE_THREAD         0x00010000
+#define CLONE_SYSVSEM        0x00040000
+#define CLONE_PARENT_SETTID  0x00100000
+#define CLONE_CHILD_CLEARTID 0x00200000
+
+/**
+ * Run fn(arg) in a new task on the given stack (the highest address).
+ * tid receives the new task id in both parent and child; with
+ * CLONE_CHILD_CLEARTID the kernel zeroes it when the task exits.
+ * Returns the tid to the caller, or a negative errno.
+ */
+extern int sys_clone(int (*fn)(void *), void *stack, unsigned long flags,
+                     void *arg, int *tid);
+
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+#define FUTEX_PRIVATE_FLAG 128
+extern long sys_futex(int *uaddr, int op, int val,
+                      const struct timespec *timeout, int *uaddr2, int val3);
 
 /** Memory management */
 
@@ -125,4 +390,13 @@ struct linux_dirent {
 };
 extern long sys_getdents(int fd, struct linux_dirent *dirent, unsigned long count);
 
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;     /* DT_* */
+    char d_name[0];
+};
+extern long sys_getdents64(int fd, struct linux_dirent64 *dirent, unsigned long count);
+
 #endif // _SYS_H_
@@ -1,107 +1,381 @@
 #include "std.h"
+#include "spawn.h"
+#include "zygote.h"
 
-/** 
- * Wrapper of sys_execve, will auto search exe path. 
- */
-void Execve(char *exe, char **argv) {
-    static char buf[128];
-    // possible path to exe
-    static const char *dir[] = {
-        "/",
-        "/bin/",
-        "/usr/bin/",
-        "/usr/local/bin/",
-    };
-    char *chp;
+/** Where commands are looked for when there is no PATH, as before. */
+#define DEFAULT_PATH "/bin:/usr/bin:/usr/local/bin:/"
+
+#define HASH_SIZE 128   // a power of 2
+#define HASH_NAME 64
+#define HASH_PATH 256
+
+/** The command hash: command name -> where PATH lead to it, as in
+ * bash. Open addressing with linear probing; name[0] == 0 is empty. */
+static struct hash_entry {
+    uint32_t hash;
+    int hits;
+    char name[HASH_NAME];
+    char path[HASH_PATH];
+} table[HASH_SIZE];
+static int hashed;
 
-    sys_execve(exe, argv, NULL);
-    for (size_t i = 0; i < sizeof(dir) / sizeof(dir[0]); i++) {
-        const char *path = dir[i];
-        chp = (char *)buf;
+char *Getenv(const char *name) {
+    size_t len = Strlen(name);
+    for (char **e = environ; e != NULL && *e != NULL; e++) {
+        if (Memcmp(*e, name, len) == 0 && (*e)[len] == '=') {
+            return *e + len + 1;
+        }
+    }
+    return NULL;
+}
 
-        // copy dir name
-        chp = Strcpy(chp, path);
-        // copy path name
-        chp = Strcpy(chp, exe);
-        sys_execve((char *)buf, argv, NULL);
+static uint32_t fnv1a(const char *s) {
+    uint32_t h = 2166136261u;
+    for (; *s; s++) {
+        h = (h ^ (uint8_t)*s) * 16777619u;
     }
+    return h;
 }
 
-/** Execute a single job */
-static void exec_single(job_t *job) __attribute__((noreturn));
+/** The slot of name, or the empty slot where it would go. */
+static struct hash_entry *slot(const char *name, uint32_t h) {
+    for (uint32_t i = h; ; i++) {
+        struct hash_entry *e = &table[i % HASH_SIZE];
+        if (e->name[0] == 0 || (e->hash == h && Strcmp(e->name, name) == 0)) {
+            return e;
+        }
+    }
+}
 
-/** Execute a job recursively(do not return) */
-static void exec_recur_noret(job_t *job, int cur, int total, int stdout_fd) __attribute__((noreturn));
+/** Look for name in each directory of PATH; an empty one means the
+ * current directory. Writes the first executable file into out. */
+static bool search_path(const char *name, char *out, size_t size) {
+    const char *path = Getenv("PATH");
+    if (path == NULL) {
+        path = DEFAULT_PATH;
+    }
+    size_t nlen = Strlen(name);
+    for (const char *dir = path; ; ) {
+        const char *end = dir;
+        while (*end && *end != ':') {
+            end++;
+        }
+        size_t dlen = end - dir;
+        if (dlen == 0) {
+            dir = ".";
+            dlen = 1;
+        }
+        if (dlen + 1 + nlen < size) {
+            Memcpy(out, dir, dlen);
+            out[dlen] = '/';
+            Memcpy(out + dlen + 1, name, nlen + 1);
+            struct stat st;
+            if (sys_fstatat(AT_FDCWD, out, &st, 0) == 0 &&
+                (st.st_mode & S_IFMT) == S_IFREG && (st.st_mode & 0111)) {
+                return true;
+            }
+        }
+        if (*end == 0) {
+            return false;
+        }
+        dir = end + 1;
+    }
+}
+
+const char *hash_lookup(const char *name) {
+    static char found[HASH_PATH];
+    if (Strlen(name) >= HASH_NAME) {
+        return search_path(name, found, sizeof(found)) ? found : NULL;
+    }
+
+    uint32_t h = fnv1a(name);
+    struct hash_entry *e = slot(name, h);
+    if (e->name[0] != 0) {
+        e->hits++;
+        return e->path;
+    }
+    if (!search_path(name, found, sizeof(found))) {
+        return NULL;
+    }
+    // keep the table at most 3/4 full, so probes stay short.
+    if (hashed < HASH_SIZE * 3 / 4) {
+        e->hash = h;
+        e->hits = 1;
+        Strcpy(e->name, name);
+        Strcpy(e->path, found);
+        hashed++;
+        return e->path;
+    }
+    return found;
+}
 
-static void exec_single(job_t *job) {
-    Assert(job != NULL);
-    if (job->stdin_fo) {
-        int fd = sys_open(job[0].stdin_fo, O_RDONLY);
-        sys_dup2(fd, 0);
+void hash_forget(const char *name) {
+    if (Strlen(name) >= HASH_NAME) {
+        return;
+    }
+    struct hash_entry *e = slot(name, fnv1a(name));
+    if (e->name[0] == 0) {
+        return;
     }
+    // move later entries of the run back, so no probe stops early.
+    uint32_t hole = e - table;
+    for (uint32_t i = hole + 1; ; i++) {
+        struct hash_entry *next = &table[i % HASH_SIZE];
+        if (next->name[0] == 0) {
+            break;
+        }
+        uint32_t home = next->hash % HASH_SIZE;
+        // can next live in the hole, i.e. is home not in (hole, i]?
+        if ((i - home) % HASH_SIZE >= (i - hole) % HASH_SIZE) {
+            table[hole] = *next;
+            hole = i % HASH_SIZE;
+        }
+    }
+    table[hole].name[0] = 0;
+    hashed--;
+}
 
-    if (job->stdout_fo) {
-        int fd = sys_open(job[0].stdout_fo, O_CREAT | O_RDWR);
-        sys_dup2(fd, 1);
+void hash_reset(void) {
+    for (int i = 0; i < HASH_SIZE; i++) {
+        table[i].name[0] = 0;
     }
+    hashed = 0;
+}
 
-    if (job->stderr_fo) {
-        int fd = sys_open(job[0].stderr_fo, O_CREAT | O_RDWR);
-        sys_dup2(fd, 2);
+void hash_list(void) {
+    if (hashed == 0) {
+        Printf("hash: hash table empty\n");
+        return;
+    }
+    Printf("hits\tcommand\n");
+    for (int i = 0; i < HASH_SIZE; i++) {
+        if (table[i].name[0] != 0) {
+            Printf("%d\t%s\n", table[i].hits, table[i].path);
+        }
     }
+}
 
-    Execve((char *)job->exe, (char **)job->argv);
+/** 
+ * Wrapper of sys_execve, will search PATH for exe through the hash.
+ * Returns only if it could not be run, with a negative errno.
+ */
+int Execve(char *exe, char **argv) {
+    return Execvpe(exe, argv, environ);
 }
 
-int exec_job(job_t *job, int cnt) {
-    Assert(cnt >= 0);
-    Assert(cnt == 0 || job != NULL);
+int Execvpe(char *exe, char **argv, char **envp) {
+    for (const char *p = exe; *p; p++) {
+        if (*p == '/') {
+            return sys_execve(exe, argv, envp);
+        }
+    }
+
+    const char *path = hash_lookup(exe);
+    if (path == NULL) {
+        return -ENOENT;
+    }
+    int r = sys_execve(path, argv, envp);
+    if (r != -ENOENT) {
+        return r;
+    }
+    // gone since it was hashed: look again. Spawned children share our
+    // memory, so this fixes the hash for the shell too.
+    hash_forget(exe);
+    path = hash_lookup(exe);
+    return path != NULL ? sys_execve(path, argv, envp) : -ENOENT;
+}
 
-    int pid = sys_fork();
+/** Add the usage of one reaped process to the total. */
+static void add_usage(struct rusage *sum, const struct rusage *ru) {
+    sum->ru_utime.tv_sec += ru->ru_utime.tv_sec;
+    sum->ru_utime.tv_usec += ru->ru_utime.tv_usec;
+    sum->ru_stime.tv_sec += ru->ru_stime.tv_sec;
+    sum->ru_stime.tv_usec += ru->ru_stime.tv_usec;
+    if (ru->ru_maxrss > sum->ru_maxrss) {
+        sum->ru_maxrss = ru->ru_maxrss;
+    }
+    sum->ru_minflt += ru->ru_minflt;
+    sum->ru_majflt += ru->ru_majflt;
+    sum->ru_nvcsw += ru->ru_nvcsw;
+    sum->ru_nivcsw += ru->ru_nivcsw;
+}
 
+/** Tell why a command could not be started, as a shell does: the
+ * redirection that failed, or the program. Returns its status. */
+static int spawn_failed(const char *exe, const struct spawn *sp, int err) {
+    static char buf[256];
+    unsigned n;
+    if (sp->failed < 0) {
+        n = Sprintf(buf, "sh: %s: %s\n", exe,
+                    err == -ENOENT ? "command not found" : "cannot run");
+        sys_write(2, buf, n);
+        return err == -ENOENT ? 127 : 126;
+    }
+    const struct spawn_action *a = &sp->act[sp->failed];
+    if (a->op == SPAWN_OPEN) {
+        sys_write(2, "sh: ", 4);
+        sys_write(2, a->path, Strlen(a->path));
+        n = Sprintf(buf, ": %s\n", Strerror(err));
+    } else {
+        n = Sprintf(buf, "sh: %d: %s\n", a->fd, Strerror(err));
+    }
+    sys_write(2, buf, n);
+    return 1;
+}
+
+/** Spawn one stage of a pipeline into process group pgid (0: a new
+ * one), with its redirections on top of in and out. */
+static int exec_single(job_t *job, int in, int out, int pgid, int tty, int flags) {
+    struct spawn sp;
+    spawn_init(&sp);
+    spawn_setpgroup(&sp, pgid);
+    spawn_settty(&sp, tty);
+    // the shell blocks SIGCHLD for its signalfd; commands start clean.
+    spawn_setsigmask(&sp, 0);
+    spawn_setenv(&sp, job->envp);
+    if (job->sched != NULL) {
+        if (job->sched->cpu_words > 0) {
+            spawn_setaffinity(&sp, job->sched->cpus, job->sched->cpu_words);
+        }
+        if (job->sched->policy >= 0) {
+            spawn_setscheduler(&sp, job->sched->policy, job->sched->priority);
+        }
+        spawn_setnice(&sp, job->sched->nice);
+    }
+    if (in >= 0) {
+        spawn_dup2(&sp, in, 0);
+    }
+    if (out >= 0) {
+        spawn_dup2(&sp, out, 1);
+    }
+    for (int i = 0; i < job->nredir; i++) {
+        const struct redir *r = &job->redirs[i];
+        if (r->from >= 0) {
+            spawn_dup2(&sp, r->from, r->fd);
+        } else {
+            spawn_open(&sp, r->fd, r->path, r->flags, 0666);
+        }
+    }
+    int pid;
+    if (job->builtin != NULL) {
+        pid = spawn_fork(&sp, job->builtin, job->argv);
+    } else {
+        pid = job->exe == NULL ? -ENOENT :
+              flags & EXEC_ZYGOTE ? zygote_spawn(&sp, job->argv) : spawn(&sp, job->argv);
+    }
     if (pid < 0) {
-        return -1;
+        job->status = job->exe != NULL ? spawn_failed(job->exe, &sp, pid) : 127;
     }
+    return pid;
+}
 
-    if (pid == 0) {
-        exec_recur_noret(job, cnt - 1, cnt, 1);
-        sys_exit(1);
+/** The terminal on stdin, if we are its foreground group: the
+ * pipeline gets it while it runs. -1 otherwise. */
+static int foreground_tty(void) {
+    int pgid;
+    if (sys_ioctl(0, TIOCGPGRP, (unsigned long)&pgid) < 0 || pgid != sys_getpgid(0)) {
+        return -1;
     }
+    return 0;
+}
 
-    return sys_waitid(P_ALL, 0, NULL, WEXITED);
+/** Take the terminal back once the pipeline is done; we are in the
+ * background until then, so SIGTTOU must be ignored meanwhile. */
+static void reclaim_tty(int tty) {
+    static const struct sigaction ign = {.sa_handler = SIG_IGN};
+    struct sigaction old;
+    int pgid = sys_getpgid(0);
+    sys_rt_sigaction(SIGTTOU, &ign, &old, sizeof(uint64_t));
+    sys_ioctl(tty, TIOCSPGRP, (unsigned long)&pgid);
+    sys_rt_sigaction(SIGTTOU, &old, NULL, sizeof(uint64_t));
 }
 
-static void exec_recur_noret(job_t *job, int cur, int total, int stdout_fd) {
-    Assert(cur <= total);
+int exec_job(job_t *job, int cnt, int flags, struct rusage *ru) {
+    Assert(cnt >= 0);
+    Assert(cnt == 0 || job != NULL);
 
-    if (cur == 0) {
-        exec_single(job);
-        sys_exit(1);
+    if (ru != NULL) {
+        Memset(ru, 0, sizeof(*ru));
     }
 
-    int pip[2];
-    if (sys_pipe((int *)pip) != 0) {
-        sys_exit(1);
+    // every stage is our child, spawned one after the other without
+    // waiting for any; the pipes are close-on-exec, so the children
+    // only keep the ends they got as stdin and stdout. The first stage
+    // that starts leads the process group the others join.
+    for (int i = 0; i < cnt; i++) {
+        job[i].pid = -1;
+        job[i].status = 1;
+    }
+    bool bg = flags & EXEC_BACKGROUND;
+    int tty = bg ? -1 : foreground_tty();
+    int pgid = 0;
+    // a background job must not read the terminal: it would stop.
+    int in = bg ? sys_openat_mode(AT_FDCWD, "/dev/null", O_RDONLY | O_CLOEXEC, 0) : -1;
+    for (int i = 0; i < cnt; i++) {
+        int pip[2] = {-1, -1};
+        if (i < cnt - 1 && sys_pipe2(pip, O_CLOEXEC) < 0) {
+            break;
+        }
+        int pid = exec_single(&job[i], in, pip[1], pgid, pgid == 0 ? tty : -1, flags);
+        if (pid >= 0) {
+            job[i].pid = pid;
+            pgid = pgid == 0 ? pid : pgid;
+        }
+        if (in >= 0) {
+            sys_close(in);
+        }
+        if (pip[1] >= 0) {
+            sys_close(pip[1]);
+        }
+        in = pip[0];
+    }
+    if (in >= 0) {
+        sys_close(in);
+    }
+    if (bg) {
+        return pgid > 0 ? pgid : -1;
     }
 
-    int pid = sys_fork();
-    if (pid < 0) {
-        sys_exit(1);
+    // reap the whole group, so the pipeline is over and counted.
+    while (pgid > 0) {
+        int st;
+        struct rusage one;
+        int r = sys_wait4(-pgid, &st, 0, &one);
+        if (r == -EINTR) {
+            continue;
+        }
+        if (r < 0) {
+            break;
+        }
+        for (int i = 0; i < cnt; i++) {
+            if (job[i].pid == r) {
+                job[i].status = WIFEXITED(st) ? WEXITSTATUS(st) : 128 + WTERMSIG(st);
+            }
+        }
+        if (ru != NULL) {
+            add_usage(ru, &one);
+        }
+    }
+    if (pgid > 0 && tty >= 0) {
+        reclaim_tty(tty);
+    }
+    if (ru != NULL) {
+        ru->ru_utime.tv_sec += ru->ru_utime.tv_usec / 1000000;
+        ru->ru_utime.tv_usec %= 1000000;
+        ru->ru_stime.tv_sec += ru->ru_stime.tv_usec / 1000000;
+        ru->ru_stime.tv_usec %= 1000000;
     }
 
-    if (pid == 0) {
-        // child proc
-        sys_dup2(pip[1], 1);
-        sys_close(pip[0]);
-        sys_close(pip[1]);
-        exec_recur_noret(job, cur - 1, total, 1);
-    } else {
-        // parent proc
-        sys_dup2(pip[0], 0);
-        sys_close(pip[0]);
-        sys_close(pip[1]);
-        exec_single(&job[cur]);
+    int ret = cnt > 0 ? job[cnt - 1].status : 0;
+    for (int i = 0; i < cnt && (flags & EXEC_PIPEFAIL); i++) {
+        if (job[i].status != 0) {
+            ret = job[i].status;
+        }
     }
+    return ret;
+}
 
-    sys_exit(1);
+int exec_async(char **argv) {
+    Assert(argv != NULL && argv[0] != NULL);
+    return spawn(NULL, argv);
 }
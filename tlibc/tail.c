@@ -0,0 +1,261 @@
+#include "std.h"
+
+#define BUFSZ 65536
+
+static struct {
+    bool bytes;         // -c, otherwise -n
+    bool from_start;    // +N: output starting with line/byte N
+    uint64_t count;
+} opt;
+
+static bool write_all(const char *p, size_t len) {
+    for (size_t done = 0; done < len; ) {
+        long w = sys_write(1, p + done, len - done);
+        if (w <= 0) {
+            return false;
+        }
+        done += w;
+    }
+    return true;
+}
+
+static void *map_anon(size_t size) {
+    void *p = sys_mmap(NULL, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (long)p < 0 ? NULL : p;
+}
+
+/** Start of the last n lines of [p, p + size). A final newline ends the
+ * last line rather than starting an empty one. */
+static const char *last_lines(const char *p, size_t size, uint64_t n) {
+    size_t end = size > 0 && p[size - 1] == '\n' ? size - 1 : size;
+    while (n > 0) {
+        const char *nl = Memrchr(p, '\n', end);
+        if (nl == NULL) {
+            return p;
+        }
+        end = nl - p;
+        n--;
+    }
+    return p + end + 1;
+}
+
+/** A regular file: map it and look backwards from the end, so only the
+ * pages of the tail are ever read. */
+static int tail_mapped(int fd, size_t size) {
+    if (size == 0 || opt.count == 0) {
+        return 0;
+    }
+    const char *p = sys_mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if ((long)p < 0) {
+        return (long)p;
+    }
+
+    const char *start;
+    if (opt.bytes) {
+        start = opt.count < size ? p + size - opt.count : p;
+    } else {
+        start = last_lines(p, size, opt.count);
+    }
+    int r = write_all(start, p + size - start) ? 0 : -EIO;
+    sys_munmap((void *)p, size);
+    return r;
+}
+
+/** Make the ring of *rcap line starts twice as large, up to nring.
+ * It has not wrapped yet, so each start stays where it is. */
+static uint64_t *grow_ring(uint64_t *ring, size_t *rcap, size_t nring) {
+    size_t bigger = *rcap < nring / 2 ? 2 * *rcap : nring;
+    uint64_t *p = map_anon(bigger * sizeof(uint64_t));
+    if (p != NULL) {
+        Memcpy(p, ring, *rcap * sizeof(uint64_t));
+        sys_munmap(ring, *rcap * sizeof(uint64_t));
+        *rcap = bigger;
+    }
+    return p;
+}
+
+/** A pipe: keep only what can still be part of the tail. With -n the
+ * starts of the last lines are remembered in a ring, so whatever lies
+ * before the oldest of them can be dropped. */
+static int tail_stream(int fd) {
+    size_t cap = BUFSZ;
+    char *buf = map_anon(cap);
+    // ring of absolute line starts, n + 1 of them for the empty "line"
+    // after a final newline. It grows with the lines read up to that:
+    // a large n must not cost its ring up front.
+    size_t max = SIZE_MAX / sizeof(uint64_t);
+    size_t nring = opt.bytes ? 1 : opt.count < max ? opt.count + 1 : max;
+    size_t rcap = nring < 512 ? nring : 512;
+    uint64_t *ring = map_anon(rcap * sizeof(uint64_t));
+    if (buf == NULL || ring == NULL) {
+        return -ENOMEM;
+    }
+    uint64_t base = 0;      // absolute offset of buf[0]
+    size_t len = 0;
+    uint64_t starts = 1;    // line starts seen, the first at offset 0
+    ring[0] = 0;
+
+    for (;;) {
+        if (len == cap) {
+            // drop what is no longer needed; grow only if nothing is.
+            uint64_t keep;
+            if (opt.bytes) {
+                keep = base + len > opt.count ? base + len - opt.count : base;
+            } else {
+                keep = starts > rcap ? ring[starts % rcap] : 0;
+            }
+            if (keep > base) {
+                Memmove(buf, buf + (keep - base), base + len - keep);
+                len -= keep - base;
+                base = keep;
+            } else {
+                char *bigger = map_anon(2 * cap);
+                if (bigger == NULL) {
+                    return -ENOMEM;
+                }
+                Memcpy(bigger, buf, len);
+                sys_munmap(buf, cap);
+                buf = bigger;
+                cap *= 2;
+            }
+        }
+
+        long r = sys_read(fd, buf + len, cap - len);
+        if (r < 0) {
+            return r;
+        }
+        if (r == 0) {
+            break;
+        }
+        if (!opt.bytes) {
+            const char *p = buf + len;
+            const char *e = p + r;
+            while ((p = Memchr(p, '\n', e - p)) != NULL) {
+                p++;
+                if (starts == rcap && rcap < nring &&
+                    (ring = grow_ring(ring, &rcap, nring)) == NULL) {
+                    return -ENOMEM;
+                }
+                ring[starts++ % rcap] = base + (p - buf);
+            }
+        }
+        len += r;
+    }
+
+    uint64_t from;
+    if (opt.bytes) {
+        from = base + len > opt.count ? base + len - opt.count : 0;
+    } else {
+        // the last start is the end of the data after a final newline.
+        uint64_t lines = ring[(starts - 1) % rcap] == base + len ? starts - 1 : starts;
+        from = opt.count == 0 ? base + len
+             : lines > opt.count ? ring[(lines - opt.count) % rcap] : 0;
+    }
+    int ret = write_all(buf + (from - base), base + len - from) ? 0 : -EIO;
+    sys_munmap(buf, cap);
+    sys_munmap(ring, rcap * sizeof(uint64_t));
+    return ret;
+}
+
+/** +N: skip to line or byte N and copy the rest. */
+static int tail_from(int fd) {
+    static char buf[BUFSZ];
+    uint64_t skip = opt.count > 0 ? opt.count - 1 : 0;
+    long r;
+    while ((r = sys_read(fd, buf, sizeof(buf))) > 0) {
+        const char *p = buf;
+        const char *e = buf + r;
+        if (opt.bytes) {
+            size_t n = skip < (uint64_t)r ? skip : r;
+            p += n;
+            skip -= n;
+        } else {
+            while (skip > 0 && p < e) {
+                const char *nl = Memchr(p, '\n', e - p);
+                p = nl == NULL ? e : nl + 1;
+                skip -= nl != NULL;
+            }
+        }
+        if (!write_all(p, e - p)) {
+            return -EIO;
+        }
+    }
+    return r;
+}
+
+static int tail(int fd) {
+    if (opt.from_start) {
+        return tail_from(fd);
+    }
+    struct stat st;
+    if (sys_fstat(fd, &st) == 0 && (st.st_mode & S_IFMT) == S_IFREG) {
+        return tail_mapped(fd, st.st_size);
+    }
+    return tail_stream(fd);
+}
+
+static void cannot_read(const char *name, int err) {
+    static char buf[64];
+    sys_write(2, "tail: cannot read ", 18);
+    sys_write(2, name, Strlen(name));
+    sys_write(2, buf, Sprintf(buf, ": %s\n", Strerror(err)));
+}
+
+static int usage(void) {
+    static const char msg[] = "Usage: tail [-n [+]lines | -c [+]bytes] [file...]\n";
+    sys_write(2, msg, sizeof(msg) - 1);
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    opt.count = 10;
+    int first = 1;
+    for (; first < argc && argv[first][0] == '-' && argv[first][1] != 0; first++) {
+        char f = argv[first][1];
+        if (f != 'n' && f != 'c') {
+            return usage();
+        }
+        const char *v = argv[first][2] ? argv[first] + 2 : argv[++first];
+        if (v == NULL) {
+            return usage();
+        }
+        opt.bytes = f == 'c';
+        opt.from_start = *v == '+';
+        v += *v == '+' || *v == '-';
+        if (*v == 0) {
+            return usage();
+        }
+        opt.count = 0;
+        for (; *v; v++) {
+            if (*v < '0' || *v > '9') {
+                return usage();
+            }
+            opt.count = opt.count * 10 + (*v - '0');
+        }
+    }
+
+    int ret = 0;
+    if (first == argc) {
+        int r = tail(0);
+        if (r < 0) {
+            cannot_read("-", r);
+            ret = 1;
+        }
+    }
+    for (int i = first; i < argc; i++) {
+        if (argc - first > 1) {
+            Printf("%s==> %s <==\n", i == first ? "" : "\n", argv[i]);
+        }
+        int fd = Strcmp(argv[i], "-") == 0 ? 0 : sys_open(argv[i], O_RDONLY);
+        int r = fd < 0 ? fd : tail(fd);
+        if (r < 0) {
+            cannot_read(argv[i], r);
+            ret = 1;
+        }
+        if (fd > 0) {
+            sys_close(fd);
+        }
+    }
+    return ret;
+}
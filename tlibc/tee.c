@@ -0,0 +1,269 @@
+#include "std.h"
+
+#define MAXOUT 64
+#define BUFSZ 65536
+
+/** An output. Pipes get the data with tee(2) straight away; anything
+ * else gets it through a private pipe that is spliced into it. */
+struct output {
+    const char *name;
+    int fd;
+    int pipe[2];        // private pipe, -1 if fd is a pipe itself
+    bool failed;
+    long got;           // bytes duplicated to it this round
+};
+
+static struct output outs[MAXOUT];
+static int nout;
+static bool append;     // -a
+static bool refused;    // splice or tee said EINVAL: buffered from now on
+static int ret;
+
+static void complain(struct output *o) {
+    sys_write(2, "tee: ", 5);
+    sys_write(2, o->name, Strlen(o->name));
+    sys_write(2, ": write error\n", 14);
+    o->failed = true;
+    ret = 1;
+}
+
+static bool write_all(int fd, const char *p, size_t len) {
+    for (size_t done = 0; done < len; ) {
+        long w = sys_write(fd, p + done, len - done);
+        if (w <= 0) {
+            return false;
+        }
+        done += w;
+    }
+    return true;
+}
+
+/** The plain way: read into a buffer and write it everywhere. */
+static void copy_buffered(void) {
+    static char buf[BUFSZ];
+    long r;
+    while ((r = sys_read(0, buf, sizeof(buf))) > 0) {
+        for (int i = 0; i < nout; i++) {
+            if (!outs[i].failed && !write_all(outs[i].fd, buf, r)) {
+                complain(&outs[i]);
+            }
+        }
+    }
+    if (r < 0) {
+        ret = 1;
+    }
+}
+
+static int fd_type(int fd) {
+    struct stat st;
+    return sys_fstat(fd, &st) == 0 ? st.st_mode & S_IFMT : 0;
+}
+
+/** Move len bytes from in to out through a buffer. */
+static bool pass_all(int in, int out, long len) {
+    static char buf[BUFSZ];
+    while (len > 0) {
+        long r = sys_read(in, buf, len < BUFSZ ? len : BUFSZ);
+        if (r <= 0 || !write_all(out, buf, r)) {
+            return false;
+        }
+        len -= r;
+    }
+    return true;
+}
+
+/** Move len bytes from the pipe in to out without copying them, or
+ * through a buffer once the kernel refuses that for out. */
+static bool splice_all(int in, int out, long len) {
+    while (len > 0) {
+        long n = sys_splice(in, NULL, out, NULL, len, SPLICE_F_MOVE);
+        if (n == -EINVAL) {
+            refused = true;
+            return pass_all(in, out, len);
+        }
+        if (n <= 0) {
+            return false;
+        }
+        len -= n;
+    }
+    return true;
+}
+
+/** Zero copy: every round tee(2) duplicates what is in stdin to all
+ * outputs but the last, then splice(2) moves it to the last one, which
+ * consumes it. Private pipes are drained into their files in between.
+ * Where the kernel refuses either, the round is finished by hand and
+ * the rest goes the buffered way. */
+static void copy_spliced(void) {
+    long cap = sys_fcntl(0, F_GETPIPE_SZ, 0);
+    if (cap <= 0) {
+        cap = BUFSZ;
+    }
+    for (int i = 0; i < nout - 1; i++) {
+        if (outs[i].pipe[0] >= 0) {
+            // as large as stdin, so a tee into it is never short.
+            sys_fcntl(outs[i].pipe[1], F_SETPIPE_SZ, cap);
+        }
+    }
+
+    struct output *last = &outs[nout - 1];
+    for (;;) {
+        long n;
+        if (nout == 1) {
+            n = sys_splice(0, NULL, last->fd, NULL, cap, SPLICE_F_MOVE);
+            if (n == -EINVAL) {
+                copy_buffered();
+                return;
+            }
+            if (n < 0) {
+                complain(last);
+            }
+            if (n <= 0) {
+                return;
+            }
+            continue;
+        }
+
+        // the first tee decides how much this round is about.
+        n = 0;
+        for (int i = 0; i < nout - 1; i++) {
+            struct output *o = &outs[i];
+            int to = o->pipe[0] >= 0 ? o->pipe[1] : o->fd;
+            o->got = 0;
+            if (o->failed) {
+                continue;
+            }
+            o->got = sys_tee(0, to, n > 0 ? n : cap, 0);
+            if (o->got == -EINVAL) {
+                // left behind: the buffered copy below catches it up.
+                refused = true;
+                o->got = 0;
+            } else if (o->got < 0) {
+                complain(o);
+                o->got = 0;
+            } else if (n == 0) {
+                if (o->got == 0) {
+                    return;     // EOF
+                }
+                n = o->got;
+            }
+        }
+        if (n == 0 && refused) {
+            // nothing taken from stdin, nothing handed out yet.
+            copy_buffered();
+            return;
+        }
+        if (n == 0) {
+            // all but the last output failed: no tee to wait for EOF.
+            n = sys_splice(0, NULL, last->fd, NULL, cap, SPLICE_F_MOVE);
+            if (n <= 0) {
+                if (n < 0) {
+                    complain(last);
+                }
+                return;
+            }
+            continue;
+        }
+
+        bool behind = last->failed;
+        for (int i = 0; i < nout - 1; i++) {
+            struct output *o = &outs[i];
+            if (o->pipe[0] >= 0 && o->got > 0 && !splice_all(o->pipe[0], o->fd, o->got)) {
+                complain(o);
+            }
+            behind |= !o->failed && o->got < n;
+        }
+
+        if (!behind) {
+            if (!splice_all(0, last->fd, n)) {
+                complain(last);
+            }
+            if (refused) {
+                copy_buffered();
+                return;
+            }
+            continue;
+        }
+
+        // someone got less than n (a full pipe): copy the rest the old way.
+        static char buf[BUFSZ];
+        long left = n;
+        long off = 0;
+        while (left > 0) {
+            long r = sys_read(0, buf, left < BUFSZ ? left : BUFSZ);
+            if (r <= 0) {
+                return;
+            }
+            for (int i = 0; i < nout; i++) {
+                struct output *o = &outs[i];
+                long skip = i == nout - 1 ? 0 : o->got - off;
+                if (o->failed || skip >= r) {
+                    continue;
+                }
+                skip = skip > 0 ? skip : 0;
+                if (!write_all(o->fd, buf + skip, r - skip)) {
+                    complain(o);
+                }
+            }
+            off += r;
+            left -= r;
+        }
+        if (refused) {
+            copy_buffered();
+            return;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    int first = 1;
+    if (first < argc && Strcmp(argv[first], "-a") == 0) {
+        append = true;
+        first++;
+    }
+
+    outs[nout++] = (struct output){
+        .name = "standard output", .fd = 1, .pipe = {-1, -1},
+    };
+    for (int i = first; i < argc && nout < MAXOUT; i++) {
+        int flags = O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC);
+        int fd = sys_openat_mode(AT_FDCWD, argv[i], flags, 0666);
+        if (fd < 0) {
+            sys_write(2, "tee: cannot open ", 17);
+            sys_write(2, argv[i], Strlen(argv[i]));
+            sys_write(2, "\n", 1);
+            ret = 1;
+            continue;
+        }
+        outs[nout++] = (struct output){
+            .name = argv[i], .fd = fd, .pipe = {-1, -1},
+        };
+    }
+
+    // splice() refuses O_APPEND files, terminals and most devices.
+    // Ours are O_APPEND with -a, but stdout may be too: ask each.
+    bool zero_copy = fd_type(0) == S_IFIFO;
+    for (int i = 0; i < nout && zero_copy; i++) {
+        int type = fd_type(outs[i].fd);
+        int flags = sys_fcntl(outs[i].fd, F_GETFL, 0);
+        if (flags < 0 || (flags & O_APPEND)) {
+            zero_copy = false;
+            continue;
+        }
+        if (type == S_IFIFO) {
+            continue;
+        }
+        if (type != S_IFREG && type != S_IFSOCK && type != S_IFBLK) {
+            zero_copy = false;
+        } else if (i < nout - 1 && sys_pipe(outs[i].pipe) < 0) {
+            zero_copy = false;
+        }
+    }
+
+    if (zero_copy) {
+        copy_spliced();
+    } else {
+        copy_buffered();
+    }
+    return ret;
+}
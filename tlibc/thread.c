@@ -0,0 +1,58 @@
+#include "std.h"
+#include "thread.h"
+
+#define THREAD_STACK (256 * 1024)
+
+static const unsigned long thread_flags =
+    CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND | CLONE_THREAD |
+    CLONE_SYSVSEM | CLONE_PARENT_SETTID | CLONE_CHILD_CLEARTID;
+
+int thread_create(struct thread *t, int (*fn)(void *), void *arg) {
+    t->stack_size = THREAD_STACK;
+    t->stack = sys_mmap(NULL, t->stack_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ((long)t->stack < 0) {
+        return (int)(long)t->stack;
+    }
+
+    int ret = sys_clone(fn, (char *)t->stack + t->stack_size, thread_flags,
+                        arg, &t->tid);
+    if (ret < 0) {
+        sys_munmap(t->stack, t->stack_size);
+        t->tid = 0;
+        return ret;
+    }
+    return 0;
+}
+
+void thread_join(struct thread *t) {
+    int tid;
+    // the kernel clears t->tid and wakes us up when the thread exits.
+    while ((tid = __atomic_load_n(&t->tid, __ATOMIC_ACQUIRE)) != 0) {
+        sys_futex(&t->tid, FUTEX_WAIT, tid, NULL, NULL, 0);
+    }
+    sys_munmap(t->stack, t->stack_size);
+}
+
+// see Ulrich Drepper, "Futexes Are Tricky", mutex #2.
+void mutex_lock(struct mutex *m) {
+    int c = 0;
+    if (__atomic_compare_exchange_n(&m->state, &c, 1, false,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+    }
+    if (c != 2) {
+        c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+    }
+    while (c != 0) {
+        sys_futex(&m->state, FUTEX_WAIT | FUTEX_PRIVATE_FLAG, 2, NULL, NULL, 0);
+        c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+    }
+}
+
+void mutex_unlock(struct mutex *m) {
+    if (__atomic_fetch_sub(&m->state, 1, __ATOMIC_RELEASE) != 1) {
+        __atomic_store_n(&m->state, 0, __ATOMIC_RELEASE);
+        sys_futex(&m->state, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, 1, NULL, NULL, 0);
+    }
+}
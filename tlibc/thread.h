@@ -0,0 +1,29 @@
+#ifndef _THREAD_H_
+#define _THREAD_H_
+
+/** Minimal kernel threads on top of sys_clone. Threads share the
+ * address space and the fd table, but std.h routines that keep static
+ * buffers (Printf, Sprintf of %L) must only be called by one thread. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct thread {
+    int tid;           // cleared by the kernel when the thread exits
+    void *stack;
+    size_t stack_size;
+};
+
+/** Returns 0 on success, negative errno on failure. */
+extern int thread_create(struct thread *t, int (*fn)(void *), void *arg);
+extern void thread_join(struct thread *t);
+
+/** Futex based lock, 0: unlocked, 1: locked, 2: locked with waiters. */
+struct mutex {
+    int state;
+};
+
+extern void mutex_lock(struct mutex *m);
+extern void mutex_unlock(struct mutex *m);
+
+#endif // _THREAD_H_
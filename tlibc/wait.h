@@ -5,21 +5,59 @@
 #define P_PID 1
 #define P_ALL 0
 
+#define WNOHANG 1
 #define WEXITED 4
 #define WSTOPPED 2
 #define WCONTINUED 8
 
+/** si_code of a SIGCHLD siginfo */
+#define CLD_EXITED 1
+#define CLD_KILLED 2
+#define CLD_DUMPED 3
+
+/** The SIGCHLD part of the kernel's siginfo, 128 bytes in total. */
 typedef struct {
     int si_signo;
-    int si_code; 
+    int si_errno;
+    int si_code;
+    int __pad;
     int si_pid;
     int si_uid;
-    void *si_addr;
-    int si_status;
-    /* FIXME */
+    int si_status;  // exit code, or the signal with CLD_KILLED/CLD_DUMPED
     uint8_t unused[100];
 } siginfo_t;
 
 extern int sys_waitid(uint32_t idtype, uint32_t id, siginfo_t *infop, int options);
 
+/** The status word of wait4 */
+#define WEXITSTATUS(st) (((st) >> 8) & 0xff)
+#define WTERMSIG(st) ((st) & 0x7f)
+#define WIFEXITED(st) (WTERMSIG(st) == 0)
+
+struct timeval {
+    long tv_sec;
+    long tv_usec;
+};
+
+struct rusage {
+    struct timeval ru_utime;    // user CPU time
+    struct timeval ru_stime;    // system CPU time
+    long ru_maxrss;             // in KB
+    long ru_ixrss;
+    long ru_idrss;
+    long ru_isrss;
+    long ru_minflt;             // page faults served without IO
+    long ru_majflt;             // page faults that needed IO
+    long ru_nswap;
+    long ru_inblock;
+    long ru_oublock;
+    long ru_msgsnd;
+    long ru_msgrcv;
+    long ru_nsignals;
+    long ru_nvcsw;              // voluntary context switches
+    long ru_nivcsw;             // involuntary context switches
+};
+
+extern int sys_wait4(int pid, int *status, int options, struct rusage *ru);
+
 #endif // _WAIT_H_
\ No newline at end of file
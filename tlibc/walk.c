@@ -0,0 +1,370 @@
+#include "std.h"
+#include "arena.h"
+#include "thread.h"
+#include "walk.h"
+
+#define WALK_NTHREAD 8
+#define PATH_MAX 4096
+#define DIRBUF 32768
+
+#define SEEN_BUCKETS (1 << 16)
+#define SEEN_STRIPES 64
+
+/** A directory that is queued, being scanned or waiting for its children. */
+struct wnode {
+    struct wnode *parent;
+    struct wnode *next;     // link in the work stack
+    const char *path;
+    size_t pathlen;
+    const char *name;
+    int depth;
+    int fd;
+    /** 1 while scanning, plus 1 per child not yet opened. Closes fd at 0. */
+    int fdrefs;
+    /** 1 while scanning, plus 1 per child not yet finished. Posts at 0. */
+    int pending;
+    uint64_t sum;
+};
+
+struct seen {
+    uint64_t dev;
+    uint64_t ino;
+    struct seen *next;
+};
+
+struct walker {
+    int flags;
+    const struct walk_ops *ops;
+    struct arena arena;
+
+    struct mutex lock;      // protects stack, outstanding and idle
+    struct wnode *stack;    // directories to scan, newest first
+    int outstanding;        // directories queued or being scanned
+    int idle;               // workers sleeping on seq
+    int seq;                // futex word, bumped whenever there is news
+    int failed;
+
+    struct mutex seen_lock[SEEN_STRIPES];
+    struct seen **seen;
+};
+
+static void report(struct walker *w, const char *path, int err) {
+    __atomic_store_n(&w->failed, 1, __ATOMIC_RELAXED);
+    if (w->ops->error != NULL) {
+        w->ops->error(path, err, w->ops->ctx);
+    }
+}
+
+static uint8_t mode_to_type(uint32_t mode) {
+    switch (mode & S_IFMT) {
+    case S_IFSOCK: return DT_SOCK;
+    case S_IFLNK: return DT_LNK;
+    case S_IFREG: return DT_REG;
+    case S_IFBLK: return DT_BLK;
+    case S_IFDIR: return DT_DIR;
+    case S_IFCHR: return DT_CHR;
+    case S_IFIFO: return DT_FIFO;
+    }
+    return DT_UNKNOWN;
+}
+
+/** Returns true if (dev, ino) was already recorded, records it otherwise. */
+static bool seen_before(struct walker *w, uint64_t dev, uint64_t ino) {
+    uint64_t h = (ino * 0x9e3779b97f4a7c15ul) ^ dev;
+    size_t b = (h >> 32) % SEEN_BUCKETS;
+    struct mutex *m = &w->seen_lock[b % SEEN_STRIPES];
+    bool found = false;
+
+    mutex_lock(m);
+    for (struct seen *s = w->seen[b]; s != NULL; s = s->next) {
+        if (s->dev == dev && s->ino == ino) {
+            found = true;
+            break;
+        }
+    }
+    if (!found) {
+        struct seen *s = arena_alloc(&w->arena, sizeof(struct seen));
+        if (s != NULL) {
+            s->dev = dev;
+            s->ino = ino;
+            s->next = w->seen[b];
+            w->seen[b] = s;
+        }
+    }
+    mutex_unlock(m);
+    return found;
+}
+
+static void push(struct walker *w, struct wnode *n) {
+    mutex_lock(&w->lock);
+    n->next = w->stack;
+    w->stack = n;
+    w->outstanding++;
+    w->seq++;
+    bool wake = w->idle > 0;
+    mutex_unlock(&w->lock);
+
+    if (wake) {
+        sys_futex(&w->seq, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, 1, NULL, NULL, 0);
+    }
+}
+
+/** Next directory to scan, or NULL once the whole tree is done. */
+static struct wnode *take(struct walker *w) {
+    mutex_lock(&w->lock);
+    for (;;) {
+        struct wnode *n = w->stack;
+        if (n != NULL) {
+            w->stack = n->next;
+            mutex_unlock(&w->lock);
+            return n;
+        }
+        if (w->outstanding == 0) {
+            mutex_unlock(&w->lock);
+            return NULL;
+        }
+
+        int seq = w->seq;
+        w->idle++;
+        mutex_unlock(&w->lock);
+        sys_futex(&w->seq, FUTEX_WAIT | FUTEX_PRIVATE_FLAG, seq, NULL, NULL, 0);
+        mutex_lock(&w->lock);
+        w->idle--;
+    }
+}
+
+/** A scan is over. The last one wakes everybody up to exit. */
+static void scanned(struct walker *w) {
+    mutex_lock(&w->lock);
+    bool last = --w->outstanding == 0;
+    if (last) {
+        w->seq++;
+    }
+    mutex_unlock(&w->lock);
+
+    if (last) {
+        sys_futex(&w->seq, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, WALK_NTHREAD, NULL, NULL, 0);
+    }
+}
+
+static void fd_release(struct wnode *n) {
+    if (__atomic_sub_fetch(&n->fdrefs, 1, __ATOMIC_ACQ_REL) == 0) {
+        sys_close(n->fd);
+    }
+}
+
+/** Drop one pending reference; finished directories are posted and
+ * their totals handed up to the parent. */
+static void finish(struct walker *w, struct wnode *n) {
+    while (n != NULL && __atomic_sub_fetch(&n->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        if (w->ops->post != NULL) {
+            struct walk_entry e = {
+                .path = n->path,
+                .name = n->name,
+                .dirfd = -1,
+                .depth = n->depth,
+                .type = DT_DIR,
+                .st = NULL,
+                .weight = 0,
+                .total = n->sum,
+            };
+            w->ops->post(&e, w->ops->ctx);
+        }
+        if (n->parent != NULL) {
+            __atomic_add_fetch(&n->parent->sum, n->sum, __ATOMIC_RELAXED);
+        }
+        n = n->parent;
+    }
+}
+
+static struct wnode *node_new(struct walker *w, struct wnode *parent,
+                              const char *path, size_t pathlen, size_t namelen) {
+    struct wnode *n = arena_alloc(&w->arena, sizeof(struct wnode) + pathlen + 1);
+    if (n == NULL) {
+        return NULL;
+    }
+    char *p = (char *)(n + 1);
+    Memcpy(p, path, pathlen + 1);
+
+    n->parent = parent;
+    n->next = NULL;
+    n->path = p;
+    n->pathlen = pathlen;
+    n->name = p + pathlen - namelen;
+    n->depth = parent == NULL ? 0 : parent->depth + 1;
+    n->fd = -1;
+    n->fdrefs = 1;
+    n->pending = 1;
+    n->sum = 0;
+    return n;
+}
+
+static void scan(struct walker *w, struct wnode *n, char *buf, char *path) {
+    if (n->fd < 0) {
+        int fd = sys_openat(n->parent->fd, n->name,
+                            O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        fd_release(n->parent);
+        if (fd < 0) {
+            report(w, n->path, fd);
+            finish(w, n);
+            return;
+        }
+        n->fd = fd;
+    }
+
+    size_t base = n->pathlen;
+    Memcpy(path, n->path, base);
+    if (base == 0 || path[base - 1] != '/') {
+        path[base++] = '/';
+    }
+
+    long nread;
+    while ((nread = sys_getdents64(n->fd, (struct linux_dirent64 *)buf, DIRBUF)) > 0) {
+        for (long off = 0; off < nread; ) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + off);
+            off += d->d_reclen;
+
+            const char *name = d->d_name;
+            if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) {
+                continue;
+            }
+            size_t len = Strlen(name);
+            if (base + len + 1 > PATH_MAX) {
+                report(w, n->path, -ENAMETOOLONG);
+                continue;
+            }
+            Memcpy(path + base, name, len + 1);
+
+            struct stat st;
+            struct walk_entry e = {
+                .path = path,
+                .name = path + base,
+                .dirfd = n->fd,
+                .depth = n->depth + 1,
+                .type = d->d_type,
+                .st = NULL,
+                .weight = 0,
+                .total = 0,
+            };
+            if ((w->flags & WALK_STAT) || e.type == DT_UNKNOWN) {
+                int r = sys_fstatat(n->fd, name, &st, AT_SYMLINK_NOFOLLOW);
+                if (r != 0) {
+                    report(w, path, r);
+                    continue;
+                }
+                e.type = mode_to_type(st.st_mode);
+                if (w->flags & WALK_STAT) {
+                    e.st = &st;
+                }
+            }
+            if ((w->flags & WALK_DEDUP) && e.st != NULL && e.type != DT_DIR &&
+                st.st_nlink > 1 && seen_before(w, st.st_dev, st.st_ino)) {
+                continue;
+            }
+
+            int r = w->ops->visit(&e, w->ops->ctx);
+            if (e.type != DT_DIR || r == WALK_SKIP) {
+                __atomic_add_fetch(&n->sum, e.weight, __ATOMIC_RELAXED);
+                continue;
+            }
+
+            struct wnode *child = node_new(w, n, path, base + len, len);
+            if (child == NULL) {
+                report(w, path, -ENOMEM);
+                continue;
+            }
+            // a directory's own weight is part of its total.
+            child->sum = e.weight;
+            __atomic_add_fetch(&n->fdrefs, 1, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&n->pending, 1, __ATOMIC_RELAXED);
+            push(w, child);
+        }
+    }
+    if (nread < 0) {
+        report(w, n->path, nread);
+    }
+
+    fd_release(n);
+    finish(w, n);
+}
+
+static int worker(void *arg) {
+    struct walker *w = arg;
+    char buf[DIRBUF] __attribute__((aligned(8)));
+    char path[PATH_MAX];
+
+    struct wnode *n;
+    while ((n = take(w)) != NULL) {
+        scan(w, n, buf, path);
+        scanned(w);
+    }
+    return 0;
+}
+
+int walk(const char *path, int flags, const struct walk_ops *ops) {
+    static struct walker w;
+    static struct thread workers[WALK_NTHREAD - 1];
+
+    Memset(&w, 0, sizeof(w));
+    w.flags = flags;
+    w.ops = ops;
+    if (!arena_init(&w.arena, 1ul << 32)) {
+        report(&w, path, -ENOMEM);
+        return -1;
+    }
+    if (flags & WALK_DEDUP) {
+        w.flags |= WALK_STAT;
+        w.seen = arena_alloc(&w.arena, SEEN_BUCKETS * sizeof(struct seen *));
+    }
+
+    // command line arguments are followed if they are symbolic links.
+    struct stat st;
+    int r = sys_fstatat(AT_FDCWD, path, &st, 0);
+    if (r != 0) {
+        report(&w, path, r);
+        arena_destroy(&w.arena);
+        return -1;
+    }
+
+    struct walk_entry e = {
+        .path = path,
+        .name = path,
+        .dirfd = AT_FDCWD,
+        .depth = 0,
+        .type = mode_to_type(st.st_mode),
+        .st = (w.flags & WALK_STAT) ? &st : NULL,
+        .weight = 0,
+        .total = 0,
+    };
+    r = ops->visit(&e, ops->ctx);
+    if (e.type != DT_DIR || r == WALK_SKIP) {
+        arena_destroy(&w.arena);
+        return w.failed ? -1 : 0;
+    }
+
+    size_t len = Strlen(path);
+    struct wnode *root = node_new(&w, NULL, path, len, len);
+    int fd = sys_open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root == NULL || fd < 0) {
+        report(&w, path, fd < 0 ? fd : -ENOMEM);
+        arena_destroy(&w.arena);
+        return -1;
+    }
+    root->fd = fd;
+    root->sum = e.weight;
+    push(&w, root);
+
+    int nworker = 0;
+    for (; nworker < WALK_NTHREAD - 1; nworker++) {
+        if (thread_create(&workers[nworker], worker, &w) != 0) {
+            break;
+        }
+    }
+    worker(&w);
+    for (int i = 0; i < nworker; i++) {
+        thread_join(&workers[i]);
+    }
+
+    arena_destroy(&w.arena);
+    return w.failed ? -1 : 0;
+}
@@ -0,0 +1,50 @@
+#ifndef _WALK_H_
+#define _WALK_H_
+
+/** A parallel, nftw-like directory tree walker.
+ *
+ * Every directory is opened with openat() relative to its parent's
+ * fd and its entries are examined with fstatat() relative to its own
+ * fd, so no path is ever resolved twice. Directories are handed to a
+ * pool of worker threads, hence the callbacks run concurrently and in
+ * no particular order; they must do their own locking. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sys.h"
+
+/** fstatat() every entry, otherwise only d_type is known. */
+#define WALK_STAT  0x1
+/** Visit files with several links only once per (st_dev, st_ino). */
+#define WALK_DEDUP 0x2
+
+/** Returned by visit: do not descend into this directory. */
+#define WALK_SKIP  1
+
+struct walk_entry {
+    const char *path;    // full path, valid during the callback only
+    const char *name;    // last component of path
+    int dirfd;           // fd of the containing directory
+    int depth;           // 0 for the roots
+    uint8_t type;        // DT_*
+    struct stat *st;     // NULL without WALK_STAT, and in post
+    /** Set by visit; summed into the total of every enclosing directory. */
+    uint64_t weight;
+    /** post only: the weight of the directory and everything below it. */
+    uint64_t total;
+};
+
+struct walk_ops {
+    /** Called for every entry, directories before their contents. */
+    int (*visit)(struct walk_entry *e, void *ctx);
+    /** Called for a directory after all its contents were visited. May be NULL. */
+    void (*post)(struct walk_entry *e, void *ctx);
+    /** Called when a path cannot be opened or stat'ed. May be NULL. */
+    void (*error)(const char *path, int err, void *ctx);
+    void *ctx;
+};
+
+/** Walk the tree rooted at path. Returns 0, or -1 if an error was reported. */
+extern int walk(const char *path, int flags, const struct walk_ops *ops);
+
+#endif // _WALK_H_
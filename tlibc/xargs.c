@@ -0,0 +1,281 @@
+#include "std.h"
+
+/** Bytes of arguments one command line may take, as GNU xargs limits
+ * itself to by default; far below what the kernel allows with the
+ * pointers and the environment on top. */
+#define ARG_MAX 131072
+#define MAXARGS (ARG_MAX / 2)
+#define PAGE 4096
+
+static struct {
+    bool nul;           // -0: items end in NUL, otherwise in newline
+    bool no_empty;      // -r: do not run the command for no input
+    long max_args;      // -n, 0 for as many as fit
+    long procs;         // -P
+} opt;
+
+/** The command line being built. Items point into the input. */
+static char *args[MAXARGS + 1];
+static size_t nbase;        // words of the command itself
+static size_t base_size;
+static size_t nargs;
+static size_t size;         // bytes of args[0..nargs), terminators included
+
+static long running;
+static bool ran;            // anything was run
+static bool stop;           // no more commands, only wait for the running ones
+static int status;
+
+static void die(const char *msg) __attribute__((noreturn));
+
+static void die(const char *msg) {
+    sys_write(2, "xargs: ", 7);
+    sys_write(2, msg, Strlen(msg));
+    sys_write(2, "\n", 1);
+    sys_exit(1);
+}
+
+static void *map_anon(size_t len) {
+    void *p = sys_mmap(NULL, len, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (long)p < 0 ? NULL : p;
+}
+
+/** Fold one child's end into the exit status, the way GNU xargs does:
+ * 123 if any command failed, and give up after a 255 or a signal. */
+static void account(const siginfo_t *info) {
+    if (info->si_code != CLD_EXITED) {
+        sys_write(2, "xargs: command killed by a signal\n", 34);
+        status = 125;
+        stop = true;
+    } else if (info->si_status == 255) {
+        sys_write(2, "xargs: command exited with status 255\n", 38);
+        status = 124;
+        stop = true;
+    } else if (info->si_status != 0 && status == 0) {
+        status = 123;
+    }
+}
+
+/** Reap whatever has ended without waiting; with block, wait for at
+ * least one child first. */
+static void reap(bool block) {
+    while (running > 0) {
+        siginfo_t info;
+        info.si_pid = 0;
+        int r = sys_waitid(P_ALL, 0, &info, WEXITED | (block ? 0 : WNOHANG));
+        if (r < 0 || info.si_pid == 0) {
+            return;
+        }
+        running--;
+        account(&info);
+        block = false;
+    }
+}
+
+/** Run the command line built so far, keeping at most -P of them running. */
+static void flush(void) {
+    if (stop) {
+        return;
+    }
+    args[nargs] = NULL;
+    int pid = exec_async(args);
+    if (pid < 0) {
+        sys_write(2, "xargs: ", 7);
+        sys_write(2, args[0], Strlen(args[0]));
+        const char *why = pid == -ENOENT ? ": not found\n" : ": cannot run\n";
+        sys_write(2, why, Strlen(why));
+        status = pid == -ENOENT ? 127 : 126;
+        stop = true;
+        return;
+    }
+    running++;
+    ran = true;
+    nargs = nbase;
+    size = base_size;
+    reap(running >= opt.procs);
+}
+
+static void add(char *item, size_t len) {
+    if (len == 0 && !opt.nul) {
+        return;         // blank line
+    }
+    size_t need = len + 1;
+    if (base_size + need > ARG_MAX) {
+        die("argument line too long");
+    }
+    if (size + need > ARG_MAX || nargs == MAXARGS) {
+        flush();
+    }
+    args[nargs++] = item;
+    size += need;
+    if (opt.max_args > 0 && (long)(nargs - nbase) == opt.max_args) {
+        flush();
+    }
+}
+
+/** Add the items ending in [p, e), terminated in place. Returns the
+ * start of the unfinished one. */
+static char *scan(char *p, char *e) {
+    char sep = opt.nul ? 0 : '\n';
+    char *s;
+    while (!stop && (s = Memchr(p, sep, e - p)) != NULL) {
+        *s = 0;
+        add(p, s - p);
+        p = s + 1;
+    }
+    return p;
+}
+
+/** A regular file: map it privately and cut it into items where it lies. */
+static void read_mapped(int fd, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    char *p = sys_mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if ((long)p < 0) {
+        die("cannot map input");
+    }
+    char *item = scan(p, p + len);
+    size_t rest = p + len - item;
+    if (rest == 0 || stop) {
+        return;
+    }
+    if (len % PAGE != 0) {
+        // the rest of the last page is there to hold the terminator.
+        item[rest] = 0;
+    } else {
+        static char last[ARG_MAX + 1];
+        if (rest > ARG_MAX) {
+            die("argument line too long");
+        }
+        item = Memcpy(last, item, rest);
+        item[rest] = 0;
+    }
+    add(item, rest);
+}
+
+/** A pipe: read into one buffer. The items of the pending command line
+ * stay where they are until the buffer is full, then move to its front. */
+static void read_stream(int fd) {
+    size_t cap = 4 * ARG_MAX;
+    char *buf = map_anon(cap);
+    if (buf == NULL) {
+        die("out of memory");
+    }
+    char *item = buf;
+    size_t len = 0;
+    while (!stop) {
+        if (len == cap - 1) {
+            char *keep = nargs > nbase ? args[nbase] : item;
+            if (keep == buf) {
+                die("argument line too long");
+            }
+            size_t delta = keep - buf;
+            Memmove(buf, keep, len - delta);
+            for (size_t i = nbase; i < nargs; i++) {
+                args[i] -= delta;
+            }
+            item -= delta;
+            len -= delta;
+        }
+        // one byte is kept for terminating a last item without separator.
+        long r = sys_read(fd, buf + len, cap - 1 - len);
+        if (r < 0) {
+            die("read error");
+        }
+        if (r == 0) {
+            break;
+        }
+        len += r;
+        item = scan(item, buf + len);
+    }
+    if (!stop && item < buf + len) {
+        buf[len] = 0;
+        add(item, buf + len - item);
+    }
+}
+
+static long parse_num(const char *s) {
+    long v = 0;
+    if (s == NULL || *s == 0) {
+        return -1;
+    }
+    for (; *s; s++) {
+        if (*s < '0' || *s > '9') {
+            return -1;
+        }
+        v = v * 10 + (*s - '0');
+    }
+    return v;
+}
+
+static int usage(void) {
+    static const char msg[] = "Usage: xargs [-0r] [-n max-args] [-P max-procs] [command [args...]]\n";
+    sys_write(2, msg, sizeof(msg) - 1);
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    opt.procs = 1;
+    int first = 1;
+    for (; first < argc && argv[first][0] == '-' && argv[first][1] != 0; first++) {
+        const char *a = argv[first];
+        if (Strcmp(a, "--") == 0) {
+            first++;
+            break;
+        }
+        for (a++; *a; a++) {
+            if (*a == '0') {
+                opt.nul = true;
+            } else if (*a == 'r') {
+                opt.no_empty = true;
+            } else if (*a == 'n' || *a == 'P') {
+                const char *v = a[1] ? a + 1 : argv[++first];
+                long n = parse_num(v);
+                if (n < 0 || (*a == 'n' && n == 0)) {
+                    return usage();
+                }
+                if (*a == 'n') {
+                    opt.max_args = n;
+                } else {
+                    // -P 0: as many at once as there are command lines.
+                    opt.procs = n > 0 ? n : INT32_MAX;
+                }
+                break;
+            } else {
+                return usage();
+            }
+        }
+    }
+
+    static char *echo[] = {"echo", NULL};
+    char **cmd = first < argc ? argv + first : echo;
+    for (; cmd[nbase] != NULL; nbase++) {
+        if (nbase == MAXARGS) {
+            die("argument line too long");
+        }
+        args[nbase] = cmd[nbase];
+        base_size += Strlen(cmd[nbase]) + 1;
+    }
+    if (base_size > ARG_MAX) {
+        die("argument line too long");
+    }
+    nargs = nbase;
+    size = base_size;
+
+    struct stat st;
+    if (sys_fstat(0, &st) == 0 && (st.st_mode & S_IFMT) == S_IFREG &&
+        sys_lseek(0, 0, SEEK_CUR) == 0) {
+        read_mapped(0, st.st_size);
+    } else {
+        read_stream(0);
+    }
+    if (nargs > nbase || (!ran && !opt.no_empty)) {
+        flush();
+    }
+    while (running > 0) {
+        reap(true);
+    }
+    return status;
+}
@@ -0,0 +1,301 @@
+#include "std.h"
+#include "zygote.h"
+
+#define ZYGOTE_MSG (64 << 10)   // the largest request; larger ones spawn here
+/** stdin, stdout, stderr and the working directory come first; then
+ * one for each action's fd above 2, and the terminal. */
+#define FD_CWD 3
+#define ZYGOTE_FDS (FD_CWD + 1 + SPAWN_MAX_ACTIONS + 1)
+
+/** A spawn action, with what points into the caller made relative. */
+struct request_action {
+    int op;
+    int fd;         // the fd in the child, or with slot set one passed
+    int slot;       // the index of the passed fd, or -1
+    int newfd;
+    int path;       // offset of the path in the text
+    int flags;
+    int mode;
+};
+
+struct request {
+    int argc;
+    int envc;
+    int nact;
+    int pgroup;
+    int tty;        // the index of the passed fd, or -1
+    uint64_t sigmask;
+    struct request_action act[SPAWN_MAX_ACTIONS];
+    char text[];    // argv, then envp, then the paths; each NUL-terminated
+};
+
+struct reply {
+    int pid;
+    int err;
+    int step;       // what failed: the request's action, or SPAWN_*
+};
+
+/** The control message of a request: up to ZYGOTE_FDS fds. */
+union control {
+    struct cmsghdr hdr;
+    char buf[sizeof(struct cmsghdr) + ZYGOTE_FDS * sizeof(int)];
+};
+
+static int zfd = -1;    // our end of the socket, -1 with no helper
+static int zpid;
+static int owner;       // who started it: a fork of ours has no socket
+static int helper_fd;   // the helper's end, in the helper
+
+// a request is built and read here; each process has its own.
+static char msg[ZYGOTE_MSG] __attribute__((aligned(8)));
+
+/** Append s to the text at *off, if it fits. */
+static bool put(struct request *rq, size_t *off, const char *s) {
+    size_t n = Strlen(s) + 1;
+    if (sizeof(msg) - offsetof(struct request, text) - *off < n) {
+        return false;
+    }
+    Memcpy(rq->text + *off, s, n);
+    *off += n;
+    return true;
+}
+
+/** Pack sp and argv into msg and the fds to pass into fds; origin gets
+ * the index in sp of each action of the request. Returns the length of
+ * the message, or 0 when it cannot be. */
+static size_t pack(const struct spawn *sp, char **argv, int *fds, int *nfd, int *origin) {
+    struct request *rq = (struct request *)msg;
+    Memset(rq, 0, sizeof(*rq));
+    size_t off = 0;
+    for (rq->argc = 0; argv[rq->argc] != NULL; rq->argc++) {
+        if (!put(rq, &off, argv[rq->argc])) {
+            return 0;
+        }
+    }
+    char **envp = sp != NULL && sp->envp != NULL ? sp->envp : environ;
+    for (rq->envc = 0; envp[rq->envc] != NULL; rq->envc++) {
+        if (!put(rq, &off, envp[rq->envc])) {
+            return 0;
+        }
+    }
+
+    // the helper's dup2 of 0 to 2 and fchdir come first.
+    if (sp != NULL && sp->nact + FD_CWD + 1 > SPAWN_MAX_ACTIONS) {
+        return 0;
+    }
+    if (sp != NULL && (sp->cpus != NULL || sp->nice != 0 || sp->policy >= 0)) {
+        return 0;   // rare enough to spawn here
+    }
+    *nfd = FD_CWD + 1;
+    rq->pgroup = sp != NULL ? sp->pgroup : -1;
+    rq->tty = -1;
+    if (sp != NULL && sp->tty >= 0) {
+        rq->tty = sp->tty <= 2 ? sp->tty : *nfd;
+        fds[*nfd] = sp->tty;
+        *nfd += sp->tty > 2;
+    }
+    if (sp != NULL && sp->setmask) {
+        rq->sigmask = sp->sigmask;
+    } else {
+        sys_rt_sigprocmask(SIG_BLOCK, NULL, &rq->sigmask, sizeof(uint64_t));
+    }
+    for (int i = 0; sp != NULL && i < sp->nact; i++) {
+        const struct spawn_action *a = &sp->act[i];
+        struct request_action *r = &rq->act[rq->nact];
+        *r = (struct request_action){
+            .op = a->op, .fd = a->fd, .slot = -1, .newfd = a->newfd,
+            .path = -1, .flags = a->flags, .mode = a->mode,
+        };
+        // the helper's own fds are above 2: the child's may not be.
+        if ((a->op == SPAWN_OPEN && a->fd > 2) || (a->op == SPAWN_DUP2 && a->newfd > 2)) {
+            return 0;
+        }
+        if (a->op == SPAWN_CLOSE && a->fd > 2) {
+            continue;   // the child has no such fd anyway
+        }
+        if (a->op == SPAWN_OPEN) {
+            r->path = off;
+            if (!put(rq, &off, a->path)) {
+                return 0;
+            }
+        } else if (a->fd > 2) {
+            r->slot = *nfd;
+            fds[(*nfd)++] = a->fd;
+        }
+        origin[rq->nact++] = i;
+    }
+    return offsetof(struct request, text) + off;
+}
+
+/** The child's spawn from a request and the fds it came with. */
+static void unpack(struct request *rq, const int *fds, struct spawn *sp, char **ptrs) {
+    char *p = rq->text;
+    for (int i = 0; i < rq->argc + rq->envc; i++) {
+        ptrs[i + (i >= rq->argc)] = p;
+        p += Strlen(p) + 1;
+    }
+    ptrs[rq->argc] = NULL;
+    ptrs[rq->argc + 1 + rq->envc] = NULL;
+
+    spawn_init(sp);
+    spawn_setpgroup(sp, rq->pgroup);
+    spawn_settty(sp, rq->tty >= 0 ? fds[rq->tty] : -1);
+    spawn_setsigmask(sp, rq->sigmask);
+    spawn_setenv(sp, ptrs + rq->argc + 1);
+    spawn_fchdir(sp, fds[FD_CWD]);
+    for (int fd = 0; fd <= 2; fd++) {
+        spawn_dup2(sp, fds[fd], fd);
+    }
+    for (int i = 0; i < rq->nact; i++) {
+        const struct request_action *r = &rq->act[i];
+        sp->act[sp->nact++] = (struct spawn_action){
+            .op = r->op, .fd = r->slot >= 0 ? fds[r->slot] : r->fd,
+            .newfd = r->newfd, .path = r->path >= 0 ? rq->text + r->path : NULL,
+            .flags = r->flags, .mode = r->mode,
+        };
+    }
+}
+
+/** The helper: one request at a time, until the caller closes its end. */
+static int zygote_main(int argc, char **argv) {
+    sys_fcntl(helper_fd, F_SETFD, FD_CLOEXEC);
+    // received fds must not land on 0 to 2, which the child's are.
+    for (int fd = 0; fd <= 2; fd++) {
+        if (sys_fcntl(fd, F_GETFD, 0) < 0) {
+            sys_openat(AT_FDCWD, "/dev/null", O_RDWR);
+        }
+    }
+    // argv, NULL, envp, NULL: at least a byte a string.
+    static char *ptrs[ZYGOTE_MSG / 2 + 2];
+    for (;;) {
+        union control ctl;
+        struct iovec iov = {msg, sizeof(msg)};
+        struct msghdr mh = {
+            .msg_iov = &iov, .msg_iovlen = 1,
+            .msg_control = ctl.buf, .msg_controllen = sizeof(ctl.buf),
+        };
+        long n = sys_recvmsg(helper_fd, &mh, MSG_CMSG_CLOEXEC);
+        if (n == -EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return 0;
+        }
+        const int *fds = (const int *)(ctl.buf + sizeof(struct cmsghdr));
+        int nfd = mh.msg_controllen < sizeof(struct cmsghdr) ? 0 :
+                  (ctl.hdr.cmsg_len - sizeof(struct cmsghdr)) / sizeof(int);
+        struct reply rep = {-EINVAL, 0, SPAWN_EXEC};
+        if (nfd > FD_CWD && (size_t)n >= offsetof(struct request, text)) {
+            struct spawn sp;
+            unpack((struct request *)msg, fds, &sp, ptrs);
+            rep.pid = spawn_sibling(&sp, ptrs, &rep.err);
+            // unpack's own actions come first: they are the setup to
+            // the caller.
+            rep.step = sp.failed < 0 ? sp.failed :
+                       sp.failed < FD_CWD + 1 ? SPAWN_SETUP : sp.failed - (FD_CWD + 1);
+        }
+        for (int i = 0; i < nfd; i++) {
+            sys_close(fds[i]);
+        }
+        sys_write(helper_fd, (const char *)&rep, sizeof(rep));
+    }
+}
+
+/** Is our helper there to ask? */
+static bool running(void) {
+    if (zfd >= 0 && owner != sys_getpid()) {
+        zfd = -1;   // closed by the fork, or another file by now
+    }
+    return zfd >= 0;
+}
+
+int zygote_start(void) {
+    if (running()) {
+        return 0;
+    }
+    int sv[2];
+    int r = sys_socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv);
+    if (r < 0) {
+        return r;
+    }
+    // spawn_fork's child closes what is close-on-exec: not its end.
+    helper_fd = sv[1];
+    sys_fcntl(helper_fd, F_SETFD, 0);
+    struct spawn sp;
+    spawn_init(&sp);
+    // a group of its own: ^C at the terminal is not for it.
+    spawn_setpgroup(&sp, 0);
+    static char *argv[] = {"zygote", NULL};
+    int pid = spawn_fork(&sp, zygote_main, argv);
+    sys_close(sv[1]);
+    if (pid < 0) {
+        sys_close(sv[0]);
+        return pid;
+    }
+    zfd = sv[0];
+    zpid = pid;
+    owner = sys_getpid();
+    return 0;
+}
+
+void zygote_stop(void) {
+    if (!running()) {
+        return;
+    }
+    sys_close(zfd);
+    zfd = -1;
+    while (sys_wait4(zpid, NULL, 0, NULL) == -EINTR) {}
+}
+
+/** Send a request and read the reply; false if the helper is gone. */
+static bool ask(size_t len, const int *fds, int nfd, struct reply *rep) {
+    union control ctl;
+    ctl.hdr = (struct cmsghdr){
+        .cmsg_len = sizeof(struct cmsghdr) + nfd * sizeof(int),
+        .cmsg_level = SOL_SOCKET,
+        .cmsg_type = SCM_RIGHTS,
+    };
+    Memcpy(ctl.buf + sizeof(struct cmsghdr), fds, nfd * sizeof(int));
+    struct iovec iov = {msg, len};
+    struct msghdr mh = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = ctl.buf, .msg_controllen = ctl.hdr.cmsg_len,
+    };
+    long n;
+    while ((n = sys_sendmsg(zfd, &mh, MSG_NOSIGNAL)) == -EINTR) {}
+    if (n < 0) {
+        return false;
+    }
+    while ((n = sys_read(zfd, (char *)rep, sizeof(*rep))) == -EINTR) {}
+    return n == sizeof(*rep);
+}
+
+int zygote_spawn(struct spawn *sp, char **argv) {
+    int fds[ZYGOTE_FDS] = {0, 1, 2};
+    int nfd;
+    int origin[SPAWN_MAX_ACTIONS];
+    size_t len = running() ? pack(sp, argv, fds, &nfd, origin) : 0;
+    if (len == 0) {
+        return spawn(sp, argv);
+    }
+    fds[FD_CWD] = sys_openat(AT_FDCWD, ".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (fds[FD_CWD] < 0) {
+        return spawn(sp, argv);
+    }
+    struct reply rep;
+    bool ok = ask(len, fds, nfd, &rep);
+    sys_close(fds[FD_CWD]);
+    if (!ok) {
+        // it died: on our own from now on.
+        zygote_stop();
+        return spawn(sp, argv);
+    }
+    if (rep.pid > 0 && rep.err < 0) {
+        sys_wait4(rep.pid, NULL, 0, NULL);
+        if (sp != NULL) {
+            sp->failed = rep.step >= 0 ? origin[rep.step] : rep.step;
+        }
+        return rep.err;
+    }
+    return rep.pid;
+}
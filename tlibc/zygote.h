@@ -0,0 +1,28 @@
+#ifndef _ZYGOTE_H_
+#define _ZYGOTE_H_
+
+/** A spawn helper: a process forked from the caller that spawns for
+ * it, so that the clone is of the helper and not of the caller. Each
+ * request is one message on a SOCK_SEQPACKET pair: argv, envp and the
+ * spawn actions packed, with the caller's stdin, stdout, stderr,
+ * working directory and the fds the actions name passed along as
+ * SCM_RIGHTS. The child is cloned with CLONE_PARENT, so it is the
+ * caller's to wait for, as one from spawn would be.
+ *
+ * The child gets no other fds of the caller; signal dispositions,
+ * umask and limits are those the caller had at zygote_start. */
+
+#include "spawn.h"
+
+/** Fork the helper, if none runs. Returns 0 or a negative errno. */
+extern int zygote_start(void);
+
+/** Close the helper's socket and reap it. */
+extern void zygote_stop(void);
+
+/** spawn, done by the helper. It is spawn itself when no helper runs,
+ * or the request is one it cannot take: larger than a message, with
+ * actions onto fds above 2, or scheduling set. */
+extern int zygote_spawn(struct spawn *sp, char **argv);
+
+#endif // _ZYGOTE_H_